@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <functional>
+#include <thread>
 
 #include <boost/asio.hpp>
 #include <boost/unordered/unordered_flat_map.hpp>
@@ -15,6 +16,7 @@
 
 namespace nsblast::lib {
 
+class AnswerCache;
 class DnsTcpSession;
 class Notifications;
 class SlaveMgr;
@@ -37,12 +39,15 @@ public:
         virtual ~Request() = default;
 
         boost::span<const char> span;
-        boost::uuids::uuid uuid = newUuid();
+        uint64_t id = newRequestId();
         // We set the truncate flag if we reach this limit.
         uint32_t maxReplyBytes = MAX_UDP_QUERY_BUFFER;
         bool is_tcp = false;
         mutable bool is_axfr = false;
         mutable bool is_ixfr = false;
+        // Set by the transport if the replies can no longer be delivered.
+        // Long replies, like zone-transfers, stop early.
+        mutable bool cancelled = false;
         endpoint_t endpoint;
     };
 
@@ -58,6 +63,9 @@ public:
             return false;
         }
 
+        /*! The port the endpoint is bound to */
+        virtual uint16_t localPort() const = 0;
+
         auto& parent() {
             return parent_;
         }
@@ -77,6 +85,15 @@ public:
     void start();
     void stop();
 
+    /*! The port the first UDP endpoint is bound to, or 0 if there is none.
+     *
+     *  Useful when dns_udp_port is 0, and the OS picks the port.
+     */
+    uint16_t udpPort() const;
+
+    /*! The port the first TCP endpoint is bound to, or 0 if there is none. */
+    uint16_t tcpPort() const;
+
     /*! Functor used to send a DNS reply
      *
      *  \param data Contains a message to send
@@ -106,10 +123,15 @@ public:
         return server_.resource();
     }
 
+    /*! The answer cache, or nullptr if it is disabled */
+    AnswerCache *answerCache() noexcept {
+        return answer_cache_.get();
+    }
+
     /*! Create and start a TCP session */
     tcp_session_t createTcpSession(tcp_t::socket && socket);
 
-    void removeTcpSession(boost::uuids::uuid uuid);
+    void removeTcpSession(uint64_t id);
 
     QtypeAllResponse getQtypeAllResponse(const Request& req, uint16_t type) const;
 
@@ -124,7 +146,15 @@ public:
 private:
     using endpoints_t = std::vector<std::shared_ptr<Endpoint>>;
 
+    // A thread with it's own io_context, used when dns_reuseport_workers is enabled
+    struct Worker {
+        boost::asio::io_context ctx{1};
+        std::thread thread;
+    };
+
     void startEndpoints();
+    void startReusePortWorkers();
+    void runWorker(size_t id);
     void handleNotify(const Request& request,
                       const Message& message,
                       const Message::Header& mhdr,
@@ -133,8 +163,7 @@ private:
                 const send_t& send,
                 const Message& message,
                 std::shared_ptr<MessageBuilder>& mb,
-                const ResourceIf::RealKey& key,
-                ResourceIf::TransactionIf& trx);
+                const ResourceIf::RealKey& key);
     void doIxfr(const Request& request,
                 const send_t& send,
                 const Message& message,
@@ -154,11 +183,13 @@ private:
                  const DnsEngine::send_t &send);
 
     Server& server_;
+    std::vector<std::unique_ptr<Worker>> workers_;
     endpoints_t endpoints_;
     std::once_flag stop_once_;
 
-    boost::unordered_flat_map<boost::uuids::uuid, tcp_session_t> tcp_sessions_; // Own the TCP session instances
+    boost::unordered_flat_map<uint64_t, tcp_session_t> tcp_sessions_; // Own the TCP session instances
     std::mutex tcp_session_mutex_;
+    std::unique_ptr<AnswerCache> answer_cache_;
 };
 
 
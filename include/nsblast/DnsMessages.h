@@ -6,6 +6,7 @@
 #include <deque>
 #include <boost/asio.hpp>
 #include <boost/uuid/string_generator.hpp>
+#include <boost/unordered/unordered_flat_map.hpp>
 #include "nsblast/nsblast.h"
 
 
@@ -180,6 +181,61 @@ private:
     boost::span<const char> buffer_view_; // A span over the full buffer
 };
 
+/*! Index over the domain-names in a message, used for name compression.
+ *
+ *  Maps a hash of each case-folded name suffix (like "example.com" and
+ *  "com" for "www.example.com") to the offset in the message where that
+ *  suffix starts. A name can then be compressed with one lookup per label.
+ *
+ *  The hashes are not unique. A match must be verified against the buffer.
+ */
+class LabelIndex {
+public:
+    // Hash for the root label
+    static constexpr uint64_t root_hash = 14695981039346656037ULL;
+
+    /*! Hash for a name suffix
+     *
+     *  \param label The first label in the suffix
+     *  \param suffixHash The hash for the rest of the suffix (or root_hash)
+     */
+    static uint64_t hash(std::string_view label, uint64_t suffixHash) noexcept {
+        constexpr uint64_t prime = 1099511628211ULL;
+        auto h = suffixHash;
+        h ^= label.size();
+        h *= prime;
+        for(const auto ch : label) {
+            h ^= static_cast<uint8_t>((ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch);
+            h *= prime;
+        }
+        return h;
+    }
+
+    /*! Get the offset for a suffix, if it is known */
+    std::optional<uint16_t> find(uint64_t hash) const {
+        if (auto it = index_.find(hash); it != index_.end()) {
+            return it->second;
+        }
+        return {};
+    }
+
+    /*! Add a suffix. If the hash is already known, the existing offset is kept. */
+    void add(uint64_t hash, uint16_t offset) {
+        index_.emplace(hash, offset);
+    }
+
+    void clear() {
+        index_.clear();
+    }
+
+    size_t size() const noexcept {
+        return index_.size();
+    }
+
+private:
+    boost::unordered_flat_map<uint64_t, uint16_t> index_;
+};
+
 /*! Representation for a query or Resource Record.
  *
  *  The rr does not own it's buffer.
@@ -950,10 +1006,33 @@ public:
 
     void finish();
 
+    /*! Clear the builder so it can be used for a new message.
+     *
+     *  The buffers keep their capacity.
+     */
+    void reset();
+
+    /*! Use a cached, finished reply as the reply to request.
+     *
+     *  The id and the RD flag are copied from the request, and so is
+     *  the question name, so the reply keeps the case used by the client.
+     *  Do not call finish() after this.
+     */
+    void setFromCachedReply(span_t reply, const Message& request);
+
     size_t size() const noexcept {
         return buffer_.size();
     }
 
+    /*! The capacity of the buffer. It's kept by reset(). */
+    size_t capacity() const noexcept {
+        return buffer_.capacity();
+    }
+
+    bool hasOpt() const noexcept {
+        return opt_.has_value();
+    }
+
     size_t maxBufferSize() const {
         return maxBufferSize_;
     }
@@ -972,7 +1051,7 @@ protected:
 
     buffer_t buffer_;
     size_t maxBufferSize_ = 0; // Not enforced if zero
-    std::deque<Labels> labels_; // Labels in the buffer. For compression.
+    LabelIndex labels_; // Name suffixes in the buffer. For compression.
     uint16_t rcode_ = 0;
     std::optional<OptValues> opt_;
 };
@@ -7,6 +7,7 @@
 #include "nsblast/nsblast.h"
 #include "nsblast/DnsMessages.h"
 #include "nsblast/util.h"
+#include "nsblast/ZoneIndex.h"
 
 namespace nsblast::lib {
 
@@ -49,6 +50,7 @@ public:
             TRXID,      // class uint64-trxid
             ZRR,        // zone-name, fqdn of RR in plain text
             TENANT_NAME,// Name of tenant, folded UTF8
+            DIFF_INDEX, // class reversed-fqdn. The serials and sizes of a zone's diff's
             UNKNOWN_    // Not used as a Class
         };
 
@@ -268,6 +270,18 @@ public:
         /*! Iterate over all data-items matching (starting with) key */
         virtual void iterate(key_t, iterator_fn_t fn, Category category = Category::ENTRY) = 0;
 
+        /*! Iterate over the entries in a zone, starting with the apex.
+         *
+         *  Meant for bulk reads, like AXFR. The iterator is bounded to
+         *  the zone's keys, and the data is not added to the block cache.
+         *
+         *  Child zones and delegations are included. It's up to the
+         *  caller to skip what's below a cut.
+         *
+         *  \param zoneKey ENTRY key for the zone's apex
+         */
+        virtual void iterateZone(key_t zoneKey, iterator_fn_t fn) = 0;
+
         /*! Get the Entry with the soa (zone) for a key.
          *
          *  \param fqdn name to query about. For zone "example.com", this may be
@@ -287,6 +301,23 @@ public:
          */
         virtual EntryWithBuffer lookup(std::string_view fqdn) = 0;
 
+        /*! Get the entries for several fqdn's in one batch
+         *
+         *  This is cheaper than calling lookup() for each fqdn, as the
+         *  database can process the keys together.
+         *
+         *  \return One EntryWithBuffer for each fqdn, in the same order.
+         *          The entries for keys that was not found are empty.
+         */
+        virtual std::vector<EntryWithBuffer> lookupBatch(const std::vector<std::string_view>& fqdns) {
+            std::vector<EntryWithBuffer> entries;
+            entries.reserve(fqdns.size());
+            for(const auto fqdn : fqdns) {
+                entries.emplace_back(lookup(fqdn));
+            }
+            return entries;
+        }
+
         /*! Check if an RR exists */
         virtual bool exists(std::string_view fqdn, uint16_t type = QTYPE_ALL) = 0;
 
@@ -321,6 +352,28 @@ public:
          */
         virtual void remove(key_t key, bool recursive = false, Category category = Category::ENTRY) = 0;
 
+        /*! Delete all keys from `from` (inclusive) to `to` (exclusive)
+         *
+         *  The keys are not locked, and the deleted keys remain visible
+         *  for reads in this transaction.
+         *
+         *  For Category::ENTRY, `from` must be a reversed fqdn followed by a dot,
+         *  so that all the names below that fqdn are deleted.
+         */
+        virtual void removeRange(span_t from, span_t to, Category category) = 0;
+
+        /*! Delete a zone
+         *
+         *  Removes the zone, all the entries below it and the diffs for
+         *  the zone, using range-deletes for the entries and diffs.
+         *
+         *  Child zones registered in the ACCOUNT column family, and the
+         *  entries below them, are kept.
+         *
+         *  \param fqdn Name of the zone. Must be lower case.
+         */
+        virtual void dropZone(std::string_view fqdn) = 0;
+
         /*! Low level read */
         virtual read_ptr_t read(key_t key, Category category = Category::ENTRY, bool throwIfNoeExixt = true) = 0;
         virtual bool read(key_t key, std::string& buffer, Category category = Category::ENTRY, bool throwIfNoeExixt = true) = 0;
@@ -328,8 +381,19 @@ public:
         virtual void commit() = 0;
         virtual void rollback() = 0;
 
-        const auto&  uuid() const noexcept {
-            return uuid_;
+        /*! Optimize the transaction for writing a large number of entries.
+         *
+         *  The writes goes straight into the transactions write-batch. The keys
+         *  are not locked or checked for conflicts with other transactions.
+         *
+         *  Only use this for bulk imports where it's acceptable that concurrent
+         *  changes to the same keys are overwritten.
+         */
+        virtual void setBulkMode() {}
+
+        /*! Process-unique id for the transaction. Mostly useful for logging. */
+        uint64_t id() const noexcept {
+            return id_;
         }
 
         /*! Get the replication-id for this transaction.
@@ -342,13 +406,55 @@ public:
         virtual uint64_t replicationId() const noexcept = 0;
 
     private:
-        const boost::uuids::uuid uuid_ = lib::newUuid();
+        const uint64_t id_ = lib::newRequestId();
     };
 
     ResourceIf() = default;
     virtual ~ResourceIf() = default;
 
     virtual std::unique_ptr<TransactionIf> transaction() = 0;
+
+    /*! Get a light-weight, read-only transaction.
+     *
+     *  Intended for the DNS query path, where we never write anything.
+     *  It avoids the overhead of a real database transaction (locks, names,
+     *  rollback on exit).
+     *
+     *  Any attempt to write or remove data throws an exception.
+     *
+     *  \param consistent If true, all reads in the transaction see the
+     *         database as it was when the transaction was created.
+     *         This has a small extra cost. If false, each read sees the
+     *         latest committed data.
+     */
+    virtual std::unique_ptr<TransactionIf> readOnlyTransaction(bool consistent = false) = 0;
+
+    /*! Get the in-memory zone index.
+     *
+     *  \return The index if it is enabled and loaded, or nullptr.
+     */
+    virtual const ZoneIndex *zoneIndex() const noexcept {
+        return {};
+    }
+
+    /*! False while the data can't be trusted, for example while a
+     *  database snapshot is being imported.
+     *
+     *  The DNS server fails queries while the resource is unavailable.
+     */
+    virtual bool available() const noexcept {
+        return true;
+    }
+
+    /*! Callback called when a transaction that changed entries is committed.
+     *
+     *  \param changes The fqdn's for the entries that was written or removed.
+     *  \param zonesChanged True if zones or delegations may have been added or removed.
+     */
+    using on_entries_changed_cb_t = std::function<void(const ZoneIndex::changes_t& changes, bool zonesChanged)>;
+
+    /*! Set (or with an empty callback, remove) the callback for changed entries. */
+    virtual void setEntriesChangedCallback(on_entries_changed_cb_t cb) = 0;
 };
 
 using trx_t = ResourceIf::TransactionIf;
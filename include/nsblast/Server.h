@@ -64,6 +64,13 @@ public:
     /*! Resets the admin user and nsblast account to it's initial, default state." */
     void resetAuth();
 
+    /*! Starts a DNS-only server on a secondary database instance.
+     *
+     *  Called by start() when `db_secondary` is set.
+     *  Returns when the server is done.
+     */
+    void startSecondary();
+
     void startRocksDb(bool init = true);
 
     void startIoThreads();
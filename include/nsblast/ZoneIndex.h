@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/unordered/unordered_flat_map.hpp>
+
+#include "nsblast/DnsMessages.h"
+
+namespace nsblast::lib {
+
+/*! In-memory index over all the zone apexes and delegation cuts.
+ *
+ *  The index lets us find the closest enclosing zone and delegation
+ *  cut for a fqdn without any database reads.
+ *
+ *  The keys are fqdn's in the same (lower-case, not reversed) format
+ *  as we use for lookups in the database.
+ *
+ *  The index is thread-safe.
+ */
+class ZoneIndex {
+public:
+    enum class Kind : uint8_t {
+        ZONE,   // Entry with a SOA
+        CUT     // Entry with NS, but no SOA (delegation)
+    };
+
+    /*! Result from findClosest()
+     *
+     *  The string_views points into the fqdn given to findClosest().
+     *  They are empty if nothing was found.
+     */
+    struct Match {
+        std::string_view zone;
+        std::string_view cut;
+    };
+
+    /*! A pending change to the index.
+     *
+     *  If kind is empty, the fqdn is removed from the index.
+     *
+     *  If end is set, all the fqdn's in the range [fqdn, end) are
+     *  removed from the index. The range use the same order as the
+     *  (reversed) keys in the database. This is used for range-deletes,
+     *  where we don't know the individual entries that was deleted.
+     */
+    struct Change {
+        std::string fqdn;
+        std::optional<Kind> kind;
+        std::optional<std::string> end;
+    };
+
+    using changes_t = std::vector<Change>;
+
+    ZoneIndex() = default;
+
+    /*! Get the kind of index entry a database Entry represents, if any */
+    static std::optional<Kind> toKind(span_t entry) noexcept;
+
+    void set(std::string_view fqdn, Kind kind);
+    void erase(std::string_view fqdn);
+
+    /*! Apply changes from a committed transaction
+     *
+     *  \return true if any zones or delegations were added, removed or changed kind.
+     *          Always true if there are suffix changes.
+     */
+    bool apply(const changes_t& changes);
+
+    /*! Find the closest zone that contains fqdn, and the delegation
+     *  cut (if any) between fqdn and that zone.
+     *
+     *  If there are several cuts, the one closest to the zone apex is returned.
+     *
+     *  fqdn itself is included in the search.
+     */
+    Match findClosest(std::string_view fqdn) const;
+
+    size_t size() const;
+    void clear();
+
+    /*! True when the index is fully loaded and can be trusted */
+    bool ready() const noexcept {
+        return ready_;
+    }
+
+    void setReady(bool ready = true) noexcept {
+        ready_ = ready;
+    }
+
+private:
+    struct Hash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view v) const noexcept {
+            return std::hash<std::string_view>{}(v);
+        }
+    };
+
+    boost::unordered_flat_map<std::string, Kind, Hash, std::equal_to<>> index_;
+    mutable std::shared_mutex mutex_;
+    std::atomic_bool ready_{false};
+};
+
+} // ns
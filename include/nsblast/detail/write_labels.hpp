@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
+#include <cctype>
 #include <regex>
+#include <span>
 
 #include "nsblast/DnsMessages.h"
 #include "nsblast/logging.h"
@@ -300,5 +303,126 @@ uint16_t writeLabels(const Labels& fqdn, P& existing, B& buffer, size_t maxLen)
     return len;
 }
 
+// Check if the name at `offset` in buffer equals labels[first...] (case-insensitive)
+template <typename B, typename L>
+bool suffixMatches(const B& buffer, uint16_t offset, const L& labels, size_t first) {
+    auto ptrs = 0;
+    auto i = first;
+    while(offset < buffer.size()) {
+        const auto len = static_cast<uint8_t>(buffer[offset]);
+        if ((len & START_OF_POINTER_TAG) == START_OF_POINTER_TAG) {
+            if (offset + 1 >= buffer.size() || ++ptrs > MAX_PTRS_IN_A_ROW) {
+                return false;
+            }
+            offset = resolvePtr(buffer, offset);
+            continue;
+        }
+
+        if (i == labels.size()) {
+            return len == 0;
+        }
+
+        const auto& label = labels[i];
+        if (len != label.size() || offset + 1 + len > buffer.size()) {
+            return false;
+        }
+
+        for(size_t c = 0; c < len; ++c) {
+            if (tolower(static_cast<uint8_t>(buffer[offset + 1 + c]))
+                != tolower(static_cast<uint8_t>(label[c]))) {
+                return false;
+            }
+        }
+
+        offset += 1 + len;
+        ++i;
+    }
+
+    return false;
+}
+
+// Same as above, but use a hash-index over the name-suffixes in the buffer,
+// so that each name is compressed in O(labels).
+// Unlike the version above, this one can be used with a buffer that is re-allocated.
+template <typename B>
+uint16_t writeLabels(const Labels& fqdn, LabelIndex& index, B& buffer, size_t maxLen) {
+    // Is it a root-label?
+    if (fqdn.bytes() == 1) {
+        if (maxLen && buffer.size() + 1 > maxLen) {
+            LOG_TRACE << "writeLabels: Exeeded maxLen";
+            return 0;
+        }
+        buffer.push_back(0);
+        return 1;
+    }
+
+    // A fqdn can not have more than 127 labels
+    array<string_view, 128> labels;
+    array<uint64_t, 128> hashes;
+    size_t num_labels = 0;
+
+    for(const auto label : fqdn) {
+        if (label.empty()) {
+            break; // root
+        }
+        if (num_labels >= labels.size()) {
+            throw runtime_error{"writeLabels: Too many labels in fqdn"};
+        }
+        labels[num_labels++] = label;
+    }
+
+    // Hash all the suffixes, starting with the top level domain
+    auto suffix_hash = LabelIndex::root_hash;
+    for(auto i = num_labels; i > 0; --i) {
+        suffix_hash = LabelIndex::hash(labels[i - 1], suffix_hash);
+        hashes[i - 1] = suffix_hash;
+    }
+
+    // Find the longest suffix that is already in the buffer
+    const std::span<const string_view> needle{labels.data(), num_labels};
+    auto first_compressed = num_labels;
+    uint16_t ptr = 0;
+    for(size_t i = 0; i < num_labels; ++i) {
+        if (const auto offset = index.find(hashes[i])) {
+            if (suffixMatches(buffer, *offset, needle, i)) {
+                first_compressed = i;
+                ptr = *offset;
+                break;
+            }
+        }
+    }
+
+    const bool compressed = first_compressed < num_labels;
+    size_t len = compressed ? 2 : 1; // Pointer or root
+    for(size_t i = 0; i < first_compressed; ++i) {
+        len += labels[i].size() + 1;
+    }
+
+    if (maxLen && (len >= maxLen)) {
+        LOG_TRACE << "writeLabels: Exeeded maxLen";
+        return 0;
+    }
+
+    const auto orig_buffer_size = buffer.size();
+    buffer.reserve(orig_buffer_size + len);
+    for(size_t i = 0; i < first_compressed; ++i) {
+        // Pointers can only address the first 16K of the message
+        if (buffer.size() < 0x4000) {
+            index.add(hashes[i], static_cast<uint16_t>(buffer.size()));
+        }
+        buffer.push_back(labels[i].size());
+        copy(labels[i].begin(), labels[i].end(), back_inserter(buffer));
+    }
+
+    if (compressed) {
+        buffer.resize(buffer.size() + 2);
+        writeNamePtr(buffer, buffer.size() - 2, ptr);
+    } else {
+        buffer.push_back(0);
+    }
+
+    assert(buffer.size() - orig_buffer_size == len);
+    return len;
+}
 
 } // ns
@@ -81,6 +81,19 @@ public:
     int httpError() const noexcept override { return 403; }
 };
 
+/*! Thrown when a transaction fails to commit because another transaction
+ *  changed some of the same keys. The operation can be retried.
+ */
+class ConflictException : public Exception {
+public:
+    ConflictException(const std::string& what) noexcept
+        : Exception(what) {}
+
+    ConflictException(const std::string& what, const std::string& httpMessage) noexcept
+        : Exception(what, httpMessage) {}
+
+    int httpError() const noexcept override { return 409; }
+};
 
 class InternalErrorException : public Exception {
 public:
@@ -51,6 +51,33 @@ struct Config {
 
     /// Unique node-name in a cluster. Defaults to the hostname of the machine.
     std::string node_name = boost::asio::ip::host_name();
+
+    /*! Keep an in-memory index of all zones and delegations.
+     *
+     *  This allows the DNS server to find the zone for a name without
+     *  probing the database for each label. The index is built when the
+     *  database is opened, which may take some time for large databases.
+     */
+    bool db_zone_index = true;
+
+    /*! Open db_path as a read-only RocksDB secondary instance.
+     *
+     *  Used to run extra DNS-only processes on the same host as the
+     *  nsblast server that owns the database. The secondary instance
+     *  follows the primary instance by tailing its MANIFEST and WAL.
+     *  The HTTP server, the REST API, replication and backups are
+     *  not started in this mode.
+     */
+    bool db_secondary = false;
+
+    /*! Directory where the secondary instance keeps its own files.
+     *
+     *  Defaults to db_path + "/secondary-<pid>", which is deleted when the database is closed.
+     */
+    std::string db_secondary_path;
+
+    /// Milliseconds between each time the secondary instance catches up with the primary.
+    size_t db_secondary_catchup_interval = 500;
     ///@}
 
     /*! \name Backup / Restore */
@@ -64,6 +91,9 @@ struct Config {
     /// Tells RocksDB to sync the database before starting a backup
     bool sync_before_backup = true;
 
+    /// Max bytes per second written by a backup. 0 == no limit.
+    size_t backup_rate_limit = 0;
+
     ///@}
 
     /*! \name Cluster */
@@ -103,6 +133,73 @@ struct Config {
     /// Milliseconds to wait before ackowledinging the current trx-id from a follower.
     size_t cluster_ack_delay = 200;
 
+    /*! \brief Retention policy for the transaction-log.
+     *
+     *  A transaction is deleted if any of the enabled rules allows it.
+     *  The last transaction is always kept. A follower that needs
+     *  transactions that are deleted must be bootstrapped again.
+     */
+
+    /// Max number of transactions to keep in the transaction-log. 0 == no limit.
+    size_t cluster_trxlog_retention_count = 0;
+
+    /// Max age in seconds for transactions in the transaction-log. 0 == no limit.
+    size_t cluster_trxlog_retention_age = 0;
+
+    /*! Delete transactions when all the connected followers have confirmed them.
+     *
+     *  Only the followers that are connected when the log is pruned are
+     *  considered. A follower that is disconnected, for example while it
+     *  restarts, may have to be bootstrapped again when it reconnects.
+     */
+    bool cluster_trxlog_prune_confirmed = false;
+
+    /// Seconds between each time the retention policy is enforced.
+    size_t cluster_trxlog_prune_interval = 300;
+
+    /*! Max size in bytes of the transactions the primary sends to a follower in one message.
+     *
+     *  Transactions that are queued for a follower while the previous
+     *  message is being sent, are sent together in one message, and
+     *  applied by the follower in one database write. 0 == one
+     *  transaction per message.
+     */
+    size_t cluster_sync_batch_max_bytes = 1024 * 1024;
+
+    /*! Milliseconds the primary may wait for more transactions to fill a batch. 0 == don't wait.
+     *
+     *  Must be low enough that the queue for the follower, limited by
+     *  cluster_repl_agent_max_queue_size, don't fill up while we wait.
+     */
+    size_t cluster_sync_batch_max_delay = 0;
+
+    /*! Let a follower bootstrap from a snapshot of the primary's database.
+     *
+     *  This is done when a follower starts with an empty transaction-log,
+     *  and when the primary has pruned the transactions the follower needs.
+     *  The snapshot replaces all the zone-data on the follower.
+     */
+    bool cluster_follower_bootstrap = true;
+
+    /*! Compression of the updates the primary sends to the followers.
+     *
+     *  - none: Don't compress
+     *  - lz4:  LZ4 compression. On the primary, it is only used if the
+     *          follower also has this setting.
+     */
+    std::string cluster_sync_compression = "lz4";
+
+    /// Updates smaller than this number of bytes are sent uncompressed.
+    size_t cluster_sync_compression_min_bytes = 256;
+
+    /*! Max number of updates from the primary a follower prepares or waits to commit.
+     *
+     *  The updates are prepared in parallel by the worker-threads, and
+     *  written to the database in order, without database transactions.
+     *  0 == apply each update in a database transaction when it is received.
+     */
+    size_t cluster_follower_apply_queue_size = 64;
+
 
     /*! Role of this server.
      *
@@ -130,6 +227,37 @@ struct Config {
      */
     size_t num_dns_threads = 6;
 
+    /*! Max number of UDP datagrams to receive and send per system-call.
+     *
+     *  If > 0, the UDP endpoints use recvmmsg() and sendmmsg() to
+     *  process up to this many requests each time a socket becomes
+     *  readable. 0 receives and sends one datagram at the time.
+     *
+     *  Only supported on Linux.
+     */
+    size_t dns_udp_batch_size = 0;
+
+    /*! Give each DNS thread it's own io_context and sockets.
+     *
+     *  If true, num_dns_threads workers are started for DNS. Each one
+     *  opens it's own UDP and TCP sockets with SO_REUSEPORT, and the
+     *  kernel spreads the traffic between them. This avoids hand-off
+     *  between threads and lock contention in the shared io_context.
+     *
+     *  The shared thread-pool is still used for everything else,
+     *  but with at most two threads, as the DNS traffic don't use it.
+     *
+     *  If the port is 0, all the workers use the port the OS picked
+     *  for the first worker.
+     */
+    bool dns_reuseport_workers = false;
+
+    /*! Pin each DNS worker to a CPU core. Only used with dns_reuseport_workers.
+     *
+     *  The workers are spread over the CPU's in the process' affinity mask.
+     */
+    bool dns_pin_workers = false;
+
     /*! endpoint to the DNS interface.
      *
      *  Can be a hostname or an IP address (ipv4 or IPv6).
@@ -155,6 +283,20 @@ struct Config {
     /*! DNS TCP connection idle time for QUERY sessions in seconds */
     uint32_t dns_tcp_idle_time = 3;
 
+    /*! Max number of requests processed in parallel on one DNS TCP connection.
+     *
+     *  The replies are sent as they become ready, so they may be sent in
+     *  a different order than the requests (RFC 7766). 1 processes
+     *  one request at the time.
+     */
+    uint32_t dns_tcp_max_inflight = 16;
+
+    /*! Max bytes waiting to be sent on one DNS TCP connection before
+     *  the requests producing replies (like zone transfers) are paused.
+     *  0 disables the limit.
+     */
+    size_t dns_tcp_max_queued_bytes = 1024 * 1024;
+
     /*! The servers response to QTYPE=ANY on UDP
      *  One of:
      *    - hinfo    Follow RFC 8482's reccomondation and return a specially crafted HINFO record.
@@ -202,6 +344,16 @@ struct Config {
      */
     bool dns_enable_ixfr = true;
 
+    /*! Max number of IXFR diff's to keep for each zone. 0 == no limit.
+     *
+     *  When a zone change, the oldest diff's outside the window are deleted.
+     *  IXFR requests from serials older than the window get a full zone transfer.
+     */
+    size_t dns_ixfr_max_diffs = 200;
+
+    /// Max total size in bytes of the IXFR diff's to keep for each zone. 0 == no limit.
+    size_t dns_ixfr_max_diff_bytes = 1024 * 1024;
+
     /*! Enable RFC 1996 NOTIFY messages
      *
      *  This causes a master server to send NOTIFY messages over UDP when a
@@ -218,6 +370,18 @@ struct Config {
     /*! Default nameserver configuration for new zones. First server is primary */
     std::vector<std::string> default_name_servers;
 
+    /*! Max number of rendered replies to keep in the answer cache.
+     *
+     *  The cache is invalidated when the entries a reply was built from
+     *  are changed, both locally and by replication. 0 disables the cache.
+     *
+     *  1/8 of the entries are reserved for negative replies (NXDOMAIN and NODATA).
+     */
+    size_t dns_answer_cache_size = 65536;
+
+    /*! Number of shards (locks) in the answer cache */
+    size_t dns_answer_cache_shards = 16;
+
     ///@}
 
     /*! \name HTTP */
@@ -233,6 +397,19 @@ struct Config {
 
     /// Default page size in a REST list reply
     size_t rest_default_page_size = 100;
+
+    /*! Max number of entries to write in each database transaction during a bulk import.
+     *
+     *  Each batch is committed (and replicated) as one transaction.
+     */
+    size_t rest_import_batch_size = 10000;
+
+    /*! Number of times to retry a REST write request that failed
+     *  because of a conflicting concurrent transaction.
+     *
+     *  Only relevant when `rocksdb_transaction_db` is "optimistic".
+     */
+    unsigned rest_write_retries = 3;
     ///@}
 
     /*! \name Authentication */
@@ -254,6 +431,47 @@ struct Config {
 
     /// Number of threads for flush and compaction. 0 == use default.
     size_t rocksdb_background_threads = 0;
+
+    /// Size of the block cache shared by all the column families. 0 == use RocksDB's default.
+    size_t rocksdb_block_cache_size = 256 * 1024 * 1024;
+
+    /// Type of block cache. "lru" or "hyperclock"
+    std::string rocksdb_block_cache_type = "lru";
+
+    /*! Bits per key for the bloom filter in the entry column family. 0 == no filter.
+     *
+     *  The filter lets lookups for names that don't exist skip the
+     *  SST files without reading their index blocks.
+     */
+    double rocksdb_entry_bloom_bits = 10.0;
+
+    /// Use a bloom filter on the fqdn-prefix of the keys in the diff column family.
+    bool rocksdb_diff_prefix_bloom = true;
+
+    /// Collect internal statistics in RocksDB, and export them to /metrics.
+    bool rocksdb_statistics = true;
+
+    /*! Type of transaction database. "pessimistic" or "optimistic"
+     *
+     *  Pessimistic transactions lock the keys as they are written.
+     *  Optimistic transactions don't take locks, but validate on commit
+     *  that no other transaction has changed the same keys. A commit
+     *  that fails validation is retried by the REST API.
+     */
+    std::string rocksdb_transaction_db = "pessimistic";
+
+    /*! Max bytes per second for flush and compaction I/O. 0 == no limit.
+     *
+     *  Flushes are given priority over compactions. Reads and writes
+     *  from DNS and API requests are not limited.
+     */
+    size_t rocksdb_rate_limit = 0;
+
+    /// Let RocksDB adjust the rate limit to the actual need, with rocksdb_rate_limit as the upper bound.
+    bool rocksdb_rate_limit_auto_tune = false;
+
+    /// Readahead size in bytes for bulk reads, like zone transfers. 0 == use RocksDB's default.
+    size_t rocksdb_bulk_readahead_size = 2 * 1024 * 1024;
     ///@}
 
     /*! \name Certs */
@@ -272,6 +490,16 @@ struct Config {
     /// Disable authentication for metrics
     bool no_metrics_auth = false;
 
+    /// Seconds between each update of the metrics we get from RocksDB. 0 == disabled.
+    unsigned metrics_rocksdb_interval = 15;
+
+    /*! Sample RocksDB's PerfContext for one in this many DNS requests. 0 == disabled.
+     *
+     *  The sampled requests are slightly slower, as RocksDB needs to
+     *  collect the counters and timers for them. Only UDP requests are sampled.
+     */
+    unsigned metrics_dns_perf_sample_rate = 0;
+
     ///@}
 };
 
@@ -43,6 +43,15 @@ concept input_range_of =
 
     boost::uuids::uuid newUuid();
     std::string newUuidStr();
+
+    /*! Get a cheap id for a request, session or transaction.
+     *
+     *  The id is unique within this process (but not across restarts or
+     *  servers). Each thread reserves a block of ids from a shared atomic
+     *  counter, so there are no locks, and the shared counter is rarely
+     *  touched. Use newUuid() if the id must be globally unique.
+     */
+    uint64_t newRequestId() noexcept;
     bool isValidUuid(std::string_view uuid);
     std::string utf8FoldCase(std::string_view from);
 
@@ -156,6 +165,14 @@ concept input_range_of =
         *val = boost::endian::native_to_big(value);
     }
 
+    /*! Compare two SOA serials using serial number arithmetic (RFC 1982)
+     *
+     *  \return true if `left` is an older serial than `right`
+     */
+    constexpr bool isSerialBefore(uint32_t left, uint32_t right) noexcept {
+        return left != right && static_cast<uint32_t>(right - left) < 0x80000000u;
+    }
+
     // Construct a string from a range
     std::string make_string(const range_of<char> auto& range) {
         std::string str;
@@ -0,0 +1,251 @@
+
+#include <cassert>
+
+#include "AnswerCache.h"
+#include "nsblast/logging.h"
+#include "nsblast/util.h"
+
+using namespace std;
+
+namespace nsblast::lib {
+
+namespace {
+
+// Part of the cache that can be used for negative replies
+constexpr size_t negative_share = 8;
+
+} // anon ns
+
+AnswerCache::AnswerCache(size_t maxEntries, size_t numShards)
+    : max_entries_per_shard_{max<size_t>(maxEntries / max<size_t>(numShards, 1), 1)}
+    , max_negative_per_shard_{max<size_t>(max_entries_per_shard_ / negative_share, 1)}
+    , max_positive_per_shard_{max<size_t>(max_entries_per_shard_ - max_negative_per_shard_, 1)}
+{
+    shards_.resize(max<size_t>(numShards, 1));
+    for(auto& s : shards_) {
+        s = make_unique<Shard>();
+    }
+
+    LOG_DEBUG << "AnswerCache - Created cache with " << shards_.size()
+              << " shards and " << max_entries_per_shard_ << " entries per shard ("
+              << max_negative_per_shard_ << " negative).";
+}
+
+string AnswerCache::makeKey(string_view fqdn, uint16_t qtype, uint32_t maxBufferSize,
+                            bool opt, bool tcp)
+{
+    string key;
+    key.reserve(fqdn.size() + 1 + sizeof(qtype) + sizeof(maxBufferSize) + 1);
+    key.append(fqdn);
+    key.push_back(0);
+
+    auto offset = key.size();
+    key.resize(offset + sizeof(qtype) + sizeof(maxBufferSize) + 1);
+    setValueAt(key, offset, qtype);
+    offset += sizeof(qtype);
+    setValueAt(key, offset, maxBufferSize);
+    offset += sizeof(maxBufferSize);
+    key[offset] = static_cast<char>((opt ? 1 : 0) | (tcp ? 2 : 0));
+    return key;
+}
+
+AnswerCache::reply_t AnswerCache::get(string_view key)
+{
+    auto& s = shard(key);
+    lock_guard lock{s.mutex};
+    if (auto it = s.items.find(key); it != s.items.end()) {
+        it->second.referenced = true;
+        return it->second.reply;
+    }
+
+    return {};
+}
+
+void AnswerCache::put(string key, span_t reply, deps_t deps, uint64_t generation, bool negative)
+{
+    auto r = make_shared<const string>(reply.data(), reply.size());
+
+    auto& s = shard(key);
+    lock_guard lock{s.mutex};
+
+    // Only invalidations of the entries this reply depends on makes it stale.
+    // The generations are set before the shards are touched. See invalidate().
+    const auto stale = cleared_ > generation || ranges::any_of(deps, [&](const auto& dep) {
+        return invalidated(dep) > generation;
+    });
+    if (stale) {
+        LOG_TRACE << "AnswerCache::put - The cache was invalidated while the reply was made. Ignoring it.";
+        return;
+    }
+
+    s.erase(key);
+    s.evict(negative, negative ? max_negative_per_shard_ : max_positive_per_shard_);
+
+    const auto seq = ++s.seq;
+    for(const auto& dep : deps) {
+        s.deps[dep].push_back(key);
+    }
+    (negative ? s.negative_ring : s.ring).emplace_back(key, seq);
+    s.num_negative += negative ? 1 : 0;
+    s.items.emplace(std::move(key), Item{std::move(r), std::move(deps), seq, negative});
+}
+
+void AnswerCache::invalidate(string_view fqdn)
+{
+    // Must be set before we touch the shards. See put().
+    setMax(invalidated(fqdn), newGeneration());
+
+    for(auto& s : shards_) {
+        lock_guard lock{s->mutex};
+        s->invalidate(fqdn);
+    }
+}
+
+void AnswerCache::invalidate(const ZoneIndex::changes_t &changes, bool zonesChanged)
+{
+    if (zonesChanged) {
+        LOG_TRACE << "AnswerCache::invalidate - Zones or delegations changed. Clearing the cache.";
+        clear();
+        return;
+    }
+
+    if (changes.empty()) {
+        return;
+    }
+
+    const auto generation = newGeneration();
+    for(const auto& change : changes) {
+        setMax(invalidated(change.fqdn), generation);
+    }
+
+    for(auto& s : shards_) {
+        lock_guard lock{s->mutex};
+        for(const auto& change : changes) {
+            s->invalidate(change.fqdn);
+        }
+    }
+}
+
+void AnswerCache::clear()
+{
+    setMax(cleared_, newGeneration());
+
+    for(auto& s : shards_) {
+        lock_guard lock{s->mutex};
+        s->items.clear();
+        s->deps.clear();
+        s->ring.clear();
+        s->negative_ring.clear();
+        s->num_negative = 0;
+    }
+}
+
+size_t AnswerCache::size() const
+{
+    size_t count = 0;
+    for(const auto& s : shards_) {
+        lock_guard lock{s->mutex};
+        count += s->items.size();
+    }
+
+    return count;
+}
+
+AnswerCache::Shard &AnswerCache::shard(string_view key)
+{
+    return *shards_[Hash{}(key) % shards_.size()];
+}
+
+atomic_uint64_t &AnswerCache::invalidated(string_view fqdn) noexcept
+{
+    return invalidated_[Hash{}(fqdn) % invalidated_.size()];
+}
+
+uint64_t AnswerCache::newGeneration() noexcept
+{
+    return ++generation_;
+}
+
+void AnswerCache::setMax(atomic_uint64_t &value, uint64_t generation) noexcept
+{
+    // Concurrent invalidations may finish in any order. Never go back.
+    auto current = value.load();
+    while(current < generation && !value.compare_exchange_weak(current, generation)) {
+        ;
+    }
+}
+
+void AnswerCache::Shard::erase(string_view key)
+{
+    auto it = items.find(key);
+    if (it == items.end()) {
+        return;
+    }
+
+    for(const auto& dep : it->second.deps) {
+        if (auto d = deps.find(dep); d != deps.end()) {
+            std::erase(d->second, key);
+            if (d->second.empty()) {
+                deps.erase(d);
+            }
+        }
+    }
+
+    if (it->second.negative) {
+        assert(num_negative > 0);
+        --num_negative;
+    }
+    items.erase(it);
+}
+
+void AnswerCache::Shard::evict(bool negative, size_t maxCount)
+{
+    auto& r = negative ? negative_ring : ring;
+    const auto count = [&] {
+        return negative ? num_negative : items.size() - num_negative;
+    };
+
+    while(count() >= maxCount && !r.empty()) {
+        auto oldest = std::move(r.front());
+        r.pop_front();
+
+        auto it = items.find(oldest.first);
+        if (it == items.end() || it->second.seq != oldest.second) {
+            // Already removed or replaced
+            continue;
+        }
+
+        if (it->second.referenced) {
+            it->second.referenced = false;
+            r.push_back(std::move(oldest));
+            continue;
+        }
+
+        erase(oldest.first);
+    }
+
+    // Invalidated replies leave their keys in the ring
+    if (r.size() > maxCount * 2) {
+        std::erase_if(r, [this](const auto& v) {
+            const auto it = items.find(v.first);
+            return it == items.end() || it->second.seq != v.second;
+        });
+    }
+}
+
+void AnswerCache::Shard::invalidate(string_view fqdn)
+{
+    auto d = deps.find(fqdn);
+    if (d == deps.end()) {
+        return;
+    }
+
+    // erase() modifies `deps`, so we need our own copy of the keys
+    const auto keys = std::move(d->second);
+    deps.erase(d);
+    for(const auto& key : keys) {
+        erase(key);
+    }
+}
+
+} // ns
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/unordered/unordered_flat_map.hpp>
+
+#include "nsblast/nsblast.h"
+#include "nsblast/ZoneIndex.h"
+
+namespace nsblast::lib {
+
+/*! Cache for fully rendered DNS replies.
+ *
+ *  The key is the lower-case qname, the qtype and the properties of
+ *  the request that affects the layout of the reply (EDNS buffer-size,
+ *  OPT, TCP/UDP).
+ *
+ *  Each cached reply remembers the fqdn's it was built from, so that
+ *  a change to any of them removes the reply from the cache.
+ *
+ *  The cache is split in shards, each with its own mutex, to reduce
+ *  lock contention between the DNS worker threads.
+ *
+ *  Replies are evicted with the CLOCK algorithm, so replies that are
+ *  used stay in the cache. Negative replies (NXDOMAIN and NODATA) have
+ *  their own, smaller budget, so that queries for random names can not
+ *  push the positive replies out of the cache.
+ */
+class AnswerCache {
+public:
+    using reply_t = std::shared_ptr<const std::string>;
+    using deps_t = std::vector<std::string>;
+
+    AnswerCache(size_t maxEntries, size_t numShards);
+
+    static std::string makeKey(std::string_view fqdn, uint16_t qtype,
+                               uint32_t maxBufferSize, bool opt, bool tcp);
+
+    /*! Current generation. Must be read before the data for a reply is looked up in the database.
+     *
+     *  Each invalidation gets a new generation.
+     */
+    uint64_t generation() const noexcept {
+        return generation_;
+    }
+
+    /*! Get a cached reply. Returns nullptr if it was not found. */
+    reply_t get(std::string_view key);
+
+    /*! Add a reply to the cache.
+     *
+     *  \param key Key from makeKey()
+     *  \param reply The rendered reply
+     *  \param deps The fqdn's that was looked up to build the reply
+     *  \param generation The value of generation() before the first lookup
+     *         for the reply. If any of the deps (or the entire cache) has been
+     *         invalidated after that, the reply may be stale, and it is not added.
+     *  \param negative True for NXDOMAIN and NODATA replies
+     */
+    void put(std::string key, span_t reply, deps_t deps, uint64_t generation,
+             bool negative = false);
+
+    /*! Remove all replies that depends on fqdn */
+    void invalidate(std::string_view fqdn);
+
+    /*! Remove all replies that depends on the changed entries.
+     *
+     *  \param changes Changed entries
+     *  \param zonesChanged True if zones or delegations were added or removed.
+     *         In that case we cannot know what replies are affected, and the
+     *         entire cache is cleared.
+     */
+    void invalidate(const ZoneIndex::changes_t& changes, bool zonesChanged);
+
+    void clear();
+
+    size_t size() const;
+
+private:
+    struct Hash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view v) const noexcept {
+            return std::hash<std::string_view>{}(v);
+        }
+    };
+
+    struct Item {
+        reply_t reply;
+        deps_t deps;
+        uint64_t seq = 0;
+        bool negative = false;
+        // Set when the reply is used. Gives the reply a second chance when it's up for eviction.
+        bool referenced = false;
+    };
+
+    // The keys in the order they were added, for the CLOCK eviction.
+    using ring_t = std::deque<std::pair<std::string, uint64_t>>;
+
+    struct Shard {
+        void erase(std::string_view key);
+        void invalidate(std::string_view fqdn);
+        void evict(bool negative, size_t maxCount);
+
+        boost::unordered_flat_map<std::string, Item, Hash, std::equal_to<>> items;
+        boost::unordered_flat_map<std::string, std::vector<std::string>, Hash, std::equal_to<>> deps;
+        ring_t ring;
+        ring_t negative_ring;
+        size_t num_negative = 0;
+        uint64_t seq = 0;
+        mutable std::mutex mutex;
+    };
+
+    // Number of buckets for the generations when fqdn's was last invalidated.
+    static constexpr size_t num_invalidated_buckets_ = 4096;
+
+    Shard& shard(std::string_view key);
+    std::atomic_uint64_t& invalidated(std::string_view fqdn) noexcept;
+    uint64_t newGeneration() noexcept;
+    static void setMax(std::atomic_uint64_t& value, uint64_t generation) noexcept;
+
+    const size_t max_entries_per_shard_;
+    const size_t max_negative_per_shard_;
+    const size_t max_positive_per_shard_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic_uint64_t generation_{0};
+    // The last generation when the cache was cleared
+    std::atomic_uint64_t cleared_{0};
+    // The last generation when any fqdn with that hash was invalidated
+    std::array<std::atomic_uint64_t, num_invalidated_buckets_> invalidated_{};
+};
+
+} // ns
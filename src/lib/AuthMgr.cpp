@@ -275,7 +275,7 @@ void AuthMgr::deleteZone(trx_t &trx, std::string_view fqdn, std::string_view ten
 
     trx.remove(key_zone, false, ResourceIf::Category::ACCOUNT);
     trx.remove(key_tzone, false, ResourceIf::Category::ACCOUNT);
-    updateZoneRrIx(trx, fqdn, 0, true);
+    updateZoneRrIx(trx, fqdn, 0, false);
 }
 
 void AuthMgr::bootstrap()
@@ -359,9 +359,12 @@ void AuthMgr::updateZoneRrIx(ResourceIf::TransactionIf &trx, std::string_view fq
     // If we delete a zone, we need to delete all RR's.
     const bool deleting_a_zone = zoneLen == 0;
     if (deleting_a_zone) {
-        ResourceIf::RealKey key{zone, key_class_t::ZRR};
-        LOG_TRACE_N << "Removong " << key << " recursively (zone)";
-        trx.remove(key, true, ResourceIf::Category::ACCOUNT);
+        // All the keys for the zone starts with "zone/"
+        const ResourceIf::RealKey from{zone, string_view{}, key_class_t::ZRR};
+        string to{from.bytes()};
+        to.back() = '0'; // '/' + 1
+        LOG_TRACE_N << "Removong " << from << " recursively (zone)";
+        trx.removeRange(from.key(), to, ResourceIf::Category::ACCOUNT);
         return;
     }
 
@@ -4,11 +4,24 @@
 #include <boost/chrono.hpp>
 #include <boost/asio/spawn.hpp>
 
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+#   include <sys/socket.h>
+#   include <sys/uio.h>
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
 #include "nsblast/nsblast.h"
 #include "nsblast/DnsEngine.h"
 #include "nsblast/logging.h"
 #include "nsblast/util.h"
+#include "nsblast/ZoneIndex.h"
 
+#include "AnswerCache.h"
+#include "ObjectPool.h"
 #include "SlaveMgr.h"
 #include "Metrics.h"
 
@@ -21,15 +34,58 @@ namespace nsblast::lib {
 
 namespace {
 
-struct UdpRequest : public DnsEngine::Request {
+struct UdpRequest : public DnsEngine::Request, public std::enable_shared_from_this<UdpRequest> {
     boost::asio::ip::udp::endpoint sender_endpoint;
     std::array<char, MAX_UDP_QUERY_BUFFER> buffer_in{};
 
     void setBufferLen(size_t bytes) {
         span = {buffer_in.data(), bytes};
     }
+
+    // Prepare a re-used instance for a new request
+    void reset() {
+        id = newRequestId();
+        maxReplyBytes = MAX_UDP_QUERY_BUFFER;
+        is_axfr = false;
+        is_ixfr = false;
+    }
 };
 
+#ifdef __linux__
+// Buffers for receiving and sending a batch of UDP messages with recvmmsg/sendmmsg
+struct UdpBatch {
+    struct Reply {
+        std::shared_ptr<MessageBuilder> message;
+        UdpRequest *request = {};
+    };
+
+    void prepare(size_t size) {
+        if (requests.size() != size) {
+            requests.resize(size);
+            msgs.resize(size);
+            iovecs.resize(size);
+        }
+
+        for(size_t i = 0; i < size; ++i) {
+            auto& req = requests[i];
+            iovecs[i] = {req.buffer_in.data(), req.buffer_in.size()};
+            msgs[i] = {};
+            msgs[i].msg_hdr.msg_name = req.sender_endpoint.data();
+            msgs[i].msg_hdr.msg_namelen = req.sender_endpoint.capacity();
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        replies.clear();
+    }
+
+    std::vector<UdpRequest> requests;
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovecs;
+    std::vector<Reply> replies;
+};
+#endif
+
 struct TcpRequest : public DnsEngine::Request {
     std::array<char, 2> size_buffer{};
     std::vector<char> buffer_in;
@@ -40,10 +96,15 @@ struct TcpRequest : public DnsEngine::Request {
     }
 };
 
+#ifdef SO_REUSEPORT
+using reuse_port_t = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
 class UdpEndpoint : public DnsEngine::Endpoint {
 public:
-    UdpEndpoint(DnsEngine& parent, const DnsEngine::udp_t::endpoint& ep)
-        : DnsEngine::Endpoint(parent), socket_{parent.ctx()}
+    UdpEndpoint(DnsEngine& parent, boost::asio::io_context& ctx,
+                const DnsEngine::udp_t::endpoint& ep, bool reusePort)
+        : DnsEngine::Endpoint(parent), ctx_{ctx}, socket_{ctx}
     {
         if (ep.address().is_v4()) {
             socket_.open(boost::asio::ip::udp::v4());
@@ -56,10 +117,29 @@ public:
         }
 
         socket_.set_option(boost::asio::socket_base::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (reusePort) {
+            socket_.set_option(reuse_port_t{true});
+        }
+#endif
         socket_.bind(ep);
+
+#ifdef __linux__
+        batch_size_ = parent.config().dns_udp_batch_size;
+#else
+        if (parent.config().dns_udp_batch_size) {
+            LOG_WARN << "UdpEndpoint - Batched UDP (recvmmsg/sendmmsg) is only supported on Linux.";
+        }
+#endif
     }
 
     void start() override {
+#ifdef __linux__
+        if (batch_size_) {
+            nextBatch();
+            return;
+        }
+#endif
         next();
     }
 
@@ -67,6 +147,10 @@ public:
         return true;
     }
 
+    [[nodiscard]] uint16_t localPort() const override {
+        return socket_.local_endpoint().port();
+    }
+
     void send(span_t data,  const DnsEngine::udp_t::endpoint& ep,
               const std::function<void(boost::system::error_code ec)>& /*cb*/) {
 
@@ -95,17 +179,16 @@ public:
     }
 
     void next() {
-        // TODO: Use a pool of requests to speed it up...
-
         // We have to use shared ptr to pass ownership to the callback.
         // A unique_ptr woun't make it trough all the asio composed trickery
-        auto req = make_shared<UdpRequest>();
+        auto req = ObjectPool<UdpRequest>::get();
+        req->reset();
 
         boost::asio::mutable_buffer mb{req->buffer_in.data(), req->buffer_in.size()};
 
         LOG_TRACE << "Ready to receive a new UDP reqest on "
                   << socket_.local_endpoint()
-                  << " as " << req->uuid;
+                  << " as " << req->id;
 
         socket_.async_receive_from(mb, req->sender_endpoint,
                                    [this, req=req]
@@ -114,14 +197,14 @@ public:
 
             // Get ready to receive the next request
             // TODO: Add some logic to prevent us from queuing an infinite number of requests
-            boost::asio::post(parent().ctx(), [this] {
+            boost::asio::post(ctx_, [this] {
                 start();
             });
 
             if (error) {
                 LOG_WARN << "DNS request from " << req->sender_endpoint
                          << " on UDP " << socket_.local_endpoint()
-                         << " for request id " << req->uuid
+                         << " for request id " << req->id
                          << " failed to receive data: " << error.message();
                 return;
             }
@@ -132,12 +215,14 @@ public:
             LOG_DEBUG << "Received a DNS message of " << bytes << " bytes from "
                       << req->sender_endpoint.address()
                       << " on UDP " << socket_.local_endpoint()
-                      << " as request id " << req->uuid;
+                      << " as request id " << req->id;
 
             try {
-                parent().processRequest(*req, [req, this](std::shared_ptr<MessageBuilder>& message, bool /*final */) {
+                // Only capture raw pointers, so that std::function don't need to allocate
+                parent().processRequest(*req, [r=req.get(), this](std::shared_ptr<MessageBuilder>& message, bool /*final */) {
+                    auto req = r->shared_from_this();
                     if (message->empty()) {
-                        LOG_DEBUG << "processRequest for request id " << req->uuid
+                        LOG_DEBUG << "processRequest for request id " << req->id
                                   << " came back empty. Will not reply.";
                         return;
                     }
@@ -147,7 +232,7 @@ public:
                     LOG_DEBUG << "Sending a DNS message of " << cb.size() << " bytes to "
                               << req->sender_endpoint.address()
                               << " from UDP " << socket_.local_endpoint()
-                              << " as a reply to request id " << req->uuid;
+                              << " as a reply to request id " << req->id;
 
                     socket_.async_send_to(cb,
                                           req->sender_endpoint,
@@ -157,7 +242,7 @@ public:
                         if (error) {
                             LOG_WARN << "DNS request from " << socket_.local_endpoint()
                                      << " on UDP " << socket_.local_endpoint()
-                                     << " for request id " << req->uuid
+                                     << " for request id " << req->id
                                      << " failed to send reply: " << error.message();
                             return;
                         }
@@ -165,24 +250,149 @@ public:
                         LOG_DEBUG << "Successfully replied to UDP message from "
                                   << req->sender_endpoint.address()
                                   << " on UDP " << socket_.local_endpoint()
-                                  << " for request id " << req->uuid;
+                                  << " for request id " << req->id;
                     });
                 });
             } catch (const std::exception& ex) {
                 LOG_ERROR << "DNS request from " << socket_.local_endpoint()
                          << " on UDP " << socket_.local_endpoint()
-                         << " for request id " << req->uuid
+                         << " for request id " << req->id
                          << " failed processing: " << ex.what();
             }
         });
     }
 
+#ifdef __linux__
+    // Wait until the socket is readable, and then drain up to batch_size_
+    // datagrams with one recvmmsg() call. The replies are sent with sendmmsg().
+    void nextBatch() {
+        socket_.async_wait(DnsEngine::udp_t::socket::wait_read,
+                           [this](const boost::system::error_code& error) {
+            if (error) {
+                if (error == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                LOG_WARN << "UdpEndpoint::nextBatch - Failed to wait for data on UDP "
+                         << socket_.local_endpoint() << ": " << error.message();
+                boost::asio::post(ctx_, [this] {
+                    nextBatch();
+                });
+                return;
+            }
+
+            // Each thread use it's own buffers. The batch is fully processed
+            // before we return from this handler.
+            thread_local UdpBatch batch;
+            batch.prepare(batch_size_);
+
+            const auto received = ::recvmmsg(socket_.native_handle(), batch.msgs.data(),
+                                             batch.msgs.size(), MSG_DONTWAIT, nullptr);
+            const auto err = errno;
+
+            // Let another thread wait for more datagrams while we process these
+            nextBatch();
+
+            if (received < 0) {
+                if (err != EAGAIN && err != EWOULDBLOCK && err != EINTR) {
+                    LOG_WARN << "UdpEndpoint::nextBatch - recvmmsg failed on UDP "
+                             << socket_.local_endpoint() << ": " << strerror(err);
+                }
+                return;
+            }
+
+            LOG_TRACE << "UdpEndpoint::nextBatch - Received " << received
+                      << " DNS messages on UDP " << socket_.local_endpoint();
+
+            for(auto i = 0; i < received; ++i) {
+                auto& req = batch.requests[i];
+                req.reset();
+                req.setBufferLen(batch.msgs[i].msg_len);
+                req.sender_endpoint.resize(batch.msgs[i].msg_hdr.msg_namelen);
+                req.endpoint = req.sender_endpoint;
+
+                try {
+                    parent().processRequest(req, [&req](std::shared_ptr<MessageBuilder>& message, bool /*final */) {
+                        if (message->empty()) {
+                            LOG_DEBUG << "processRequest for request id " << req.id
+                                      << " came back empty. Will not reply.";
+                            return;
+                        }
+                        batch.replies.push_back({message, &req});
+                    });
+                } catch (const std::exception& ex) {
+                    LOG_ERROR << "DNS request from " << req.sender_endpoint
+                             << " on UDP " << socket_.local_endpoint()
+                             << " for request id " << req.id
+                             << " failed processing: " << ex.what();
+                }
+            }
+
+            sendBatch(batch);
+        });
+    }
+
+    void sendBatch(UdpBatch& batch) {
+        if (batch.replies.empty()) {
+            return;
+        }
+
+        // Re-use the receive buffers' headers for the replies
+        const auto count = batch.replies.size();
+        for(size_t i = 0; i < count; ++i) {
+            auto& reply = batch.replies[i];
+            const auto& span = reply.message->span();
+            batch.iovecs[i] = {const_cast<char *>(span.data()), span.size()};
+            batch.msgs[i] = {};
+            batch.msgs[i].msg_hdr.msg_name = reply.request->sender_endpoint.data();
+            batch.msgs[i].msg_hdr.msg_namelen = reply.request->sender_endpoint.size();
+            batch.msgs[i].msg_hdr.msg_iov = &batch.iovecs[i];
+            batch.msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        size_t sent = 0;
+        while(sent < count) {
+            const auto result = ::sendmmsg(socket_.native_handle(), batch.msgs.data() + sent,
+                                           count - sent, MSG_DONTWAIT);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            sent += result;
+        }
+
+        LOG_TRACE << "UdpEndpoint::sendBatch - Sent " << sent << " of " << count
+                  << " DNS replies on UDP " << socket_.local_endpoint();
+
+        // If the socket-buffer was full, or a message failed, send the rest one by one.
+        for(auto i = sent; i < count; ++i) {
+            auto& reply = batch.replies[i];
+            const auto& span = reply.message->span();
+            const auto ep = reply.request->sender_endpoint;
+            socket_.async_send_to(boost::asio::const_buffer{span.data(), span.size()}, ep,
+                                  [this, ep, message=std::move(reply.message)]
+                                  (const boost::system::error_code& error, std::size_t /*bytes*/) {
+                if (error) {
+                    LOG_WARN << "DNS reply to " << ep
+                             << " on UDP " << socket_.local_endpoint()
+                             << " failed to send: " << error.message();
+                }
+            });
+        }
+
+        batch.replies.clear();
+    }
+#endif
+
     [[nodiscard]] DnsEngine::udp_t::endpoint localEndpoint() const {
         return socket_.local_endpoint();
     }
 
 private:
+    boost::asio::io_context& ctx_;
     DnsEngine::udp_t::socket socket_;
+    size_t batch_size_ = 0;
 };
 
 class TcpEndpoint : public DnsEngine::Endpoint {
@@ -195,11 +405,20 @@ public:
         DnsEngine::tcp_t::socket socket_;
     };
 
-    TcpEndpoint(DnsEngine& parent, const DnsEngine::tcp_t::endpoint& ep)
+    TcpEndpoint(DnsEngine& parent, boost::asio::io_context& ctx,
+                const DnsEngine::tcp_t::endpoint& ep, bool reusePort)
         : DnsEngine::Endpoint(parent)
-        , acceptor_{parent.ctx(), ep}
-
+        , acceptor_{ctx}
     {
+        acceptor_.open(ep.protocol());
+        acceptor_.set_option(boost::asio::socket_base::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (reusePort) {
+            acceptor_.set_option(reuse_port_t{true});
+        }
+#endif
+        acceptor_.bind(ep);
+        acceptor_.listen();
     }
 
     void start() override {
@@ -207,6 +426,10 @@ public:
         accept();
     }
 
+    [[nodiscard]] uint16_t localPort() const override {
+        return acceptor_.local_endpoint().port();
+    }
+
     void accept() {
         acceptor_.async_accept([this](auto ec, auto socket) {
            if (ec) {
@@ -227,7 +450,9 @@ private:
 
 
 template<typename T>
-void doStartEndpoints(DnsEngine& engine, const std::string& endpoint, const std::string& port) {
+void doStartEndpoints(DnsEngine& engine, boost::asio::io_context& ctx,
+                      const std::string& endpoint, const std::string& port,
+                      bool reusePort = false) {
     using ip_t = T;
 
     typename ip_t::resolver resolver(engine.ctx());
@@ -238,12 +463,12 @@ void doStartEndpoints(DnsEngine& engine, const std::string& endpoint, const std:
         std::shared_ptr<DnsEngine::Endpoint> ep;
         if constexpr (std::is_same_v<ip_t, DnsEngine::udp_t>) {
             LOG_INFO << "Starting DNS/UDP endpoint: " << addr.endpoint();
-            ep = make_shared<UdpEndpoint>(engine, addr);
+            ep = make_shared<UdpEndpoint>(engine, ctx, addr, reusePort);
         }
 
         if constexpr (std::is_same_v<ip_t, DnsEngine::tcp_t>) {
             LOG_INFO << "Starting DNS/TCP endpoint: " << addr.endpoint();
-            ep = make_shared<TcpEndpoint>(engine, addr);
+            ep = make_shared<TcpEndpoint>(engine, ctx, addr, reusePort);
         }
 
         assert(ep);
@@ -256,10 +481,18 @@ void doStartEndpoints(DnsEngine& engine, const std::string& endpoint, const std:
     }
 }
 
+// Builders for TCP and AXFR replies grow large buffers. Don't keep them in the pool.
+struct RecycleUdpSizedBuilder {
+    bool operator()(const MessageBuilder& mb) const noexcept {
+        return mb.capacity() <= MAX_UDP_QUERY_BUFFER_WITH_OPT;
+    }
+};
+
 tuple<bool, shared_ptr<MessageBuilder>>
 createBuilder(Server& server, const DnsEngine::Request &request, const Message& message,
               uint16_t maxBufferSize, uint16_t maxBufferSizeWithOpt) {
-    auto mb = make_shared<MessageBuilder>();
+    auto mb = ObjectPool<MessageBuilder, 8, RecycleUdpSizedBuilder>::get();
+    mb->reset();
     auto use_buffer_size = maxBufferSize;
     size_t opt_count_ = 0;
     bool ok = true;
@@ -307,17 +540,17 @@ createBuilder(Server& server, const DnsEngine::Request &request, const Message&
         const auto qtype = query.type();
 
         if (qtype == QTYPE_AXFR) {
-            LOG_DEBUG << "createBuilder: " << "Processing AXFR query. Request: " << request.uuid;
+            LOG_DEBUG << "createBuilder: " << "Processing AXFR query. Request: " << request.id;
 
             if (message.header().qdcount() != 1) {
-                LOG_WARN << "Refusing AXFR request " << request.uuid
+                LOG_WARN << "Refusing AXFR request " << request.id
                          << " because the QUERY section has more than 1 entry. That is not valid DNS!";
                 mb->setRcode(Message::Header::RCODE::NAME_ERROR);
                 return {false, mb};
             }
 
             if (!request.is_tcp) {
-                LOG_WARN << "Refusing AXFR request " << request.uuid
+                LOG_WARN << "Refusing AXFR request " << request.id
                          << " because the transport is not TCP.";
                 mb->setRcode(Message::Header::RCODE::REFUSED);
                 return {false, mb};
@@ -329,7 +562,7 @@ createBuilder(Server& server, const DnsEngine::Request &request, const Message&
             }
         } else if (qtype == QTYPE_IXFR) {
             if (message.header().qdcount() != 1) {
-                LOG_WARN << "Refusing IXFR request " << request.uuid
+                LOG_WARN << "Refusing IXFR request " << request.id
                          << " because the QUERY section has more than 1 entry. That is not valid DNS!";
                 mb->setRcode(Message::Header::RCODE::NAME_ERROR);
                 return {false, mb};
@@ -355,11 +588,18 @@ createBuilder(Server& server, const DnsEngine::Request &request, const Message&
 
 class DnsTcpSession : public std::enable_shared_from_this<DnsTcpSession> {
 public:
+    using strand_t = boost::asio::strand<DnsEngine::tcp_t::socket::executor_type>;
+
     DnsTcpSession(DnsEngine& parent,  DnsEngine::tcp_t::socket && socket)
         : parent_{parent}, socket_{std::move(socket)}
-        , idle_timer_{socket_.get_executor()}
+        , strand_{socket_.get_executor()}
+        , idle_timer_{strand_}
+        , wakeup_timer_{strand_, boost::asio::steady_timer::time_point::max()}
     {
-        setIdleTimer();
+        // The endpoints are not available after the peer has reset the connection
+        boost::system::error_code ec;
+        remote_endpoint_ = socket_.remote_endpoint(ec);
+        local_endpoint_ = socket_.local_endpoint(ec);
     }
 
     // Make Clang-Tidy shut up!
@@ -370,13 +610,18 @@ public:
     DnsTcpSession& operator = (DnsTcpSession&&) = delete;
 
     ~DnsTcpSession() {
-        LOG_DEBUG << "DnsTcpSession " << uuid_ << " is history...";
+        LOG_DEBUG << "DnsTcpSession " << id_ << " is history...";
     }
 
-    const auto& uuid() const noexcept {
-        return uuid_;
+    auto executor() {
+        return strand_;
     }
 
+    uint64_t id() const noexcept {
+        return id_;
+    }
+
+    // Must be called from the strand
     void done() {
         auto self = shared_from_this(); // don't die until we return
         if (!done_) {
@@ -385,26 +630,28 @@ public:
                 socket_.close(ec);
             }
             done_ = true;
-            parent_.removeTcpSession(uuid());
+            idle_timer_.cancel();
+            wakeup_timer_.cancel();
+            parent_.removeTcpSession(id());
         }
     }
 
     bool validate(const TcpRequest& req, string_view what,
              boost::system::error_code ec = {}) {
         if (done_) {
-            LOG_DEBUG << "DnsTcpSession " << uuid()
-                      << " for req " << req.uuid << " was done while "
+            LOG_DEBUG << "DnsTcpSession " << id()
+                      << " for req " << req.id << " was done while "
                       << what;
             return false;
         }
 
         if (ec) {
             if (ec == boost::asio::error::eof) {
-                LOG_DEBUG << "DnsTcpSession " << uuid()
-                          << " for req " << req.uuid << " closed by peer on " << what;
+                LOG_DEBUG << "DnsTcpSession " << id()
+                          << " for req " << req.id << " closed by peer on " << what;
             } else {
-                LOG_DEBUG << "DnsTcpSession " << uuid()
-                          << " for req " << req.uuid << " failed with error '"
+                LOG_DEBUG << "DnsTcpSession " << id()
+                          << " for req " << req.id << " failed with error '"
                           << ec.message() << "' on " << what;
             }
             done();
@@ -412,20 +659,21 @@ public:
         }
 
         if (!socket_.is_open()) {
-            LOG_DEBUG << "DnsTcpSession " << uuid()
-                      << " for req " << req.uuid << " has its socked closed while "
+            LOG_DEBUG << "DnsTcpSession " << id()
+                      << " for req " << req.id << " has its socked closed while "
                       << what;
             done();
             return false;
         }
 
-        LOG_TRACE << "DnsTcpSession " << uuid()
-                  << " for req " << req.uuid << " proceeding after "
+        LOG_TRACE << "DnsTcpSession " << id()
+                  << " for req " << req.id << " proceeding after "
                   << what;
 
         return true;
     }
 
+    // Must be called from the strand
     void setIdleTimer() {
         if (!parent_.config().dns_tcp_idle_time) {
             LOG_WARN << "DnsTcpSession: 'dns-tcp-idle-time' is set to 0 (disabled)";
@@ -440,24 +688,25 @@ public:
                 if (auto self = w.lock()) {
                     if (ec) {
                        if (ec == boost::asio::error::operation_aborted) {
-                           LOG_TRACE << "DnsTcpSession " << self->uuid()
+                           LOG_TRACE << "DnsTcpSession " << self->id()
                                      << " idle-timer aborted. Ignoring.";
                            return;
                        }
 
-                       LOG_WARN << "DnsTcpSession " << self->uuid()
+                       LOG_WARN << "DnsTcpSession " << self->id()
                                 << " idle-timer - unexpected error " << ec;
                     }
 
                     if (!self->done_) {
-                       if (self->axfr_timeout_ > chrono::steady_clock::now()) {
-                           LOG_DEBUG << "DnsTcpSession " << self->uuid()
-                                 << " idle-timer expiered but an axfr session is in progress. Resetting the timer.";
+                       if (self->axfr_timeout_ > chrono::steady_clock::now()
+                           || self->inflight_ > 0) {
+                           LOG_DEBUG << "DnsTcpSession " << self->id()
+                                 << " idle-timer expiered but requests are in progress. Resetting the timer.";
                            self->setIdleTimer();
                            return;
                        }
 
-                       LOG_DEBUG << "DnsTcpSession " << self->uuid()
+                       LOG_DEBUG << "DnsTcpSession " << self->id()
                              << " idle-timer expiered. Closing session.";
                        self->done();
                     }
@@ -466,19 +715,29 @@ public:
         }
     }
 
+    /*! Read requests from the socket.
+     *
+     *  Each request is processed in it's own coroutine, so several
+     *  requests can be in flight at the same time (RFC 7766, 6.2.1.1).
+     *  The replies are written in the order they are ready, trough
+     *  a write-queue. The reader coroutine and all the session-state
+     *  is serialized by strand_.
+     */
     void start() {
-        auto req = make_shared<TcpRequest>();
-        if (!validate(*req, "next")) {
-            return;
-        }
-        req->endpoint = socket_.remote_endpoint();
+        boost::asio::spawn(strand_, [self=shared_from_this(), this](auto yield) {
+            setIdleTimer();
+            const auto max_inflight = max<size_t>(parent_.config().dns_tcp_max_inflight, 1);
+
+            while(!done_) {
+                auto req = make_shared<TcpRequest>();
+                if (!validate(*req, "next")) {
+                    return;
+                }
+                req->endpoint = remote_endpoint_;
 
-        // The parent owns this instance, but we need it to exist until we exit the spawn context.
-        boost::asio::spawn(parent_.ctx(), [self=shared_from_this(), this, req](auto yield) {
-            while(!self->done_) {
                 // Read message-length
                 boost::system::error_code ec;
-                auto bytes = socket_.async_receive(to_asio_buffer(req->size_buffer), yield[ec]);
+                auto bytes = boost::asio::async_read(socket_, to_asio_buffer(req->size_buffer), yield[ec]);
                 if (!validate(*req, "read message-length", ec)) {
                     return;
                 }
@@ -486,16 +745,16 @@ public:
 
                 const auto len = get16bValueAt(req->size_buffer, 0);
                 if (!len) {
-                    LOG_DEBUG << "DnsTcpSession " << uuid()
-                              << " for req " << req->uuid
+                    LOG_DEBUG << "DnsTcpSession " << id()
+                              << " for req " << req->id
                               << " contains a 0 bytes DNS query. Assuming other end closed the connection.";
                     done();
                     return;
                 }
 
                 if (len > MAX_TCP_QUERY_LEN) {
-                    LOG_DEBUG << "DnsTcpSession " << uuid()
-                              << " for req " << req->uuid
+                    LOG_DEBUG << "DnsTcpSession " << id()
+                              << " for req " << req->id
                               << " contains a " << len << " bytes DNS query. "
                               << "My upper limit is " << MAX_TCP_QUERY_LEN << " bytes!";
                     done();
@@ -505,7 +764,7 @@ public:
                 req->buffer_in.resize(len);
 
                 // Read message
-                bytes = socket_.async_receive(to_asio_buffer(req->buffer_in), yield[ec]);
+                bytes = boost::asio::async_read(socket_, to_asio_buffer(req->buffer_in), yield[ec]);
                 if (!validate(*req, "read message", ec)) {
                     return;
                 }
@@ -516,110 +775,208 @@ public:
 
                 setIdleTimer();
 
-                LOG_DEBUG << "DnsTcpSession " << uuid()
+                LOG_DEBUG << "DnsTcpSession " << id()
                           << " received a DNS message of " << bytes << " bytes from "
-                          << socket_.remote_endpoint()
-                          << " on TCP " << socket_.local_endpoint()
-                          << " as request id " << req->uuid;
-
-                try {
-                    parent_.processRequest(*req, [this, &req, &yield](auto& message, bool final) {
-
-                        LOG_TRACE << "Replying to TCP session " << uuid()
-                                  << " for request " << req->uuid
-                                  << " is_axfr=" << req->is_axfr
-                                  << ", final=" << final
-                                  << ", message-size is " << message->size()
-                                  << ", Answer-count is " << (message->empty() ? 0 : message->header().ancount());
-
+                          << remote_endpoint_
+                          << " on TCP " << local_endpoint_
+                          << " as request id " << req->id;
 
-                        if (message->empty()) {
-                            LOG_DEBUG << "processRequest/send for request id " << req->uuid
-                                      << " came empty. Will not reply.";
-                            return;
-                        }
-
-                        if (!validate(*req, "preparing reply")) {
-                            return;
-                        }
-
-                        LOG_TRACE << "Reply to request: is_axfr =" << req->is_axfr
-                                  << ", is_ixfr=" << req->is_ixfr;
-                        if (req->is_axfr || req->is_ixfr) {
-                            if (final) {
-                                axfrResetTimeout();
-                            } else {
-                                axfrExtendTimeout();
-                            }
-                        }
-
-                        // Set the length of the message-segment in two bytes before the message
-                        // as required by DNS over TCP
-                        const auto reply_len = static_cast<uint16_t>(message->span().size());
-                        setValueAt(req->size_buffer, 0, reply_len);
-
-                        LOG_DEBUG << "Sending a DNS reply message of "
-                                  << reply_len << " + 2 bytes to "
-                                  << socket_.remote_endpoint()
-                                  << " from TCP " << socket_.local_endpoint()
-                                  << " as a reply to request id " << req->uuid
-                                  << " on TCP session " << uuid();
-
-                        array<boost::asio::const_buffer, 2> buffers{
-                            to_asio_buffer(req->size_buffer),
-                            to_asio_buffer(message->span())
-                        };
-
-                        // TODO: Change the idle-timer to allow for a much longer idle period when
-                        //       the session is doing one or more zone transfers.
-                        boost::system::error_code ec;
-                        socket_.async_send(buffers, yield[ec]);
-
-                        if (!validate(*req, "sent reply", ec)) {
-                            LOG_DEBUG << "Successfully replied to DNS message from "
-                                  << socket_.local_endpoint()
-                                  << " on TCP " << socket_.local_endpoint()
-                                  << " for request id " << req->uuid;
-                        }
-                    });
-                } catch (const std::exception& ex) {
-                    LOG_ERROR << "DNS request from " << socket_.local_endpoint()
-                             << " on UDP " << socket_.local_endpoint()
-                             << " for request id " << req->uuid
-                             << " failed with exception: " << ex.what();
+                ++inflight_;
+                processRequest(std::move(req));
 
-                    done();
-                } catch(...) {
-                    ostringstream estr;
-    #ifdef __unix__
-                    estr << " of type : " << __cxxabiv1::__cxa_current_exception_type()->name();
-    #endif
-                    LOG_ERROR << "DNS TCP session " << uuid()
-                              << " caught unknow exception in coroutine: " << estr.str();
-                } // one request
+                // Don't read more requests until there is room for them
+                while(!done_ && inflight_ >= max_inflight) {
+                    wakeupWait(yield);
+                }
             } // loop
         }, boost::asio::detached);
     } // start()
 
-    // Currently we don't do parallel processing, so no need to track the individual
-    // AXFR replies
     void axfrExtendTimeout() {
-        LOG_TRACE << "axfrExtendTimeout - Extending time for ongoing AXFR transfer on session " << uuid();
+        LOG_TRACE << "axfrExtendTimeout - Extending time for ongoing AXFR transfer on session " << id();
         axfr_timeout_ = chrono::steady_clock::now() + 3min;
     }
 
     void axfrResetTimeout() {
-        LOG_TRACE << "axfrResetTimeout - Removing extended time for obsolete AXFR transfer on session " << uuid();
+        LOG_TRACE << "axfrResetTimeout - Removing extended time for obsolete AXFR transfer on session " << id();
         axfr_timeout_  = {};
     }
 
 private:
-    const boost::uuids::uuid uuid_ = newUuid();
+    struct Outgoing {
+        Outgoing(std::shared_ptr<MessageBuilder> msg)
+            : message{std::move(msg)} {
+            setValueAt(size_buffer, 0, static_cast<uint16_t>(message->span().size()));
+        }
+
+        size_t bytes() const noexcept {
+            return message->span().size() + size_buffer.size();
+        }
+
+        std::shared_ptr<MessageBuilder> message;
+        std::array<char, 2> size_buffer{};
+    };
+
+    // Wait until something is written or a request is done.
+    // Returns on the strand.
+    template <typename Y>
+    void wakeupWait(Y& yield) {
+        boost::system::error_code ec;
+        wakeup_timer_.async_wait(yield[ec]);
+        boost::asio::post(strand_, yield);
+    }
+
+    // Must be called from the strand
+    void wakeup() {
+        wakeup_timer_.cancel();
+    }
+
+    // Process the request in it's own coroutine, on the worker-pool
+    void processRequest(std::shared_ptr<TcpRequest> req) {
+        boost::asio::spawn(socket_.get_executor(), [self=shared_from_this(), this, req](auto yield) {
+            try {
+                parent_.processRequest(*req, [this, &req, &yield](auto& message, bool final) {
+
+                    LOG_TRACE << "Replying to TCP session " << id()
+                              << " for request " << req->id
+                              << " is_axfr=" << req->is_axfr
+                              << ", final=" << final
+                              << ", message-size is " << message->size()
+                              << ", Answer-count is " << (message->empty() ? 0 : message->header().ancount());
+
+                    if (message->empty()) {
+                        LOG_DEBUG << "processRequest/send for request id " << req->id
+                                  << " came empty. Will not reply.";
+                        return;
+                    }
+
+                    // Only the session-state is serialized by the strand
+                    boost::asio::post(strand_, yield);
+                    queueReply(*req, message, final, yield);
+                    if (done_) {
+                        // Nobody will receive the rest of a zone-transfer
+                        req->cancelled = true;
+                    }
+
+                    // The lookups for the rest of the reply (like the next
+                    // part of a zone-transfer) don't need the strand.
+                    boost::asio::post(socket_.get_executor(), yield);
+                });
+            } catch (const std::exception& ex) {
+                LOG_ERROR << "DNS request from " << req->endpoint
+                         << " on TCP session " << id()
+                         << " for request id " << req->id
+                         << " failed with exception: " << ex.what();
+
+                boost::asio::post(strand_, yield);
+                done();
+            } catch(...) {
+                ostringstream estr;
+#ifdef __unix__
+                estr << " of type : " << __cxxabiv1::__cxa_current_exception_type()->name();
+#endif
+                LOG_ERROR << "DNS TCP session " << id()
+                          << " caught unknow exception in coroutine: " << estr.str();
+            }
+
+            boost::asio::post(strand_, yield);
+            assert(inflight_ > 0);
+            --inflight_;
+            wakeup();
+        }, boost::asio::detached);
+    }
+
+    // Must be called from the strand
+    template <typename Y>
+    void queueReply(TcpRequest& req, std::shared_ptr<MessageBuilder>& message, bool final, Y& yield) {
+        if (!validate(req, "preparing reply")) {
+            return;
+        }
+
+        if (req.is_axfr || req.is_ixfr) {
+            if (final) {
+                axfrResetTimeout();
+            } else {
+                axfrExtendTimeout();
+            }
+        }
+
+        LOG_DEBUG << "Queuing a DNS reply message of "
+                  << message->span().size() << " + 2 bytes to "
+                  << req.endpoint
+                  << " as a reply to request id " << req.id
+                  << " on TCP session " << id();
+
+        enqueue(message);
+
+        // Back-pressure, so that a large zone-transfer don't end up in memory
+        const auto max_bytes = parent_.config().dns_tcp_max_queued_bytes;
+        while(!done_ && max_bytes && queued_bytes_ > max_bytes) {
+            wakeupWait(yield);
+        }
+    }
+
+    // Must be called from the strand
+    void enqueue(std::shared_ptr<MessageBuilder> message) {
+        auto& item = write_queue_.emplace_back(std::move(message));
+        queued_bytes_ += item.bytes();
+        if (!writing_) {
+            writeNext();
+        }
+    }
+
+    // Must be called from the strand
+    void writeNext() {
+        if (write_queue_.empty() || done_) {
+            writing_ = false;
+            return;
+        }
+
+        writing_ = true;
+        const auto& item = write_queue_.front();
+        array<boost::asio::const_buffer, 2> buffers{
+            to_asio_buffer(item.size_buffer),
+            to_asio_buffer(item.message->span())
+        };
+
+        boost::asio::async_write(socket_, buffers, boost::asio::bind_executor(strand_,
+            [self=shared_from_this(), this](boost::system::error_code ec, size_t /*bytes*/) {
+
+            assert(!write_queue_.empty());
+            queued_bytes_ -= write_queue_.front().bytes();
+            write_queue_.pop_front();
+            wakeup();
+
+            if (ec) {
+                LOG_DEBUG << "DnsTcpSession " << id()
+                          << " failed to send reply: " << ec.message();
+                writing_ = false;
+                done();
+                return;
+            }
+
+            LOG_TRACE << "DnsTcpSession " << id() << " successfully sent a reply.";
+            writeNext();
+        }));
+    }
+
+    const uint64_t id_ = newRequestId();
     DnsEngine& parent_;
     DnsEngine::tcp_t::socket socket_;
-    bool done_ = false;
+    DnsEngine::tcp_t::endpoint remote_endpoint_;
+    DnsEngine::tcp_t::endpoint local_endpoint_;
+    strand_t strand_;
+    std::atomic_bool done_{false};
     boost::asio::deadline_timer idle_timer_;
 
+    // Never expires. Cancelled to wake up coroutines waiting for the state to change.
+    boost::asio::steady_timer wakeup_timer_;
+
+    std::deque<Outgoing> write_queue_;
+    size_t queued_bytes_ = 0;
+    size_t inflight_ = 0;
+    bool writing_ = false;
+
     // If set in the future, leave the session running even if the idle_timer timed out
     chrono::steady_clock::time_point axfr_timeout_ = {};
 };
@@ -628,11 +985,39 @@ private:
 DnsEngine::DnsEngine(Server &server)
     : server_{server}
 {
+    if (config().dns_answer_cache_size) {
+        answer_cache_ = make_unique<AnswerCache>(config().dns_answer_cache_size,
+                                                 config().dns_answer_cache_shards);
+        server_.resource().setEntriesChangedCallback(
+            [cache=answer_cache_.get()](const ZoneIndex::changes_t& changes, bool zonesChanged) {
+            cache->invalidate(changes, zonesChanged);
+        });
+    }
 }
 
 DnsEngine::~DnsEngine()
 {
+    if (answer_cache_) {
+        server_.resource().setEntriesChangedCallback({});
+    }
     stop();
+
+    for(auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    if (!workers_.empty()) {
+        // The sockets must go before the io_context's they belong to
+        {
+            lock_guard<mutex> lock{tcp_session_mutex_};
+            tcp_sessions_.clear();
+        }
+        endpoints_.clear();
+        workers_.clear();
+    }
+
     LOG_DEBUG << "~DnsEngine(): Done.";
 }
 
@@ -643,7 +1028,11 @@ void DnsEngine::start()
 
 void DnsEngine::stop()
 {
-
+    call_once(stop_once_, [this] {
+        for(auto& worker : workers_) {
+            worker->ctx.stop();
+        }
+    });
 }
 
 
@@ -701,7 +1090,7 @@ void DnsEngine::handleNotify(const DnsEngine::Request &request,
     }
 
     if (mhdr.qdcount() != 1) {
-        LOG_DEBUG << "Request " << request.uuid << " has opcode NOTIFY "
+        LOG_DEBUG << "Request " << request.id << " has opcode NOTIFY "
                   << " but not excactely 1 query. That is not valid DNS.";
 
         if (mb) {
@@ -712,7 +1101,7 @@ void DnsEngine::handleNotify(const DnsEngine::Request &request,
 
     const auto rr = *message.getQuestions().begin();
     if (rr.type() != TYPE_SOA) {
-        LOG_DEBUG << "Request " << request.uuid << " has opcode NOTIFY "
+        LOG_DEBUG << "Request " << request.id << " has opcode NOTIFY "
                   << " but the query is not for TYPE_SOA. That is not valid DNS.";
         if (mb) {
             mb->setRcode(Message::Header::RCODE::FORMAT_ERROR);
@@ -722,7 +1111,7 @@ void DnsEngine::handleNotify(const DnsEngine::Request &request,
 
     if (rr.clas() != CLASS_IN) {
         if (rr.type() != TYPE_SOA) {
-            LOG_DEBUG << "Request " << request.uuid << " has opcode NOTIFY "
+            LOG_DEBUG << "Request " << request.id << " has opcode NOTIFY "
                       << " but the querry is not for CLASS_IN. I do`n't support that.";
             if (mb) {
                 mb->setRcode(Message::Header::RCODE::NOT_IMPLEMENTED);
@@ -733,6 +1122,16 @@ void DnsEngine::handleNotify(const DnsEngine::Request &request,
 
     const auto fqdn = toLower(rr.labels().string());
 
+    if (config().db_secondary) {
+        // The primary instance deals with notifications
+        LOG_DEBUG << "DnsEngine::handleNotify - Ignoring NOTIFY for zone " << fqdn
+                  << ". This server is running on a secondary database instance.";
+        if (mb) {
+            mb->setRcode(Message::Header::RCODE::REFUSED);
+        }
+        return;
+    }
+
     if (is_reply) {
         LOG_TRACE << "DnsEngine::handleNotify - Dealing with reply for zone "
                   << fqdn << " with id " << mhdr.id();
@@ -749,11 +1148,10 @@ void DnsEngine::doAxfr(const DnsEngine::Request &request,
                        const DnsEngine::send_t &send,
                        const Message& message,
                        shared_ptr<MessageBuilder>& mb,
-                       const ResourceIf::RealKey& key,
-                       ResourceIf::TransactionIf& trx)
+                       const ResourceIf::RealKey& key)
 {
     LOG_DEBUG << "DnsEngine::doAxfr - Starting request "
-              << request.uuid
+              << request.id
               << " regarding " << key;
 
     // TODO: Check if the caller is allowed to do AXFR!
@@ -764,9 +1162,18 @@ void DnsEngine::doAxfr(const DnsEngine::Request &request,
     vector<char> zone_buffer; // To keep the SOA we need as the latest RR in the reply
     optional<Entry> zone;
     vector<char> cut;
-    trx.iterate({key}, [&]
+
+    // The transfer must be consistent, also if the zone is changed while
+    // a slow client reads it.
+    auto trx = server_.resource().readOnlyTransaction(true);
+    trx->iterateZone(key, [&]
                  (auto db_key, auto value) mutable {
 
+        if (request.cancelled) {
+            LOG_DEBUG << "DnsEngine::doAxfr - Request " << request.id << " was cancelled.";
+            return false;
+        }
+
         // Skip child-zones if they happen to be hosted by me (and the keys appears here)
         if (!cut.empty()) {
            if (cut.size() <= db_key.size()) {
@@ -775,7 +1182,7 @@ void DnsEngine::doAxfr(const DnsEngine::Request &request,
                    // We only want to send RR's from inside the requested zone,
                    // so we have to ignore this key.
                    LOG_TRACE << "DnsEngine::processRequest for request "
-                             << request.uuid
+                             << request.id
                              << " in AXFR; ignoring child Entry at "
                              << db_key;
                    return true;
@@ -811,12 +1218,18 @@ void DnsEngine::doAxfr(const DnsEngine::Request &request,
             assert(zone->begin()->type() == TYPE_SOA);
         }
 
+        const auto flags = entry.header().flags;
+        const bool child_zone = count > 1 && flags.soa;
+        if (child_zone || (flags.ns && !flags.soa)) {
+            // Start of a cut
+            cut.reserve(db_key.size());
+            copy(db_key.bytes().begin(), db_key.bytes().end(), back_inserter(cut));
+        }
+
         for(const auto& rr : entry) {
-            const auto flags = entry.header().flags;
-            if (flags.ns && !flags.soa) {
-                // Start of a cut
-                cut.reserve(db_key.size());
-                copy(db_key.bytes().begin(), db_key.bytes().end(), back_inserter(cut));
+            if (child_zone && rr.type() != TYPE_NS) {
+                // Only the delegation belongs to this zone
+                continue;
             }
 
             // For now, copy all the RR's. I don't think we have any RR's
@@ -829,6 +1242,10 @@ void DnsEngine::doAxfr(const DnsEngine::Request &request,
         return true; // We are ready for the next Entry
     });
 
+    if (request.cancelled) {
+        return;
+    }
+
     if (!zone) {
         mb->setRcode(Message::Header::RCODE::NAME_ERROR);
         return;
@@ -854,13 +1271,13 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
                        ResourceIf::TransactionIf &trx)
 {
     LOG_DEBUG << "DnsEngine::doIxfr - Starting request "
-              << request.uuid
+              << request.id
               << " regarding " << key;
 
     // See if the request is OK and get the start serial.
     if (message.getAuthority().count() == 0) {
         LOG_DEBUG << "DnsEngine::doIxfr " << " for request "
-                  << request.uuid
+                  << request.id
                   << " regarding " << key
                   << " does not contain a SOA record. That is not valid DNS.";
         mb->setRcode(Message::Header::RCODE::FORMAT_ERROR);
@@ -882,7 +1299,7 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
     auto zone = trx.lookup(fqdn);
     if (zone.empty() || !zone.flags().soa) {
         LOG_DEBUG << "DnsEngine::doIxfr " << " for request "
-                  << request.uuid
+                  << request.id
                   << " regarding " << key
                   << ". The zone was not found.";
         mb->setRcode(Message::Header::RCODE::NAME_ERROR);
@@ -895,7 +1312,7 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
     const auto currentSoa = zone.getSoa();
     if (from_serial >= currentSoa.serial()) {
         LOG_DEBUG << "DnsEngine::doIxfr " << " for request "
-                  << request.uuid
+                  << request.id
                   << " regarding " << key
                   << ". There is no newer version of the zone.";
 
@@ -930,13 +1347,38 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
             return false; // No longer at the relevant key
         }
 
+        if (request.cancelled) {
+            LOG_DEBUG << "DnsEngine::doIxfr - Request " << request.id << " was cancelled.";
+            return false;
+        }
+
+        const Entry entry{value};
+
+        if (!diff_count) {
+            // The first diff must start at the clients version. Some changes, like
+            // bulk imports, don't create diffs. If there is a gap, we can't
+            // do an incremental transfer.
+            if (auto first = entry.begin(); first != entry.end() && first->type() == TYPE_SOA) {
+                const RrSoa soa{entry.buffer(), first->offset()};
+                if (soa.serial() < from_serial) {
+                    return true; // The client already has this version
+                }
+                if (soa.serial() != from_serial) {
+                    LOG_DEBUG << "DnsEngine::doIxfr " << " for request "
+                              << request.id
+                              << " regarding " << key
+                              << ". There are no diff's starting at serial " << from_serial;
+                    return false;
+                }
+            }
+        }
+
         if (++diff_count == 1) {
             // Create the first Soa with the current serial.
             // From now on we will complete the IXFR or send an error or TC bit.
             mb->addRr(currentSoa, hdr, MessageBuilder::Segment::ANSWER);
         }
 
-        const Entry entry{value};
         size_t count = 0;
         for(const auto& rr : entry) {
             const auto type = rr.type();
@@ -944,7 +1386,7 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
                 // Most be soa, start of deletions (old version)
                 if (type != TYPE_SOA) {
                     LOG_ERROR << "DnsEngine::doIxfr " << " for request "
-                              << request.uuid
+                              << request.id
                               << " regarding " << key
                               << ". The DIFF data is invalid. First entry must be a SOA.";
                     mb->setRcode(Message::Header::RCODE::SERVER_FAILURE);
@@ -963,7 +1405,7 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
 
     if (!diff_count) {
         LOG_TRACE << "DnsEngine::doIxfr " << " for request "
-                  << request.uuid
+                  << request.id
                   << " regarding " << key
                   << ". No first match was aquired.";
 
@@ -973,7 +1415,11 @@ void DnsEngine::doIxfr(const DnsEngine::Request &request,
         }
 
         // Do a full zone transfer
-        return doAxfr(request, send, message, mb, key, trx);
+        return doAxfr(request, send, message, mb, key);
+    }
+
+    if (request.cancelled) {
+        return;
     }
 
     // Is the reply valid? Did we get the changes for the current zone?
@@ -1009,12 +1455,12 @@ void DnsEngine::flushIf(std::shared_ptr<MessageBuilder> &mb,
 void DnsEngine::processRequest(const DnsEngine::Request &request,
                                const DnsEngine::send_t &send)
 {
-    LOG_TRACE << "processRequest: Processing request " << request.uuid;    
+    LOG_TRACE << "processRequest: Processing request " << request.id;    
 
     auto out_buffer_len = request.maxReplyBytes;
 
     Message message{request.span};
-    LOG_DEBUG << "Request " << request.uuid << " from " << request.endpoint
+    LOG_DEBUG << "Request " << request.id << " from " << request.endpoint
               << ": " << message.toString();
 
     shared_ptr<MessageBuilder> mb;
@@ -1025,10 +1471,28 @@ void DnsEngine::processRequest(const DnsEngine::Request &request,
     bool do_reply = true;
     auto latency_metrics_ok = server_.metrics().request_latency_ok().scoped();
 
-    ScopedExit se{[&mb, &do_reply, &send, &request, &ok, this, &latency_metrics_ok] {
+    // Answer cache state. `cacheable` is set when the reply is complete.
+    string cache_key;
+    AnswerCache::deps_t cache_deps;
+    uint64_t cache_generation = 0;
+    bool cacheable = false;
+
+    ScopedExit se{[&mb, &do_reply, &send, &request, &ok, this, &latency_metrics_ok,
+                   &cache_key, &cache_deps, &cache_generation, &cacheable] {
         if (do_reply && mb) {
             mb->finish();
-            LOG_DEBUG << "Request " << request.uuid << " from " << request.endpoint
+            if (cacheable) {
+                const auto rhdr = mb->header();
+                const auto rcode = rhdr.rcode();
+                if (!rhdr.tc() && (rcode == Message::Header::RCODE::OK
+                                   || rcode == Message::Header::RCODE::NAME_ERROR)) {
+                    const bool negative = rcode == Message::Header::RCODE::NAME_ERROR
+                                          || rhdr.ancount() == 0;
+                    answer_cache_->put(std::move(cache_key), mb->span(), std::move(cache_deps),
+                                       cache_generation, negative);
+                }
+            }
+            LOG_DEBUG << "Request " << request.id << " from " << request.endpoint
                       << " is done: " << mb->toString();
             send(mb, true);
             if (ok) {
@@ -1054,17 +1518,84 @@ void DnsEngine::processRequest(const DnsEngine::Request &request,
         return;
     }
 
-    auto trx = server_.resource().transaction();
+    if (!server_.resource().available()) [[unlikely]] {
+        // Probably importing a database snapshot. Don't answer from partial data.
+        LOG_DEBUG << "Request " << request.id << " from " << request.endpoint
+                  << " failed: The database is unavailable.";
+        mb->setRcode(Message::Header::RCODE::SERVER_FAILURE);
+        return;
+    }
+
+    // Only plain queries for a single question are cached
+    if (answer_cache_ && mhdr.qdcount() == 1) {
+        const auto& q = *message.getQuestions().begin();
+        if (q.clas() == CLASS_IN && q.type() != QTYPE_AXFR && q.type() != QTYPE_IXFR) {
+            cache_key = AnswerCache::makeKey(labelsToFqdnKey(q.labels()), q.type(),
+                                             mb->maxBufferSize(), mb->hasOpt(), request.is_tcp);
+            if (auto reply = answer_cache_->get(cache_key)) {
+                mb->setFromCachedReply(*reply, message);
+                do_reply = false;
+                LOG_DEBUG << "Request " << request.id << " from " << request.endpoint
+                          << " is done (cached): " << mb->toString();
+                send(mb, true);
+                server_.metrics().dns_answer_cache_hits().inc();
+                server_.metrics().dns_responses_ok().inc();
+                return;
+            }
+            server_.metrics().dns_answer_cache_misses().inc();
+            cache_generation = answer_cache_->generation();
+        }
+    }
+
+    // Optionally sample what the database does for this request.
+    // The PerfContext is thread-local, so we only sample UDP requests. TCP requests
+    // yield to the session's strand while replying, and may resume on another thread.
+    const Metrics::PerfContextSample perf_sample{server_.metrics(),
+        request.is_tcp ? 0 : config().metrics_dns_perf_sample_rate};
 
-    LOG_TRACE << "DnsEngine::processRequest " << request.uuid
+    auto trx = server_.resource().readOnlyTransaction();
+
+    LOG_TRACE << "DnsEngine::processRequest " << request.id
               << ". qcount=" << message.header().qdcount();
 
+    // Names we want to add address records for in the additional section
+    vector<string> additional_names;
+
+    // Look up all the names in one batch and add their address records
+    // to the additional section. Returns false if the reply was truncated.
+    const auto add_additional = [&](vector<string>& names, bool withCname) {
+        ranges::sort(names);
+        names.erase(unique(names.begin(), names.end()), names.end());
+
+        vector<string_view> keys{names.begin(), names.end()};
+        if (!cache_key.empty()) {
+            for(const auto& name : names) {
+                cache_deps.emplace_back(name);
+            }
+        }
+
+        for(const auto& entry : trx->lookupBatch(keys)) {
+            for(const auto& rr : entry) {
+                const auto type = rr.type();
+                if (type == TYPE_A || type == TYPE_AAAA || (withCname && type == TYPE_CNAME)) {
+                    if (!mb->addRr(rr, hdr, MessageBuilder::Segment::ADDITIONAL)) {
+                        server_.metrics().truncated_dns_responses().inc();
+                        return false;
+                    }
+                } // relevant type
+            } // for entry
+        } // for lookupBatch
+
+        names.clear();
+        return true;
+    };
+
 
     // Iterate over the queries and add our answers
     for(const auto& query : message.getQuestions()) {
         if (query.clas() != CLASS_IN) {
             LOG_DEBUG << "I can only handle CLASS_IN. Client requested " << query.clas()
-                     << " in request " << request.uuid;
+                     << " in request " << request.id;
             mb->setRcode(Message::Header::RCODE::NOT_IMPLEMENTED);
             server_.metrics().dns_requests_error().inc();
             return;
@@ -1079,7 +1610,7 @@ void DnsEngine::processRequest(const DnsEngine::Request &request,
         auto key = labelsToFqdnKey(orig_fqdn);
 
         if (qtype == QTYPE_AXFR) {
-            return doAxfr(request, send, message, mb, {key, key_class_t::ENTRY}, *trx);
+            return doAxfr(request, send, message, mb, {key, key_class_t::ENTRY});
         }
 
         if (qtype == QTYPE_IXFR) {
@@ -1087,6 +1618,9 @@ void DnsEngine::processRequest(const DnsEngine::Request &request,
         }
 
 again:
+        if (!cache_key.empty()) {
+            cache_deps.emplace_back(key.string());
+        }
         auto rr_set = trx->lookup(key);
         if (!rr_set.empty()) {
             const auto& rr_hdr = rr_set.header();
@@ -1155,11 +1689,30 @@ again:
                     server_.metrics().truncated_dns_responses().inc();
                     return; // Truncated
                 }
+
+                // RFC 1035 3.3.9, RFC 2782
+                if (rr_type == TYPE_MX) {
+                    additional_names.emplace_back(
+                        toFqdnKey(RrMx{rr_set.buffer(), rr.offset()}.host().string()).string());
+                } else if (rr_type == TYPE_SRV) {
+                    additional_names.emplace_back(
+                        toFqdnKey(RrSrv{rr_set.buffer(), rr.offset()}.target().string()).string());
+                }
             } // for rr_set
         } else {
             // key not found.
             bool is_referral = false;
-            if (auto prev = getNextKey(key); !prev.empty()) {
+            span_t prev;
+            if (const auto *zone_index = server_.resource().zoneIndex()) {
+                // Find the delegation, if any, in memory
+                prev = span_t{zone_index->findClosest(key).cut};
+            } else {
+                prev = getNextKey(key);
+            }
+            if (!prev.empty()) {
+                if (!cache_key.empty()) {
+                    cache_deps.emplace_back(prev.data(), prev.size());
+                }
                 // Is it a referral?
                 if (auto entry = trx->lookup({prev.data(), prev.size()}); !entry.empty()) {
                     const auto& e_hdr = entry.header();
@@ -1173,24 +1726,14 @@ again:
                                     server_.metrics().truncated_dns_responses().inc();
                                     return; // Truncated
                                 }
-                                ns_list.push_back(rr.labels().string());
+                                ns_list.push_back(toFqdnKey(RrNs{entry.buffer(), rr.offset()}.ns().string()).string());
                             }
                         }
 
                         // See if we can resolve the NS servers.
-                        for(const auto& ns : ns_list) {
-                            if (auto ns_rrset = trx->lookup(toFqdnKey(ns)); !ns_rrset.empty()) {
-                                for(const auto& rr : ns_rrset) {
-                                    const auto type = rr.type();
-                                    if (type == TYPE_CNAME || type == TYPE_A || type == TYPE_AAAA) {
-                                        if (!mb->addRr(rr, hdr, MessageBuilder::Segment::ADDITIONAL)) {
-                                            server_.metrics().truncated_dns_responses().inc();
-                                            return; // Truncated
-                                        }
-                                    } // relevant type
-                                } // for ns_rrset
-                            } // ns loouup
-                        } // nslist
+                        if (!add_additional(ns_list, true)) {
+                            return; // Truncated
+                        }
                     } // is referral
                 } // if referral lookup block
             } // Next level block
@@ -1205,21 +1748,140 @@ again:
         } // fqdn not found with direct lookup
     } // For queries
 
-    // Should we add nameservers in the auth section?
-
     // Add additional information as appropriate
+    if (!additional_names.empty() && !add_additional(additional_names, false)) {
+        return; // Truncated
+    }
+
+    cacheable = !cache_key.empty();
+
+    // Should we add nameservers in the auth section?
 }
 
 void DnsEngine::startEndpoints()
 {
-    doStartEndpoints<udp_t>(*this, config().dns_endpoint, config().dns_udp_port);
-    doStartEndpoints<tcp_t>(*this, config().dns_endpoint, config().dns_tcp_port);
+    if (config().dns_reuseport_workers) {
+#ifdef SO_REUSEPORT
+        startReusePortWorkers();
+        return;
+#else
+        LOG_WARN << "DnsEngine::startEndpoints - SO_REUSEPORT is not supported on this platform. "
+                 << "Using the shared thread-pool for DNS.";
+#endif
+    }
+
+    doStartEndpoints<udp_t>(*this, ctx(), config().dns_endpoint, config().dns_udp_port);
+    doStartEndpoints<tcp_t>(*this, ctx(), config().dns_endpoint, config().dns_tcp_port);
+}
+
+void DnsEngine::startReusePortWorkers()
+{
+    const auto num_workers = max<size_t>(config().num_dns_threads, 1);
+    LOG_INFO << "DnsEngine - Starting " << num_workers
+             << " DNS workers, each with it's own SO_REUSEPORT sockets.";
+
+    // Each worker get it's own io_context and set of sockets.
+    // The kernel distributes the incoming packets and connections between them.
+    auto udp_port = config().dns_udp_port;
+    auto tcp_port = config().dns_tcp_port;
+    for(size_t i = 0; i < num_workers; ++i) {
+        auto& worker = workers_.emplace_back(make_unique<Worker>());
+        doStartEndpoints<udp_t>(*this, worker->ctx, config().dns_endpoint, udp_port, true);
+        doStartEndpoints<tcp_t>(*this, worker->ctx, config().dns_endpoint, tcp_port, true);
+
+        // If the port is 0, the OS picks one for the first worker.
+        // The other workers must share that port.
+        if (i == 0) {
+            udp_port = to_string(udpPort());
+            tcp_port = to_string(tcpPort());
+        }
+    }
+
+    for(size_t i = 0; i < num_workers; ++i) {
+        workers_[i]->thread = thread{[this, i] {
+            runWorker(i);
+        }};
+    }
+}
+
+uint16_t DnsEngine::udpPort() const
+{
+    for(const auto& ep : endpoints_) {
+        if (ep->isUdp()) {
+            return ep->localPort();
+        }
+    }
+    return 0;
+}
+
+uint16_t DnsEngine::tcpPort() const
+{
+    for(const auto& ep : endpoints_) {
+        if (!ep->isUdp()) {
+            return ep->localPort();
+        }
+    }
+    return 0;
+}
+
+void DnsEngine::runWorker(size_t id)
+{
+    auto& worker = *workers_.at(id);
+
+    if (config().dns_pin_workers) {
+#ifdef __linux__
+        // Only use the CPU's we are allowed to run on (cpuset, taskset).
+        // The thread inherits the affinity from the thread that started it.
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        vector<int> cpus;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } else {
+            LOG_WARN << "DnsEngine::runWorker - Failed to get the CPU affinity: " << strerror(errno);
+        }
+
+        if (!cpus.empty()) {
+            const auto cpu = cpus[id % cpus.size()];
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(cpu, &cpuset);
+            if (const auto err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset)) {
+                LOG_WARN << "DnsEngine::runWorker - Failed to pin DNS worker #" << id
+                         << " to CPU " << cpu << ": " << strerror(err);
+            } else {
+                LOG_DEBUG << "DnsEngine::runWorker - DNS worker #" << id << " is pinned to CPU " << cpu;
+            }
+        }
+#else
+        LOG_WARN << "DnsEngine::runWorker - CPU pinning is only supported on Linux.";
+#endif
+    }
+
+    LOG_DEBUG << "DNS worker #" << id << " is starting.";
+    lib::Metrics::gauge_scoped_t thread_scope;
+    if (server_.haveMetrics()) {
+        thread_scope = server_.metrics().asio_worker_threads().scoped();
+    }
+
+    try {
+        worker.ctx.run();
+    } catch(const exception& ex) {
+        LOG_ERROR << "DNS worker #" << id << " caught exception: " << ex.what();
+    }
+    LOG_DEBUG << "DNS worker #" << id << " is done.";
 }
 
 DnsEngine::tcp_session_t DnsEngine::createTcpSession(DnsEngine::tcp_t::socket && socket)
 {
-    const auto rep = socket.remote_endpoint();
-    const auto lep = socket.local_endpoint();
+    // Don't throw if the peer has already reset the connection
+    boost::system::error_code ec;
+    const auto rep = socket.remote_endpoint(ec);
+    const auto lep = socket.local_endpoint(ec);
     tcp_session_t session;
     try {
         session = make_shared<DnsTcpSession>(*this, std::move(socket));
@@ -1234,11 +1896,11 @@ DnsEngine::tcp_session_t DnsEngine::createTcpSession(DnsEngine::tcp_t::socket &&
 
     LOG_DEBUG << "Starting new DNS TCP connection from "
               << rep << " to (my interface) " << lep << " as session "
-              << session->uuid();
+              << session->id();
 
     {
         lock_guard<mutex> lock{tcp_session_mutex_};
-        tcp_sessions_.emplace(session->uuid(), session);
+        tcp_sessions_.emplace(session->id(), session);
     }
 
     // Since the DnsEngine has ownership of the session, there is
@@ -1247,7 +1909,7 @@ DnsEngine::tcp_session_t DnsEngine::createTcpSession(DnsEngine::tcp_t::socket &&
     // a weak pointer so we can easily detect this corner-case and handle
     // it correctly.
     auto w = session->weak_from_this();
-    boost::asio::post(ctx(), [w] {
+    boost::asio::post(session->executor(), [w] {
         if (auto self = w.lock()) {
             // Start receiving messages
             self->start();
@@ -1259,13 +1921,13 @@ DnsEngine::tcp_session_t DnsEngine::createTcpSession(DnsEngine::tcp_t::socket &&
     return session;
 }
 
-void DnsEngine::removeTcpSession(boost::uuids::uuid uuid)
+void DnsEngine::removeTcpSession(uint64_t id)
 {
-    LOG_DEBUG << "Removing TCP connection " << uuid;
+    LOG_DEBUG << "Removing TCP connection " << id;
 
     {
         lock_guard<mutex> lock{tcp_session_mutex_};
-        tcp_sessions_.erase(uuid);
+        tcp_sessions_.erase(id);
     }
 }
 
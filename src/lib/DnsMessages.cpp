@@ -1,6 +1,7 @@
 
 #include <cassert>
 #include <stdexcept>
+#include <cstring>
 #include <string>
 #include <boost/asio.hpp>
 #include <algorithm>
@@ -210,6 +211,52 @@ void MessageBuilder::finish()
     createIndex();
 }
 
+void MessageBuilder::reset()
+{
+    buffer_.clear();
+    labels_.clear();
+    maxBufferSize_ = 0;
+    rcode_ = 0;
+    opt_.reset();
+    span_ = {};
+    for(auto& rrset : rrsets_) {
+        rrset.reset();
+    }
+}
+
+void MessageBuilder::setFromCachedReply(span_t reply, const Message &request)
+{
+    if (reply.size() < Message::Header::SIZE) {
+        throw runtime_error{"setFromCachedReply: Invalid reply"};
+    }
+
+    const auto& req = request.span();
+    buffer_.assign(reply.begin(), reply.end());
+
+    // Id and RD are from the request
+    set16bValueAt(buffer_, 0, request.header().id());
+    auto bits = getHdrFlags(buffer_);
+    bits.rd = request.header().rd();
+    setHdrFlags(buffer_, bits);
+
+    // The question name is not compressed, and it starts right after the header.
+    // Copy the labels from the request, so the client get the case it used.
+    for(size_t offset = Message::Header::SIZE; offset < req.size() && offset < buffer_.size();) {
+        const auto len = static_cast<uint8_t>(req[offset]);
+        if (len != static_cast<uint8_t>(buffer_[offset]) || (len & 0xc0)) {
+            break;
+        }
+        if (!len || offset + 1 + len > req.size() || offset + 1 + len > buffer_.size()) {
+            break;
+        }
+        memcpy(buffer_.data() + offset + 1, req.data() + offset + 1, len);
+        offset += 1 + len;
+    }
+
+    span_ = buffer_;
+    createIndex();
+}
+
 bool MessageBuilder::exists(const Rr &rr, Segment segment) const
 {
     Header hdr{span_};
@@ -29,54 +29,368 @@ void FollowerReplication::start()
 FollowerReplication::Agent::Agent(FollowerReplication &parent)
     : parent_{parent}
 {
-
+    current_trxid_ = parent_.server().db().getLastCommittedTransactionId();
+    last_enqueued_trxid_ = current_trxid_;
 }
 
 void FollowerReplication::Agent::init()
 {
-    current_trxid_ = parent_.server().db().getLastCommittedTransactionId();
+    if (!current_trxid_ && parent_.server().config().cluster_follower_bootstrap) {
+        // A new follower. It's faster to copy the primary's database
+        // than to replay its entire transaction-log.
+        try {
+            bootstrap();
+        } catch(const exception& ex) {
+            LOG_WARN_N << "Failed to bootstrap from the primary: " << ex.what()
+                       << ". Will replicate from the transaction-log instead.";
+        }
+    }
 
     parent_.server().grpcFollow().createSyncClient([this]() {
         lock_guard lock{mutex_};
         return current_trxid_;
-    }, [this](const grpc::nsblast::pb::SyncUpdate& update){
-        LOG_TRACE << "FollowerReplication::Agent--update called with update. sync="
-            << update.isinsync()
-            << ", trx #" << update.trx().id();
+    }, [this](grpc::nsblast::pb::SyncUpdate& update){
+        return onUpdate(update);
+    });
+}
 
-        try {
+bool FollowerReplication::Agent::onUpdate(grpc::nsblast::pb::SyncUpdate &update)
+{
+    LOG_TRACE << "FollowerReplication::Agent--update called with update. sync="
+        << update.isinsync()
+        << ", trx #" << update.trx().id()
+        << ", batch size " << update.trxs_size();
+
+    if (update.needbootstrap()) {
+        parent_.is_in_sync_ = false;
+        if (parent_.server().config().cluster_follower_bootstrap) {
+            LOG_WARN_N << "The primary has deleted the transactions we need from its "
+                       << "transaction-log. The oldest transaction it has is #"
+                       << update.firstretainedtrxid()
+                       << ". Bootstrapping from a snapshot of the primary's database.";
+            drain();
+            startBootstrap();
+            return true;
+        }
+
+        LOG_ERROR_N << "The primary has deleted the transactions we need from its "
+                    << "transaction-log. The oldest transaction it has is #"
+                    << update.firstretainedtrxid()
+                    << ". This server must be bootstrapped again.";
+        return true;
+    }
+
+    if (!update.has_trx() && update.trxs().empty()) {
+        parent_.is_in_sync_ = update.isinsync();
+        return true;
+    }
+
+    if (parent_.server().config().cluster_follower_apply_queue_size) {
+        trxs_t trxs;
+        if (update.trxs().empty()) {
+            trxs.Add()->Swap(update.mutable_trx());
+        } else {
+            trxs.Swap(update.mutable_trxs());
+        }
+        return enqueue(std::move(trxs), update.isinsync());
+    }
+
+    const auto id = update.trxs().empty()
+                        ? update.trx().id()
+                        : update.trxs().rbegin()->id();
+    try {
+        if (update.trxs().empty()) {
             onTrx(update.trx());
-            const auto id =  update.trx().id();
+        } else {
+            onTrxBatch(update.trxs());
+        }
 
-            auto was_in_sync = parent_.is_in_sync_;
-            parent_.is_in_sync_ = update.isinsync();
+        auto was_in_sync = parent_.is_in_sync_;
+        parent_.is_in_sync_ = update.isinsync();
 
-            if (parent_.is_in_sync_ != was_in_sync) {
-                LOG_INFO << "Changed replication state to "
-                         << (parent_.is_in_sync_ ? "IN_SYNC" : "NOT_IN_SYNC");
-            }
+        if (parent_.is_in_sync_ != was_in_sync) {
+            LOG_INFO << "Changed replication state to "
+                     << (parent_.is_in_sync_ ? "IN_SYNC" : "NOT_IN_SYNC");
+        }
 
-            {
-                lock_guard lock{mutex_};
-                current_trxid_ = id;
-            }
+        {
+            lock_guard lock{mutex_};
+            current_trxid_ = id;
+        }
+    } catch(const exception& ex) {
+        LOG_ERROR_N << "Failed to apply transaction #"
+                  << id
+                  << ": " << ex.what();
+    }
+
+    return true;
+}
+
+void FollowerReplication::Agent::bootstrap()
+{
+    const auto trxid = parent_.server().grpcFollow().bootstrap();
+
+    lock_guard lock{mutex_};
+    current_trxid_ = trxid;
+    last_enqueued_trxid_ = trxid;
+}
+
+void FollowerReplication::Agent::startBootstrap()
+{
+    if (bootstrapping_.exchange(true)) {
+        return;
+    }
+
+    // We are called from the gRPC stream we are about to replace,
+    // so the work must be done from another thread.
+    boost::asio::post(parent_.server().ctx(), [this] {
+        try {
+            bootstrap();
+
+            // The primary don't send anything more on the old stream
+            parent_.server().grpcFollow().restartSync();
         } catch(const exception& ex) {
-            LOG_ERROR_N << "Failed to apply transaction #"
-                      << update.trx().id()
-                      << ": " << ex.what();
+            LOG_ERROR_N << "Failed to bootstrap from the primary: " << ex.what();
         }
+
+        bootstrapping_ = false;
     });
 }
 
 void FollowerReplication::Agent::onTrx(const pb::Transaction &value)
 {
-    const auto trxid = value.id();
+    auto trx = parent_.server().db().dbTransaction();
+    trx->disableTrxlog();
 
-    LOG_TRACE_N << "Applying transaction #" << trxid;
+    apply(*trx, value);
+    trx->commit();
+
+    parent_.server().db().pruneTrxLog();
+}
+
+void FollowerReplication::Agent::onTrxBatch(const google::protobuf::RepeatedPtrField<pb::Transaction>& trxs)
+{
+    LOG_TRACE_N << "Applying a batch of " << trxs.size() << " transactions.";
 
     auto trx = parent_.server().db().dbTransaction();
     trx->disableTrxlog();
 
+    for(const auto& value : trxs) {
+        apply(*trx, value);
+    }
+    trx->commit();
+
+    parent_.server().db().pruneTrxLog();
+}
+
+bool FollowerReplication::Agent::enqueue(trxs_t &&trxs, bool isInSync)
+{
+    if (resyncing_) {
+        LOG_TRACE_N << "Ignoring an update while we re-sync with the primary.";
+        return true;
+    }
+
+    const auto max_pending = parent_.server().config().cluster_follower_apply_queue_size;
+    auto item = make_shared<Pending>();
+    item->isInSync = isInSync;
+    bool can_read = true;
+    bool has_hole = false;
+
+    {
+        lock_guard lock{mutex_};
+
+        // The primary may re-send transactions we already have after a re-sync
+        int skip = 0;
+        while(skip < trxs.size() && trxs.Get(skip).id() <= last_enqueued_trxid_) {
+            ++skip;
+        }
+        if (skip) {
+            LOG_DEBUG_N << "Skipping " << skip << " transactions we already have.";
+            trxs.DeleteSubrange(0, skip);
+        }
+        if (trxs.empty()) {
+            return true;
+        }
+
+        // Anything else than the next transaction leaves a hole in the data
+        auto expected = last_enqueued_trxid_;
+        for(const auto& trx : trxs) {
+            if (trx.id() != ++expected) {
+                LOG_WARN_N << "Got transaction #" << trx.id() << " from the primary. Expected #"
+                           << expected << '.';
+                has_hole = true;
+                break;
+            }
+        }
+
+        if (!has_hole) {
+            last_enqueued_trxid_ = expected;
+            item->seq = next_seq_++;
+            pending_[item->seq] = item;
+
+            // Back-pressure. gRPC don't read more from the primary until commitReady()
+            // has made room in the queue.
+            if (pending_.size() >= max_pending) {
+                read_paused_ = true;
+                can_read = false;
+            }
+        }
+    }
+
+    if (has_hole) {
+        resync();
+        return true;
+    }
+
+    boost::asio::post(parent_.server().ctx(),
+                      [this, item, trxs = make_shared<trxs_t>(std::move(trxs))] {
+        try {
+            for(const auto& trx : *trxs) {
+                parent_.server().db().prepareReplicated(item->batch, trx);
+            }
+        } catch(const exception& ex) {
+            LOG_ERROR_N << "Failed to prepare transactions from the primary: " << ex.what();
+            item->failed = true;
+        }
+
+        {
+            lock_guard lock{mutex_};
+            item->ready = true;
+        }
+
+        commitReady();
+    });
+
+    return can_read;
+}
+
+void FollowerReplication::Agent::commitReady()
+{
+    // The batches must be written in the same order as we got them
+    lock_guard commit_lock{commit_mutex_};
+    bool committed = false;
+
+    while(true) {
+        shared_ptr<Pending> item;
+        {
+            lock_guard lock{mutex_};
+            auto it = pending_.find(next_commit_seq_);
+            if (it == pending_.end() || !it->second->ready) {
+                break;
+            }
+            item = it->second;
+        }
+
+        bool ok = !item->failed;
+        if (ok) {
+            try {
+                parent_.server().db().commitReplicated(item->batch);
+            } catch(const exception& ex) {
+                LOG_ERROR_N << "Failed to apply transactions up to #"
+                            << item->batch.trxId << ": " << ex.what();
+                ok = false;
+            }
+        }
+
+        if (!ok) {
+            // Later updates would leave a hole in the data
+            resyncLocked();
+            break;
+        }
+
+        bool resume_read = false;
+        {
+            lock_guard lock{mutex_};
+            pending_.erase(item->seq);
+            next_commit_seq_ = item->seq + 1;
+            current_trxid_ = item->batch.trxId;
+
+            if (read_paused_
+                && pending_.size() < parent_.server().config().cluster_follower_apply_queue_size) {
+                read_paused_ = false;
+                resume_read = true;
+            }
+        }
+        pending_cond_.notify_all();
+        committed = true;
+
+        if (resume_read) {
+            parent_.server().grpcFollow().resumeRead();
+        }
+
+        const auto was_in_sync = parent_.is_in_sync_;
+        parent_.is_in_sync_ = item->isInSync;
+        if (parent_.is_in_sync_ != was_in_sync) {
+            LOG_INFO << "Changed replication state to "
+                     << (parent_.is_in_sync_ ? "IN_SYNC" : "NOT_IN_SYNC");
+        }
+    }
+
+    if (committed) {
+        parent_.server().db().pruneTrxLog();
+    }
+}
+
+void FollowerReplication::Agent::resync()
+{
+    // Don't reset the queue under a commit in progress. commitReady() would
+    // then advance next_commit_seq_ past the first update after the re-sync,
+    // and current_trxid_ would not include the transactions it commits.
+    lock_guard commit_lock{commit_mutex_};
+    resyncLocked();
+}
+
+void FollowerReplication::Agent::resyncLocked()
+{
+    bool already_resyncing = false;
+    {
+        lock_guard lock{mutex_};
+        LOG_WARN_N << "Discarding " << pending_.size() << " pending updates. "
+                   << "Will ask the primary for the transactions after #"
+                   << current_trxid_ << " again.";
+
+        // Updates that are still being prepared are ignored by commitReady(),
+        // as their sequence numbers are below next_commit_seq_
+        pending_.clear();
+        next_commit_seq_ = next_seq_;
+        last_enqueued_trxid_ = current_trxid_;
+        read_paused_ = false;
+        already_resyncing = resyncing_.exchange(true);
+    }
+    pending_cond_.notify_all();
+
+    if (already_resyncing) {
+        return;
+    }
+
+    boost::asio::post(parent_.server().ctx(), [this] {
+        // The new stream starts with the transaction after current_trxid_.
+        // Its first updates must not be ignored. Anything that still arrives
+        // from the old stream must follow last_enqueued_trxid_, or it's skipped
+        // or triggers a new re-sync.
+        resyncing_ = false;
+        try {
+            parent_.server().grpcFollow().restartSync();
+        } catch(const exception& ex) {
+            LOG_ERROR_N << "Failed to restart the replication: " << ex.what();
+        }
+    });
+}
+
+void FollowerReplication::Agent::drain()
+{
+    unique_lock lock{mutex_};
+    pending_cond_.wait(lock, [this] {
+        return pending_.empty();
+    });
+}
+
+void FollowerReplication::Agent::apply(ResourceIf::TransactionIf &trx, const pb::Transaction &value)
+{
+    const auto trxid = value.id();
+
+    LOG_TRACE_N << "Applying transaction #" << trxid;
+
     // Re-compose each of the parts of the original transaction
     for(const auto& part : value.parts()) {
         const ResourceIf::RealKey key{ResourceIf::RealKey::Binary{part.key()}};
@@ -84,10 +398,13 @@ void FollowerReplication::Agent::onTrx(const pb::Transaction &value)
         try {
             auto cat = ResourceIf::toCatecory(part.columnfamilyix());
             if (part.has_value()) {
-                trx->write(key, part.value(), false, cat);
+                trx.write(key, part.value(), false, cat);
+            } else if (part.has_endkey()) {
+                op = "remove range from";
+                trx.removeRange(part.key(), part.endkey(), cat);
             } else {
                 op = "remove";
-                trx->remove(key, false, cat);
+                trx.remove(key, false, cat);
             }
         } catch (const exception& ex) {
             LOG_WARN_N << "Failed to " << op << ' ' << key << " of transaction "
@@ -100,8 +417,7 @@ void FollowerReplication::Agent::onTrx(const pb::Transaction &value)
     string val;
     value.SerializeToString(&val);
     const ResourceIf::RealKey key{trxid, ResourceIf::RealKey::Class::TRXID};
-    trx->write(key, val, false, ResourceIf::Category::TRXLOG);
-    trx->commit();
+    trx.write(key, val, false, ResourceIf::Category::TRXLOG);
 }
 
 
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <map>
 #include <mutex>
 #include <memory>
 //#include "nsblast/util.h"
 //#include "RocksDbResource.h"
 //#include "GrpcPrimary.h"
 #include "GrpcFollow.h"
+#include "RocksDbResource.h"
 #include "proto/nsblast.pb.h"
 
 namespace nsblast {
@@ -37,11 +40,80 @@ public:
 
         void init();
 
+        /*! Handle an update from the primary
+         *
+         *  \return false if the apply queue is full. The caller must then stop
+         *      reading from the primary until resumeRead() is called on the stream.
+         */
+        bool onUpdate(grpc::nsblast::pb::SyncUpdate& update);
+
+        /*! True while we discard updates and restart the stream from the primary */
+        bool isResyncing() const noexcept {
+            return resyncing_;
+        }
+
         void onTrx(const pb::Transaction& trx);
 
+        /*! Apply a batch of transactions in one database transaction */
+        void onTrxBatch(const google::protobuf::RepeatedPtrField<pb::Transaction>& trxs);
+
+        /*! Replace our zone-data with a snapshot from the primary
+         *
+         *  Blocks until the snapshot is imported.
+         */
+        void bootstrap();
+
     private:
+        using trxs_t = google::protobuf::RepeatedPtrField<pb::Transaction>;
+
+        /*! An update from the primary that is being prepared, or waits to be committed */
+        struct Pending {
+            RocksDbResource::ReplicatedBatch batch;
+            uint64_t seq = 0; // Key in pending_
+            bool isInSync = false;
+            bool ready = false;
+            bool failed = false;
+        };
+
+        void apply(ResourceIf::TransactionIf& trx, const pb::Transaction& value);
+        void startBootstrap();
+
+        /*! Prepare the transactions in a worker-thread, and commit them in order
+         *
+         *  The transactions must follow the last transaction we have received,
+         *  without holes. Transactions we already have are skipped.
+         *  If there is a hole, we re-sync with the primary.
+         *
+         *  \return false if `cluster_follower_apply_queue_size` updates are now pending.
+         */
+        bool enqueue(trxs_t&& trxs, bool isInSync);
+
+        /*! Commit the prepared updates that are next in line */
+        void commitReady();
+
+        /*! Discard the pending updates and ask the primary for the transactions again
+         *
+         *  Waits for a commit in progress to finish.
+         */
+        void resync();
+
+        /*! Same as resync(), but the caller must hold commit_mutex_ */
+        void resyncLocked();
+
+        /*! Wait until all the pending updates are committed or discarded */
+        void drain();
+
         std::weak_ptr<GrpcFollow::SyncFromServer> grpc_sync_;
         uint64_t current_trxid_ = 0; // Last transaction id received from the primary
+        uint64_t last_enqueued_trxid_ = 0; // Last transaction id in the apply queue
+        bool read_paused_ = false;
+        std::atomic_bool bootstrapping_{false};
+        std::atomic_bool resyncing_{false};
+        std::map<uint64_t, std::shared_ptr<Pending>> pending_; // By sequence number
+        uint64_t next_seq_ = 0;
+        uint64_t next_commit_seq_ = 0;
+        std::condition_variable pending_cond_;
+        std::mutex commit_mutex_;
         FollowerReplication& parent_;
         mutable std::mutex mutex_;
     };
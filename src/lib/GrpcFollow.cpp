@@ -1,8 +1,13 @@
 //#include <boost/uuid/string_generator.hpp>
 
+#include <fstream>
+
 #include <grpc/grpc.h>
+#include <lz4.h>
 
 #include "GrpcFollow.h"
+#include "RocksDbResource.h"
+#include "Metrics.h"
 #include "nsblast/logging.h"
 //#include "nsblast/util.h"
 #include "nsblast/AckTimer.hpp"
@@ -50,35 +55,120 @@ void GrpcFollow::createSyncClient(get_current_trxid_t due, on_update_t onUpdate)
     scheduleNextTimer();
 }
 
-void GrpcFollow::scheduleNextTimer()
+uint64_t GrpcFollow::bootstrap()
 {
-    timer_.expires_from_now(boost::posix_time::seconds{server().config().cluster_keepalive_timer});
-    timer_.async_wait([this](boost::system::error_code ec) {
-        if (!ec.failed()) {
-            onTimer();
+    const auto& address = server().config().cluster_server_addr;
+    LOG_INFO_N << "Bootstrapping from a snapshot of the primary's database at " << address;
+
+    auto channel = createChannel(address);
+    auto stub = grpc::nsblast::pb::NsblastSvc::NewStub(channel);
+    assert(stub);
+
+    grpc::ClientContext ctx;
+    ctx.AddMetadata("auth-hash", authKey().hash);
+    ctx.AddMetadata("auth-seed", authKey().seed);
+
+    filesystem::path dir = server().config().db_path;
+    dir /= "bootstrap-import";
+    dir /= boost::uuids::to_string(newUuid());
+    filesystem::create_directories(dir);
+
+    ScopedExit cleanup{[&dir] {
+        std::error_code ec;
+        filesystem::remove_all(dir, ec);
+    }};
+
+    RocksDbResource::Snapshot snapshot;
+    grpc::nsblast::pb::BootstrapRequest req;
+    grpc::nsblast::pb::BootstrapChunk chunk;
+    std::ofstream file;
+    bool first = true;
+    size_t bytes = 0;
+
+    auto reader = stub->Bootstrap(&ctx, req);
+    while(reader->Read(&chunk)) {
+        if (first) {
+            snapshot.trxId = chunk.trxid();
+            snapshot.lastTrx = chunk.lasttrx();
+            first = false;
         }
 
-        if (!stopped_) {
-            scheduleNextTimer();
+        if (!chunk.filename().empty()) {
+            // Never trust a path from the network
+            const auto path = dir / filesystem::path{chunk.filename()}.filename();
+            if (!file.is_open()) {
+                file.open(path, ios::out | ios::binary | ios::trunc);
+                if (!file.is_open()) {
+                    LOG_ERROR_N << "Failed to open " << path << " for write";
+                    ctx.TryCancel();
+                    reader->Finish();
+                    throw runtime_error{"Failed to write the database snapshot"};
+                }
+            }
+
+            file.write(chunk.data().data(), chunk.data().size());
+            bytes += chunk.data().size();
+
+            if (chunk.endoffile()) {
+                file.close();
+                if (!file) {
+                    LOG_ERROR_N << "Failed to write " << path;
+                    ctx.TryCancel();
+                    reader->Finish();
+                    throw runtime_error{"Failed to write the database snapshot"};
+                }
+                snapshot.files.emplace_back(ResourceIf::toCatecory(chunk.columnfamilyix()), path);
+            }
         }
-    });
+
+        chunk.Clear();
+    }
+
+    if (const auto status = reader->Finish(); !status.ok()) {
+        LOG_ERROR_N << "Bootstrap failed: " << status.error_message();
+        throw runtime_error{"Bootstrap from the primary failed"};
+    }
+
+    if (first || file.is_open()) {
+        LOG_ERROR_N << "Bootstrap failed: The snapshot from the primary was incomplete.";
+        throw runtime_error{"Bootstrap from the primary failed"};
+    }
+
+    LOG_INFO_N << "Received " << snapshot.files.size() << " files (" << bytes
+               << " bytes) at trx #" << snapshot.trxId;
+
+    server().db().importSnapshot(snapshot);
+    return snapshot.trxId;
 }
 
-GrpcFollow::SyncFromServer::SyncFromServer(GrpcFollow &grpc,
-                                           const std::string &address)
-    : grpc_{grpc}
-    , ack_timer_{grpc.server().ctx(), [this] {
-                     onAckTimer();
-                 }
-      }
+void GrpcFollow::resumeRead()
+{
+    if (auto f = follower_) {
+        f->resumeRead();
+    }
+}
+
+void GrpcFollow::restartSync()
+{
+    if (follower_) {
+        follower_->stop();
+        follower_.reset();
+    }
+
+    if (get_ack_t) {
+        startFollower();
+    }
+}
+
+std::shared_ptr<grpc::Channel> GrpcFollow::createChannel(const string &address)
 {
     std::shared_ptr<grpc::ChannelCredentials> creds;
 
     string_view how = "plain text";
 
-    if (!grpc_.server().config().cluster_x509_ca_cert.empty()) {
+    if (!server().config().cluster_x509_ca_cert.empty()) {
         grpc::SslCredentialsOptions opts;
-        opts.pem_root_certs = readFileToBuffer(grpc_.server().config().cluster_x509_ca_cert);
+        opts.pem_root_certs = readFileToBuffer(server().config().cluster_x509_ca_cert);
         creds = grpc::SslCredentials(opts);
         how = "tls with x509";
     } else {
@@ -90,12 +180,38 @@ GrpcFollow::SyncFromServer::SyncFromServer(GrpcFollow &grpc,
     LOG_INFO_N << "Setting up replication channel to " << address
                << " using a " << how << " connection.";
 
-    channel_ = grpc::CreateChannel(address, creds);
-    if (auto status = channel_->GetState(false); status == GRPC_CHANNEL_TRANSIENT_FAILURE) {
+    auto channel = grpc::CreateChannel(address, creds);
+    if (auto status = channel->GetState(false); status == GRPC_CHANNEL_TRANSIENT_FAILURE) {
         LOG_WARN << "Failed to initialize channel. Is the server address even valid?";
         throw std::runtime_error{"Failed to initialize channel"};
     }
 
+    return channel;
+}
+
+void GrpcFollow::scheduleNextTimer()
+{
+    timer_.expires_from_now(boost::posix_time::seconds{server().config().cluster_keepalive_timer});
+    timer_.async_wait([this](boost::system::error_code ec) {
+        if (!ec.failed()) {
+            onTimer();
+        }
+
+        if (!stopped_) {
+            scheduleNextTimer();
+        }
+    });
+}
+
+GrpcFollow::SyncFromServer::SyncFromServer(GrpcFollow &grpc,
+                                           const std::string &address)
+    : grpc_{grpc}
+    , ack_timer_{grpc.server().ctx(), [this] {
+                     onAckTimer();
+                 }
+      }
+{
+    channel_ = grpc_.createChannel(address);
     stub_ = grpc::nsblast::pb::NsblastSvc::NewStub(channel_);
     assert(stub_);
 }
@@ -142,6 +258,10 @@ bool GrpcFollow::SyncFromServer::writeIf()
         const auto ack = grpc_.get_ack_t();
         req_.set_level(grpc::nsblast::pb::SyncLevel::ENTRIES);
         req_.set_startafter(ack);
+        req_.set_acceptbatches(true);
+        if (grpc_.server().config().cluster_sync_compression == "lz4") {
+            req_.set_acceptcompression(grpc::nsblast::pb::SYNC_LZ4);
+        }
         can_write_ = false;
         LOG_TRACE_N << "Asking for transactions from #" << ack;
         StartWrite(&req_);
@@ -170,7 +290,7 @@ void GrpcFollow::SyncFromServer::ping()
         LOG_INFO_N << "We may have lost connectivity with the primary (cluster_keepalive_timeout="
                    << grpc_.server().config().cluster_keepalive_timeout
                    << " seconds).";
-        static const grpc::nsblast::pb::SyncUpdate not_in_sync;
+        grpc::nsblast::pb::SyncUpdate not_in_sync;
         callOnUpdate(not_in_sync);
     }
 }
@@ -195,12 +315,56 @@ void GrpcFollow::SyncFromServer::OnReadDone(bool ok) {
     }
 
     grpc_.last_contact_ = chrono::steady_clock::now();
-    callOnUpdate(update_);
+    if (!update_.compressed().empty()) [[unlikely]] {
+        if (grpc_.server().config().cluster_sync_compression != "lz4") {
+            LOG_ERROR_N << "The primary sent a compressed update, but we did not ask for compression.";
+            stop();
+            return;
+        }
+        if (!grpc_.decompress(update_)) {
+            stop();
+            return;
+        }
+    }
+
+    const auto read_more = callOnUpdate(update_);
     update_.Clear();
+
+    if (!read_more) {
+        // Back-pressure. The follower can't keep up.
+        lock_guard lock{mutex_};
+        if (resume_requested_) {
+            resume_requested_ = false;
+        } else {
+            LOG_TRACE_N << "Pausing reads from the primary.";
+            read_paused_ = true;
+            startAckTimer();
+            return;
+        }
+    }
+
     StartRead(&update_);
     startAckTimer();
 }
 
+void GrpcFollow::SyncFromServer::resumeRead()
+{
+    lock_guard lock{mutex_};
+    if (done_) {
+        return;
+    }
+
+    if (!read_paused_) {
+        // OnReadDone() has not yet paused
+        resume_requested_ = true;
+        return;
+    }
+
+    LOG_TRACE_N << "Resuming reads from the primary.";
+    read_paused_ = false;
+    StartRead(&update_);
+}
+
 void GrpcFollow::SyncFromServer::OnDone(const grpc::Status &s)
 {
     if (!was_connected_) {
@@ -239,11 +403,50 @@ void GrpcFollow::onTimer()
     }
 }
 
-void GrpcFollow::SyncFromServer::callOnUpdate(const grpc::nsblast::pb::SyncUpdate &update)
+bool GrpcFollow::decompress(grpc::nsblast::pb::SyncUpdate& update)
+{
+    // Sanity limit. The primary's batches are much smaller.
+    static constexpr uint32_t max_size = 256 * 1024 * 1024;
+
+    const auto size = update.uncompressedsize();
+    if (size > max_size) {
+        LOG_ERROR_N << "The primary sent a compressed update of " << size
+                    << " bytes. The limit is " << max_size << " bytes.";
+        return false;
+    }
+
+    auto& metrics = server().metrics().sync_compression();
+    string buffer(size, 0);
+    int len = 0;
+    {
+        auto duration = metrics.duration->scoped();
+        len = LZ4_decompress_safe(update.compressed().data(), buffer.data(),
+                                  static_cast<int>(update.compressed().size()),
+                                  static_cast<int>(buffer.size()));
+    }
+
+    if (len < 0 || static_cast<uint32_t>(len) != size) {
+        LOG_ERROR_N << "Failed to decompress an update from the primary.";
+        return false;
+    }
+
+    metrics.uncompressed_bytes->inc(size);
+    metrics.compressed_bytes->inc(update.compressed().size());
+    metrics.ratio->observe(static_cast<double>(update.compressed().size()) / size);
+
+    if (!update.ParseFromString(buffer)) {
+        LOG_ERROR_N << "Failed to deserialize a decompressed update from the primary.";
+        return false;
+    }
+
+    return true;
+}
+
+bool GrpcFollow::SyncFromServer::callOnUpdate(grpc::nsblast::pb::SyncUpdate &update)
 {
     assert(grpc_.on_update_);
     lock_guard lock{update_mutex_};
-    grpc_.on_update_(update);
+    return grpc_.on_update_(update);
 }
 
 void GrpcFollow::SyncFromServer::startAckTimer()
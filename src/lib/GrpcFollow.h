@@ -23,7 +23,9 @@ using ack_timer_t = AckTimer<boost::asio::io_context, std::function<void()>>;
 class GrpcFollow {
 public:
     using get_current_trxid_t = std::function<uint64_t()>; // Called to check if we should send an update
-    using on_update_t = std::function<void(const grpc::nsblast::pb::SyncUpdate& update)>;
+    // The callback may move the transactions out of the update.
+    // It returns false to stop reading from the primary until resumeRead() is called.
+    using on_update_t = std::function<bool(grpc::nsblast::pb::SyncUpdate& update)>;
 
     GrpcFollow(Server& server);
 
@@ -41,6 +43,9 @@ public:
         void stop();
         bool writeIf();
         void ping();
+
+        /*! Continue reading updates after the update callback returned false */
+        void resumeRead();
         bool isDone() const noexcept {
             return done_;
         }
@@ -55,7 +60,7 @@ public:
         /*! Callback event when the RPC is complete */
         void OnDone(const grpc::Status& s) override;
 
-        void callOnUpdate(const grpc::nsblast::pb::SyncUpdate& update);
+        bool callOnUpdate(grpc::nsblast::pb::SyncUpdate& update);
         void startAckTimer();
         void onAckTimer();
 
@@ -71,6 +76,8 @@ public:
         std::shared_ptr<SyncFromServer> self_;
         ack_timer_t ack_timer_;
         bool ack_pending_ = false;
+        bool read_paused_ = false;
+        bool resume_requested_ = false;
         std::atomic_bool done_{false};
         std::mutex mutex_;
         std::mutex update_mutex_;
@@ -85,6 +92,30 @@ public:
 
     void createSyncClient(get_current_trxid_t due, on_update_t onUpdate);
 
+    /*! Replace our zone-data with a snapshot of the primary's database.
+     *
+     *  Blocks until the snapshot is downloaded and imported.
+     *
+     *  \return The transaction-id the snapshot is consistent with.
+     *  \throws std::runtime_error on errors
+     */
+    uint64_t bootstrap();
+
+    /*! Close the current Sync stream and start a new one */
+    void restartSync();
+
+    /*! Replace the update with the update in update.compressed
+     *
+     *  \return false if the data could not be decompressed.
+     */
+    bool decompress(grpc::nsblast::pb::SyncUpdate& update);
+
+    /*! Continue reading from the current Sync stream
+     *
+     *  Used when the update callback returned false.
+     */
+    void resumeRead();
+
     const auto& agent() {
         return follower_;
     }
@@ -95,6 +126,7 @@ public:
 
 
 private:
+    std::shared_ptr<grpc::Channel> createChannel(const std::string& address);
     void scheduleNextTimer();
     void startFollower();
     void onTimer();
@@ -6,8 +6,11 @@
 #include <grpcpp/server_builder.h>
 #include <grpcpp/server_context.h>
 
+#include <lz4.h>
+
 #include "GrpcPrimary.h"
 #include "PrimaryReplication.h"
+#include "Metrics.h"
 #include "nsblast/logging.h"
 
 using namespace std;
@@ -18,6 +21,9 @@ namespace nsblast::lib {
 
 namespace {
 
+bool canBatch(const grpc::nsblast::pb::SyncUpdate& update) {
+    return update.has_trx() && !update.needbootstrap();
+}
 
 } // anon ns
 
@@ -114,8 +120,68 @@ GrpcPrimary::bidi_sync_stream_t *GrpcPrimary::createSyncClient(grpc::CallbackSer
     return client.get();
 }
 
+GrpcPrimary::update_t GrpcPrimary::compress(const update_t& update)
+{
+    if (!update->has_trx() && update->trxs().empty()) {
+        return update;
+    }
+
+    lock_guard lock{compressed_mutex_};
+
+    // Forget the updates that all the followers are done with
+    std::erase_if(compressed_, [](const auto& v) {
+        return v.second.source.expired();
+    });
+
+    if (auto it = compressed_.find(update.get()); it != compressed_.end()) {
+        return it->second.compressed ? it->second.compressed : update;
+    }
+
+    auto compressed = compressUpdate(*update);
+    compressed_[update.get()] = {update, compressed};
+    return compressed ? compressed : update;
+}
+
+GrpcPrimary::update_t GrpcPrimary::compressUpdate(const grpc::nsblast::pb::SyncUpdate& update)
+{
+    const auto uncompressed = update.SerializeAsString();
+    if (uncompressed.size() < owner_.config().cluster_sync_compression_min_bytes
+        || uncompressed.size() > LZ4_MAX_INPUT_SIZE) {
+        return {};
+    }
+
+    auto& metrics = owner_.metrics().sync_compression();
+    string buffer;
+    {
+        auto duration = metrics.duration->scoped();
+        buffer.resize(LZ4_compressBound(static_cast<int>(uncompressed.size())));
+        const auto len = LZ4_compress_default(uncompressed.data(), buffer.data(),
+                                              static_cast<int>(uncompressed.size()),
+                                              static_cast<int>(buffer.size()));
+        if (len <= 0) {
+            LOG_WARN_N << "Failed to compress an update of "
+                       << uncompressed.size() << " bytes. Sending it uncompressed.";
+            return {};
+        }
+        buffer.resize(len);
+    }
+
+    metrics.uncompressed_bytes->inc(uncompressed.size());
+    metrics.compressed_bytes->inc(buffer.size());
+    metrics.ratio->observe(static_cast<double>(buffer.size()) / uncompressed.size());
+
+    if (buffer.size() >= uncompressed.size()) {
+        return {};
+    }
+
+    auto compressed = make_shared<grpc::nsblast::pb::SyncUpdate>();
+    compressed->set_compressed(std::move(buffer));
+    compressed->set_uncompressedsize(uncompressed.size());
+    return compressed;
+}
+
 GrpcPrimary::SyncClient::SyncClient(GrpcPrimary &grpc, grpc::CallbackServerContext &context)
-    : grpc_{grpc}, context_{context}
+    : grpc_{grpc}, batch_timer_{grpc.owner_.ctx()}, context_{context}
 {
     StartRead(&req_);
 }
@@ -129,6 +195,9 @@ bool GrpcPrimary::SyncClient::enqueue(update_t update)
         return false;
     }
 
+    if (canBatch(*update)) {
+        pending_batch_bytes_ += update->trx().ByteSizeLong();
+    }
     pending_.emplace(std::move(update));
     flush();
 
@@ -167,6 +236,13 @@ void GrpcPrimary::SyncClient::OnReadDone(bool ok)
     // I don't think we need a lock here, because we should not be called into again
     // until after we start a new read.
     if (!replication_) [[unlikely]] {
+        {
+            std::lock_guard lock{mutex_};
+            accept_batches_ = req_.acceptbatches();
+            compress_ = req_.acceptcompression() == grpc::nsblast::pb::SYNC_LZ4
+                        && grpc_.owner_.config().cluster_sync_compression == "lz4";
+        }
+
         // The first read sets up the link with replication
         replication_ = grpc_.owner_.primaryReplication().addAgent(shared_from_this());
     }
@@ -188,37 +264,170 @@ void GrpcPrimary::SyncClient::OnWriteDone(bool ok)
 void GrpcPrimary::SyncClient::flush()
 {
     if (!current_ && !pending_.empty()) {
+        if (waitForMore()) {
+            return;
+        }
+
         has_written_after_empty_queue_ = true;
-        current_ = std::move(pending_.front());
-        pending_.pop();
+        batch_delay_expired_ = false;
+        is_idle_ = false;
+        current_ = nextUpdate();
+        if (compress_) {
+            current_ = grpc_.compress(current_);
+        }
         return StartWrite(current_.get());
     }
 
     // The queue is empty. Nothing to write.
+    if (!current_) {
+        is_idle_ = true;
+    }
     if (replication_ && has_written_after_empty_queue_) {
         replication_->onQueueIsEmpty();
         has_written_after_empty_queue_ = false;
     }
 }
 
+GrpcPrimary::update_t GrpcPrimary::SyncClient::nextUpdate()
+{
+    assert(!pending_.empty());
+
+    auto first = popPending();
+
+    const auto max_bytes = grpc_.owner_.config().cluster_sync_batch_max_bytes;
+    if (!accept_batches_ || !max_bytes || pending_.empty()
+        || !canBatch(*first) || !canBatch(*pending_.front())) {
+        return first;
+    }
+
+    // The updates are shared by all the followers, so we copy
+    // the transactions to a new update.
+    auto batch = make_shared<grpc::nsblast::pb::SyncUpdate>();
+    size_t bytes = first->trx().ByteSizeLong();
+    batch->add_trxs()->CopyFrom(first->trx());
+    batch->set_isinsync(first->isinsync());
+
+    while(!pending_.empty() && canBatch(*pending_.front())) {
+        const auto& next = *pending_.front();
+        const auto size = next.trx().ByteSizeLong();
+        if (bytes + size > max_bytes) {
+            break;
+        }
+
+        bytes += size;
+        batch->add_trxs()->CopyFrom(next.trx());
+        batch->set_isinsync(next.isinsync());
+        popPending();
+    }
+
+    LOG_TRACE_N << "Client " << uuid() << " sending a batch of " << batch->trxs_size()
+                << " transactions (" << bytes << " bytes).";
+    return batch;
+}
+
+GrpcPrimary::update_t GrpcPrimary::SyncClient::popPending()
+{
+    auto update = std::move(pending_.front());
+    pending_.pop();
+    if (canBatch(*update)) {
+        const auto size = update->trx().ByteSizeLong();
+        pending_batch_bytes_ -= std::min<size_t>(size, pending_batch_bytes_);
+    }
+    return update;
+}
+
+bool GrpcPrimary::SyncClient::waitForMore()
+{
+    const auto delay = grpc_.owner_.config().cluster_sync_batch_max_delay;
+    if (!accept_batches_ || !delay || batch_delay_expired_) {
+        return false;
+    }
+
+    // Send right away if we already have enough for a full batch.
+    const auto max_bytes = grpc_.owner_.config().cluster_sync_batch_max_bytes;
+    if (max_bytes && pending_batch_bytes_ >= max_bytes) {
+        if (batch_timer_active_) {
+            batch_timer_active_ = false;
+            batch_timer_.cancel();
+        }
+        return false;
+    }
+
+    if (batch_timer_active_) {
+        return true;
+    }
+
+    // Updates that was queued while we were writing have already waited,
+    // so we only delay the first update after the stream has been idle.
+    if (!is_idle_) {
+        return false;
+    }
+
+    batch_timer_active_ = true;
+    batch_timer_.expires_from_now(boost::posix_time::milliseconds{delay});
+    batch_timer_.async_wait([w=weak_from_this()](const auto ec) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+
+        if (auto self = w.lock()) {
+            lock_guard lock{self->mutex_};
+            self->batch_timer_active_ = false;
+            self->batch_delay_expired_ = true;
+            if (!self->is_done_) {
+                self->flush();
+            }
+        }
+    });
+
+    return true;
+}
+
 GrpcPrimary::bidi_sync_stream_t *GrpcPrimary::NsblastSvcImpl::Sync(
     grpc::CallbackServerContext *context)
 {
     LOG_TRACE_N << "Was called from peer: " << context->peer();
 
-    auto client_hash = context->client_metadata().find("auth-hash");
-    auto client_seed = context->client_metadata().find("auth-seed");
+    if (!isAuthorized(*context)) {
+        return {};
+    }
 
-    if (client_hash == context->client_metadata().end()) {
-        LOG_WARN_N << "Connection from peer " << context->peer()
+    return grpc_.createSyncClient(context);
+}
+
+grpc::ServerWriteReactor<grpc::nsblast::pb::BootstrapChunk> *
+GrpcPrimary::NsblastSvcImpl::Bootstrap(grpc::CallbackServerContext *context,
+                                       const grpc::nsblast::pb::BootstrapRequest */*request*/)
+{
+    LOG_TRACE_N << "Was called from peer: " << context->peer();
+
+    // Deletes itself in OnDone()
+    auto *sender = new BootstrapSender(grpc_, *context);
+
+    if (!isAuthorized(*context)) {
+        sender->Finish({::grpc::StatusCode::UNAUTHENTICATED, "Access denied"});
+    } else {
+        sender->start();
+    }
+
+    return sender;
+}
+
+bool GrpcPrimary::NsblastSvcImpl::isAuthorized(grpc::CallbackServerContext &context) const
+{
+    auto client_hash = context.client_metadata().find("auth-hash");
+    auto client_seed = context.client_metadata().find("auth-seed");
+
+    if (client_hash == context.client_metadata().end()) {
+        LOG_WARN_N << "Connection from peer " << context.peer()
                    << " denied because the client did not send a auth-hash value";
-        return {};
+        return false;
     }
 
-    if (client_seed == context->client_metadata().end()) {
-        LOG_WARN_N << "Connection from peer " << context->peer()
+    if (client_seed == context.client_metadata().end()) {
+        LOG_WARN_N << "Connection from peer " << context.peer()
                    << " denied because the client did not send a auth-seed value";
-        return {};
+        return false;
     }
 
     HashedKey my_hash;
@@ -229,22 +438,128 @@ GrpcPrimary::bidi_sync_stream_t *GrpcPrimary::NsblastSvcImpl::Sync(
             string{client_seed->second.begin(), client_seed->second.end()});
 
     } catch (const exception& ex) {
-        LOG_ERROR_N << "Connection from peer " << context->peer()
+        LOG_ERROR_N << "Connection from peer " << context.peer()
                     << " denied because I failed to compute the auth-hash value: "
                     << ex.what();
-        return {};
+        return false;
     }
 
     if (string_view{my_hash.hash}
         != string_view{client_hash->second.data(), client_hash->second.size()}) {
-        LOG_WARN_N << "Connection from peer " << context->peer()
+        LOG_WARN_N << "Connection from peer " << context.peer()
                    << " denied because the client did not provide a correct hashed auth-key value";
-        return {};
+        return false;
     }
 
+    return true;
+}
 
-    return grpc_.createSyncClient(context);
+GrpcPrimary::BootstrapSender::BootstrapSender(GrpcPrimary &grpc, grpc::CallbackServerContext &context)
+    : grpc_{grpc}
+{
+    LOG_INFO_N << "Bootstrap " << uuid_ << " requested by peer " << context.peer();
+
+    dir_ = grpc_.owner_.config().db_path;
+    dir_ /= "bootstrap";
+    dir_ /= boost::uuids::to_string(uuid_);
 }
 
+void GrpcPrimary::BootstrapSender::OnDone()
+{
+    LOG_DEBUG_N << "Bootstrap " << uuid_ << " is done.";
+
+    file_.close();
+    std::error_code ec;
+    filesystem::remove_all(dir_, ec);
+    if (ec) {
+        LOG_WARN_N << "Failed to delete " << dir_ << ": " << ec.message();
+    }
+
+    delete this;
+}
+
+void GrpcPrimary::BootstrapSender::OnWriteDone(bool ok)
+{
+    if (!ok) [[unlikely]] {
+        LOG_DEBUG_N << "Bootstrap " << uuid_ << " - write failed.";
+        Finish({::grpc::StatusCode::UNAVAILABLE, "Write failed"});
+        return;
+    }
+
+    next();
+}
+
+void GrpcPrimary::BootstrapSender::start()
+{
+    // Exporting the database may take a while. Don't block gRPC's thread.
+    boost::asio::post(grpc_.owner_.ctx(), [this] {
+        try {
+            snapshot_ = grpc_.owner_.db().exportSnapshot(dir_);
+        } catch (const exception& ex) {
+            LOG_ERROR_N << "Bootstrap " << uuid_ << " - Failed to export the database: " << ex.what();
+            Finish({::grpc::StatusCode::INTERNAL, "Failed to export the database"});
+            return;
+        }
+
+        next();
+    });
+}
+
+void GrpcPrimary::BootstrapSender::next()
+{
+    static constexpr size_t chunk_size = 1024 * 1024;
+
+    chunk_.Clear();
+
+    const bool send_header = !sent_header_;
+    if (send_header) {
+        chunk_.set_trxid(snapshot_.trxId);
+        chunk_.set_lasttrx(snapshot_.lastTrx);
+        sent_header_ = true;
+    }
+
+    if (current_file_ < snapshot_.files.size()) {
+        const auto& [category, path] = snapshot_.files[current_file_];
+        if (!file_.is_open()) {
+            file_.open(path, ios::in | ios::binary);
+            if (!file_.is_open()) {
+                LOG_ERROR_N << "Bootstrap " << uuid_ << " - Failed to open " << path;
+                Finish({::grpc::StatusCode::INTERNAL, "Failed to read the database snapshot"});
+                return;
+            }
+        }
+
+        string buffer(chunk_size, 0);
+        file_.read(buffer.data(), buffer.size());
+        buffer.resize(file_.gcount());
+
+        chunk_.set_columnfamilyix(ResourceIf::toInt(category));
+        chunk_.set_filename(path.filename().string());
+        chunk_.set_data(std::move(buffer));
+
+        if (file_.eof()) {
+            chunk_.set_endoffile(true);
+            file_.close();
+            ++current_file_;
+        } else if (!file_) {
+            LOG_ERROR_N << "Bootstrap " << uuid_ << " - Failed to read " << path;
+            Finish({::grpc::StatusCode::INTERNAL, "Failed to read the database snapshot"});
+            return;
+        }
+
+        StartWrite(&chunk_);
+        return;
+    }
+
+    if (send_header) {
+        // Empty database. We still need to tell the follower the trx-id.
+        StartWrite(&chunk_);
+        return;
+    }
+
+    LOG_INFO_N << "Bootstrap " << uuid_ << " - Sent " << snapshot_.files.size()
+               << " files at trx #" << snapshot_.trxId;
+    Finish(::grpc::Status::OK);
+}
 
 } //ns
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <filesystem>
+#include <fstream>
 #include <queue>
 
+#include <boost/asio/deadline_timer.hpp>
 #include <grpcpp/server.h>
 
 #include "nsblast/Server.h"
 #include "nsblast/util.h"
+#include "RocksDbResource.h"
 #include "proto_util.h"
 #include "proto/nsblast-grpc.grpc.pb.h"
 
@@ -105,6 +109,31 @@ public:
          */
         void flush();
 
+        /*! Get the next update to send.
+         *
+         *  If the follower accepts batches, consecutive queued
+         *  transactions are combined into one update.
+         *
+         *  Expects the lock to be held, and the queue to be non-empty.
+         */
+        update_t nextUpdate();
+
+        /*! Pop the first update in the queue
+         *
+         *  Expects the lock to be held, and the queue to be non-empty.
+         */
+        update_t popPending();
+
+        /*! Start the timer to wait for more transactions to batch, if configured
+         *
+         *  We only wait when the stream is idle and the queue holds less than
+         *  `cluster_sync_batch_max_bytes` of transactions.
+         *  Expects the lock to be held.
+         *
+         *  \return true if we are waiting.
+         */
+        bool waitForMore();
+
         const boost::uuids::uuid uuid_ = newUuid();
         GrpcPrimary& grpc_;
         bool is_done_ = false;
@@ -113,6 +142,16 @@ public:
         // since the last write operation was initiated.
         bool has_written_after_empty_queue_ = true;
 
+        bool accept_batches_ = false;
+        bool compress_ = false;
+        bool batch_timer_active_ = false;
+        bool batch_delay_expired_ = false;
+        // True when nothing has been written since the queue was empty
+        bool is_idle_ = true;
+        // Bytes of the queued transactions that can be batched
+        size_t pending_batch_bytes_ = 0;
+        boost::asio::deadline_timer batch_timer_;
+
         ::grpc::nsblast::pb::SyncRequest req_;
         std::queue<update_t> pending_;
         update_t current_;
@@ -121,6 +160,40 @@ public:
         mutable std::mutex mutex_;
     };
 
+    /*! Streams a snapshot of the database to a new follower
+     *
+     *  The snapshot is exported to SST files in a temporary directory,
+     *  and the files are sent in chunks. The directory is deleted when
+     *  the RPC is done.
+     */
+    class BootstrapSender
+        : public ::grpc::ServerWriteReactor<::grpc::nsblast::pb::BootstrapChunk> {
+    public:
+        BootstrapSender(GrpcPrimary& grpc, ::grpc::CallbackServerContext& context);
+
+        /*! Export the snapshot in a worker-thread and start sending it */
+        void start();
+
+    private:
+        /*! Callback event when the RPC is complete */
+        void OnDone() override;
+
+        /*! Callback event when a write operation is complete */
+        void OnWriteDone(bool ok) override;
+
+        /*! Send the next chunk, or finish the RPC if all the files are sent */
+        void next();
+
+        const boost::uuids::uuid uuid_ = newUuid();
+        GrpcPrimary& grpc_;
+        std::filesystem::path dir_;
+        RocksDbResource::Snapshot snapshot_;
+        size_t current_file_ = 0;
+        bool sent_header_ = false;
+        std::ifstream file_;
+        ::grpc::nsblast::pb::BootstrapChunk chunk_;
+    };
+
     class NsblastSvcImpl: public grpc::nsblast::pb::NsblastSvc::CallbackService {
     public:
         NsblastSvcImpl(GrpcPrimary& grpc)
@@ -131,6 +204,13 @@ public:
         bidi_sync_stream_t* Sync(
             ::grpc::CallbackServerContext* context) override;
 
+        ::grpc::ServerWriteReactor<::grpc::nsblast::pb::BootstrapChunk>* Bootstrap(
+            ::grpc::CallbackServerContext* context,
+            const ::grpc::nsblast::pb::BootstrapRequest* request) override;
+
+        /*! Validate the auth-hash sent by the peer */
+        bool isAuthorized(::grpc::CallbackServerContext& context) const;
+
         GrpcPrimary& grpc_;
     };
 
@@ -144,19 +224,42 @@ public:
 
     bidi_sync_stream_t *createSyncClient(::grpc::CallbackServerContext* context);
 
+    /*! Get a compressed version of the update, if the compression pays off
+     *
+     *  The updates from the replication agents are shared by all the followers.
+     *  The result is cached for as long as the update exists, so that each
+     *  update is only compressed once.
+     *
+     *  \return The compressed update, or `update` if it was not compressed.
+     */
+    update_t compress(const update_t& update);
+
     const auto& authKey() const {
         return auth_key_;
     }
 
 private:
+    struct CompressedUpdate {
+        std::weak_ptr<grpc::nsblast::pb::SyncUpdate> source;
+        update_t compressed; // Empty if the compression don't pay off
+    };
+
     void init();
 
+    /*! Compress the update
+     *
+     *  \return The compressed update, or nullptr if the compression don't pay off
+     */
+    update_t compressUpdate(const grpc::nsblast::pb::SyncUpdate& update);
+
     Server& owner_;
     std::map<boost::uuids::uuid, std::shared_ptr<SyncClient>> clients_;
     std::unique_ptr<NsblastSvcImpl> impl_;
     std::unique_ptr<grpc::Server> svc_;
     const HashedKey auth_key_;
     std::mutex mutex_;
+    std::map<const grpc::nsblast::pb::SyncUpdate *, CompressedUpdate> compressed_;
+    std::mutex compressed_mutex_;
 };
 
 } // ns
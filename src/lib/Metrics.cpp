@@ -1,5 +1,9 @@
+#include "rocksdb/perf_context.h"
+#include "rocksdb/perf_level.h"
+
 #include "Metrics.h"
 #include "nsblast/Server.h"
+#include "nsblast/ResourceIf.h"
 
 #include "nsblast/logging.h"
 #include "nsblast/util.h"
@@ -47,6 +51,8 @@ Metrics::Metrics(Server& server)
     dns_requests_not_implemented_ = metrics_.AddCounter("nsblast_dns_requests", "Number of DNS requests that failed because the query type is not implemented", {}, {{"result", "not_implemented"}});
     dns_requests_error_ = metrics_.AddCounter("nsblast_dns_requests", "Number of DNS requests that failed with an error", {}, {{"result", "error"}});
     dns_responses_ok_ = metrics_.AddCounter("nsblast_dns_responses", "Number of successful DNS responses", {}, {{"result", "ok"}});
+    dns_answer_cache_hits_ = metrics_.AddCounter("nsblast_dns_answer_cache", "Number of DNS requests answered from the answer cache", {}, {{"result", "hit"}});
+    dns_answer_cache_misses_ = metrics_.AddCounter("nsblast_dns_answer_cache", "Number of cacheable DNS requests not found in the answer cache", {}, {{"result", "miss"}});
     truncated_dns_responses_ = metrics_.AddCounter("nsblast_truncated_dns_responses", "Number of DNS requests that was truncated", {});
     current_dns_requests_ = metrics_.AddGauge("nsblast_current_dns_requests", "Number of DNS requests currently being processed", {}, {{"state", "current"}});
     asio_worker_threads_ = metrics_.AddGauge("nsblast_worker_threads", "Number of worker threads", {}, {{"kind", "asio"}});
@@ -59,6 +65,48 @@ Metrics::Metrics(Server& server)
     backup_state_ = metrics_.AddStateset<2>("nsblast_backup_state", "Backup state", {}, {}, {"idle", "running"});
     backup_state_->setExclusiveState(BackupState::IDLE);
 
+    if (server.config().rocksdb_statistics) {
+        rocksdb_.block_cache_hits = metrics_.AddGauge("nsblast_rocksdb_block_cache", "RocksDB block cache lookups", {}, {{"result", "hit"}});
+        rocksdb_.block_cache_misses = metrics_.AddGauge("nsblast_rocksdb_block_cache", "RocksDB block cache lookups", {}, {{"result", "miss"}});
+        rocksdb_.bloom_useful = metrics_.AddGauge("nsblast_rocksdb_bloom_filter", "RocksDB lookups where the bloom filter avoided a read", {}, {{"result", "useful"}});
+        rocksdb_.bloom_full_positive = metrics_.AddGauge("nsblast_rocksdb_bloom_filter", "RocksDB lookups where the bloom filter could not avoid a read", {}, {{"result", "full_positive"}});
+        rocksdb_.bloom_full_true_positive = metrics_.AddGauge("nsblast_rocksdb_bloom_filter", "RocksDB lookups where the bloom filter could not avoid a read, and the key existed", {}, {{"result", "full_true_positive"}});
+        rocksdb_.bloom_prefix_useful = metrics_.AddGauge("nsblast_rocksdb_bloom_filter", "RocksDB seeks where the prefix bloom filter avoided a read", {}, {{"result", "prefix_useful"}});
+        rocksdb_.memtable_hits = metrics_.AddGauge("nsblast_rocksdb_memtable", "RocksDB memtable lookups", {}, {{"result", "hit"}});
+        rocksdb_.memtable_misses = metrics_.AddGauge("nsblast_rocksdb_memtable", "RocksDB memtable lookups", {}, {{"result", "miss"}});
+        rocksdb_.compaction_read_bytes = metrics_.AddGauge("nsblast_rocksdb_compaction_bytes", "Bytes processed by RocksDB compactions", {}, {{"op", "read"}});
+        rocksdb_.compaction_write_bytes = metrics_.AddGauge("nsblast_rocksdb_compaction_bytes", "Bytes processed by RocksDB compactions", {}, {{"op", "write"}});
+        rocksdb_.stall_micros = metrics_.AddGauge("nsblast_rocksdb_stall_micros", "Microseconds RocksDB has stalled writes", {});
+    }
+
+    for(size_t i = 0; i < rocksdb_.sst_files_size.size(); ++i) {
+        const auto cf = toName(static_cast<ResourceIf::Category>(i));
+        rocksdb_.sst_files_size[i] = metrics_.AddGauge("nsblast_rocksdb_sst_files_size", "Size of the SST files in a RocksDB column family", {}, {{"cf", string{cf}}});
+    }
+
+    if (server.config().rocksdb_rate_limit) {
+        rocksdb_.rate_limit = metrics_.AddGauge("nsblast_rocksdb_rate_limit", "Current RocksDB rate limit for flush and compaction, in bytes per second", {});
+        // Flushes are requested at IO_HIGH and compactions at IO_LOW
+        for(const auto& [pri, name] : {pair{rocksdb::Env::IO_LOW, "low"}, pair{rocksdb::Env::IO_HIGH, "high"}}) {
+            rocksdb_.rate_limiter_bytes.at(pri) = metrics_.AddGauge("nsblast_rocksdb_rate_limiter_bytes", "Bytes that passed through the RocksDB rate limiter", {}, {{"priority", name}});
+            rocksdb_.rate_limiter_requests.at(pri) = metrics_.AddGauge("nsblast_rocksdb_rate_limiter_requests", "Requests to the RocksDB rate limiter", {}, {{"priority", name}});
+        }
+    }
+
+    if (server.config().metrics_dns_perf_sample_rate) {
+        dns_perf_block_reads_ = metrics_.AddSummary("nsblast_rocksdb_dns_perf", "Blocks read from SST files per sampled DNS request", {}, {{"kind", "block_reads"}}, {{0.5, 0.9, 0.95, 0.99}});
+        dns_perf_block_cache_hits_ = metrics_.AddSummary("nsblast_rocksdb_dns_perf", "Block cache hits per sampled DNS request", {}, {{"kind", "block_cache_hits"}}, {{0.5, 0.9, 0.95, 0.99}});
+        dns_perf_get_time_ = metrics_.AddSummary("nsblast_rocksdb_dns_perf_get_time", "Time spent in memtable and SST lookups per sampled DNS request", {}, {}, {{0.5, 0.9, 0.95, 0.99}});
+    }
+
+    if (server.config().cluster_role != "none" && server.config().cluster_sync_compression != "none") {
+        const string stage = server.config().cluster_role == "primary" ? "compress" : "decompress";
+        sync_compression_.uncompressed_bytes = metrics_.AddCounter("nsblast_cluster_sync_compression_bytes", "Bytes in replication updates, before compression and after decompression", {}, {{"stage", stage}, {"size", "uncompressed"}});
+        sync_compression_.compressed_bytes = metrics_.AddCounter("nsblast_cluster_sync_compression_bytes", "Bytes in compressed replication updates", {}, {{"stage", stage}, {"size", "compressed"}});
+        sync_compression_.ratio = metrics_.AddSummary("nsblast_cluster_sync_compression_ratio", "Compressed size / uncompressed size for replication updates", {}, {{"stage", stage}}, {{0.5, 0.9, 0.95, 0.99}});
+        sync_compression_.duration = metrics_.AddSummary("nsblast_cluster_sync_compression_duration", "Seconds spent compressing or decompressing replication updates", {}, {{"stage", stage}}, {{0.5, 0.9, 0.95, 0.99}});
+    }
+
     if (server.isCluster()) {
         if (server.isPrimaryReplicationServer()) {
             cluster_replication_followers_ = metrics_.AddGauge("nsblast_cluster_replication", "Number of followers connected to us", {});
@@ -71,5 +119,44 @@ Metrics::Metrics(Server& server)
     logfault::LogManager::Instance().AddHandler(std::make_unique<LogHandler>(logfault::LogLevel::WARN, warnings_));
 }
 
+Metrics::PerfContextSample::PerfContextSample(Metrics &metrics, unsigned sampleRate)
+{
+    if (!sampleRate || !metrics.dns_perf_block_reads_) {
+        return;
+    }
+
+    thread_local unsigned counter = 0;
+    if (++counter % sampleRate) {
+        return;
+    }
+
+    metrics_ = &metrics;
+    prev_level_ = rocksdb::GetPerfLevel();
+    if (prev_level_ < rocksdb::PerfLevel::kEnableTimeExceptForMutex) {
+        rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTimeExceptForMutex);
+    }
+
+    const auto *pc = rocksdb::get_perf_context();
+    block_reads_ = pc->block_read_count;
+    block_cache_hits_ = pc->block_cache_hit_count;
+    get_time_ = pc->get_from_memtable_time + pc->get_from_output_files_time;
+}
+
+Metrics::PerfContextSample::~PerfContextSample()
+{
+    if (!metrics_) {
+        return;
+    }
+
+    const auto *pc = rocksdb::get_perf_context();
+    const auto get_time = pc->get_from_memtable_time + pc->get_from_output_files_time;
+    metrics_->dns_perf_block_reads().observe(static_cast<double>(pc->block_read_count - block_reads_));
+    metrics_->dns_perf_block_cache_hits().observe(static_cast<double>(pc->block_cache_hit_count - block_cache_hits_));
+    metrics_->dns_perf_get_time().observe(static_cast<double>(get_time - get_time_) / 1000000000.0);
+
+    if (rocksdb::GetPerfLevel() != prev_level_) {
+        rocksdb::SetPerfLevel(prev_level_);
+    }
+}
 
 } // ns nsblast::lib
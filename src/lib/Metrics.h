@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
 #include <cassert>
 
+#include "rocksdb/env.h"
+#include "rocksdb/perf_level.h"
 #include "yahat/Metrics.h"
 
 namespace nsblast {
@@ -21,6 +24,66 @@ public:
     using summary_t = yahat::Metrics::Summary<double>;
     using summary_scoped = yahat::Metrics::ScopedTimer<summary_t, double>;
 
+    /*! Metrics we get from RocksDB's statistics and properties.
+     *
+     *  They are gauges, as the values are copied from RocksDB
+     *  periodically by RocksDbResource::updateMetrics().
+     */
+    struct RocksDb {
+        gauge_t *block_cache_hits{};
+        gauge_t *block_cache_misses{};
+        gauge_t *bloom_useful{};
+        gauge_t *bloom_full_positive{};
+        gauge_t *bloom_full_true_positive{};
+        gauge_t *bloom_prefix_useful{};
+        gauge_t *memtable_hits{};
+        gauge_t *memtable_misses{};
+        gauge_t *compaction_read_bytes{};
+        gauge_t *compaction_write_bytes{};
+        gauge_t *stall_micros{};
+        std::array<gauge_t *, 6> sst_files_size{}; // Indexed by ResourceIf::Category
+        gauge_t *rate_limit{};
+        std::array<gauge_t *, rocksdb::Env::IO_TOTAL> rate_limiter_bytes{}; // Indexed by Env::IOPriority
+        std::array<gauge_t *, rocksdb::Env::IO_TOTAL> rate_limiter_requests{}; // Indexed by Env::IOPriority
+    };
+
+    /*! Compression of the replication stream.
+     *
+     *  On the primary, the values are for compression. On a follower,
+     *  they are for decompression.
+     */
+    struct SyncCompression {
+        counter_t *uncompressed_bytes{};
+        counter_t *compressed_bytes{};
+        summary_t *ratio{}; // Compressed size / uncompressed size
+        summary_t *duration{}; // Seconds spent compressing or decompressing
+    };
+
+    /*! Samples RocksDB's PerfContext for the calling thread while in scope.
+     *
+     *  Only one in `sampleRate` instances (per thread) collects the
+     *  values. The others does nothing.
+     *
+     *  The thread's perf level is restored when the sample goes out of
+     *  scope, and the PerfContext is not reset, so the sample don't
+     *  interfere with other users of the PerfContext.
+     */
+    class PerfContextSample {
+    public:
+        PerfContextSample(Metrics& metrics, unsigned sampleRate);
+        ~PerfContextSample();
+
+        PerfContextSample(const PerfContextSample&) = delete;
+        PerfContextSample& operator = (const PerfContextSample&) = delete;
+
+    private:
+        Metrics *metrics_{}; // nullptr if this instance don't sample
+        rocksdb::PerfLevel prev_level_ = rocksdb::PerfLevel::kDisable;
+        uint64_t block_reads_ = 0;
+        uint64_t block_cache_hits_ = 0;
+        uint64_t get_time_ = 0;
+    };
+
     Metrics(Server& server);
 
     yahat::Metrics& metrics() {
@@ -64,6 +127,14 @@ public:
         return *dns_responses_ok_;
     }
 
+    counter_t& dns_answer_cache_hits() {
+        return *dns_answer_cache_hits_;
+    }
+
+    counter_t& dns_answer_cache_misses() {
+        return *dns_answer_cache_misses_;
+    }
+
     gauge_t& cluster_replication_followers() {
         assert(cluster_replication_followers_);
         return *cluster_replication_followers_;
@@ -102,6 +173,26 @@ public:
         return *request_latency_ok_;
     }
 
+    RocksDb& rocksdb() noexcept {
+        return rocksdb_;
+    }
+
+    SyncCompression& sync_compression() noexcept {
+        return sync_compression_;
+    }
+
+    summary_t& dns_perf_block_reads() {
+        return *dns_perf_block_reads_;
+    }
+
+    summary_t& dns_perf_block_cache_hits() {
+        return *dns_perf_block_cache_hits_;
+    }
+
+    summary_t& dns_perf_get_time() {
+        return *dns_perf_get_time_;
+    }
+
     enum class BackupState{
         IDLE,
         RUNNING
@@ -124,6 +215,8 @@ private:
     counter_t * truncated_dns_responses_{};
     counter_t * dns_requests_error_{}; // Potentially probes for vulnerabilities
     counter_t * dns_responses_ok_{};
+    counter_t * dns_answer_cache_hits_{};
+    counter_t * dns_answer_cache_misses_{};
     gauge_t * cluster_replication_followers_{}; // Only for primary
     gauge_t * cluster_replication_primaries_{}; // Only for followers
     gauge_t * current_dns_requests_{};
@@ -134,6 +227,11 @@ private:
     summary_t * backup_duration_{}; // Duration of backups in seconds
     summary_t * request_latency_ok_{}; // Latency of requests in seconds
     yahat::Metrics::Stateset<2> * backup_state_{};
+    RocksDb rocksdb_;
+    SyncCompression sync_compression_;
+    summary_t * dns_perf_block_reads_{}; // Blocks read from the SST files in sampled DNS requests
+    summary_t * dns_perf_block_cache_hits_{}; // Block cache hits in sampled DNS requests
+    summary_t * dns_perf_get_time_{}; // Time in seconds in memtable and SST lookups in sampled DNS requests
 };
 
 
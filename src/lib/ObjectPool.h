@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace nsblast::lib {
+
+/*! Default policy for ObjectPool. All released objects are re-used. */
+struct RecycleAlways {
+    template <typename T>
+    bool operator()(const T&) const noexcept {
+        return true;
+    }
+};
+
+/*! Per-thread pool of objects that are passed around in std::shared_ptr's
+ *
+ *  The shared_ptr's returned by get() give the object back to the pool
+ *  when the last reference is released. The pool keeps at most maxFree
+ *  free objects. Buffers owned by the object keep their capacity, unless
+ *  the Recycle policy returns false for the object. Then it is deleted.
+ *
+ *  The objects can be released from any thread, but they are only
+ *  handed out again by the thread that created them.
+ *
+ *  The pool does not reset the objects. That is up to the caller.
+ */
+template <typename T, size_t maxFree = 8, typename Recycle = RecycleAlways>
+class ObjectPool {
+public:
+    /*! Get an object from the calling threads pool */
+    static std::shared_ptr<T> get() {
+        // Shared with the deleters, as objects may be released after the thread is gone
+        thread_local const auto pool = std::make_shared<ObjectPool>();
+        return pool->acquire(pool);
+    }
+
+    ObjectPool() {
+        free_.reserve(maxFree);
+    }
+
+private:
+    std::shared_ptr<T> acquire(const std::shared_ptr<ObjectPool>& self) {
+        std::unique_ptr<T> item;
+        {
+            std::lock_guard lock{mutex_};
+            if (!free_.empty()) {
+                item = std::move(free_.back());
+                free_.pop_back();
+            }
+        }
+
+        if (!item) {
+            item = std::make_unique<T>();
+        }
+
+        return {item.release(), [self](T *released) {
+            self->release(std::unique_ptr<T>{released});
+        }};
+    }
+
+    void release(std::unique_ptr<T> item) {
+        if (!Recycle{}(*item)) {
+            return;
+        }
+
+        std::lock_guard lock{mutex_};
+        if (free_.size() < maxFree) {
+            free_.push_back(std::move(item));
+        }
+    }
+
+    std::vector<std::unique_ptr<T>> free_;
+    std::mutex mutex_;
+};
+
+} // ns
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "PrimaryReplication.h"
 
 #include "nsblast/logging.h"
@@ -21,11 +23,13 @@ operator<<(ostream &out,
 namespace nsblast::lib {
 
 PrimaryReplication::PrimaryReplication(Server &server)
-    : server_{server}, waiter_{server.ctx(),
-              [](uint64_t current, uint64_t constraint) {
-                  return current <= constraint;
-              }}
+    : server_{server}, waiter_{server.ctx(), isReplicated}
+{
+}
+
+bool PrimaryReplication::isReplicated(uint64_t current, uint64_t constraint)
 {
+    return current <= constraint;
 }
 
 void PrimaryReplication::start()
@@ -38,6 +42,66 @@ void PrimaryReplication::checkAgents()
     if (auto trxid = getMinTrxIdForAllAgents()) {
         waiter_.onChange(minTrxIdForAllStreamingAgents_);
     }
+
+    updateQuorumWaiters();
+}
+
+PrimaryReplication::repl_waiter_t &PrimaryReplication::waiter(size_t quorum)
+{
+    if (!quorum) {
+        return waiter_;
+    }
+
+    {
+        lock_guard lock{mutex_};
+        if (auto it = quorum_waiters_.find(quorum); it != quorum_waiters_.end()) {
+            return *it->second.waiter;
+        }
+
+        LOG_DEBUG << "PrimaryReplication::waiter - Adding a waiter for a quorum of " << quorum;
+        quorum_waiters_[quorum].waiter = make_unique<repl_waiter_t>(server_.ctx(), isReplicated);
+    }
+
+    // Give the new waiter the current state
+    updateQuorumWaiters();
+
+    lock_guard lock{mutex_};
+    return *quorum_waiters_.at(quorum).waiter;
+}
+
+void PrimaryReplication::updateQuorumWaiters()
+{
+    vector<pair<repl_waiter_t *, uint64_t>> changes;
+
+    {
+        lock_guard lock{mutex_};
+        if (quorum_waiters_.empty()) {
+            return;
+        }
+
+        vector<uint64_t> confirmed;
+        confirmed.reserve(follower_agents_.size());
+        for(const auto& [_, agent] : follower_agents_) {
+            if (agent->isStreaming()) {
+                confirmed.push_back(agent->lastConfirmedTrx());
+            }
+        }
+
+        // Highest first, so that confirmed[n - 1] is confirmed by at least n followers
+        ranges::sort(confirmed, greater{});
+
+        for(auto& [quorum, w] : quorum_waiters_) {
+            if (quorum <= confirmed.size() && confirmed[quorum - 1] > w.trxid) {
+                w.trxid = confirmed[quorum - 1];
+                changes.emplace_back(w.waiter.get(), w.trxid);
+            }
+        }
+    }
+
+    // The waiters are never deleted, so the pointers are still valid
+    for(auto [waiter, trxid] : changes) {
+        waiter->onChange(trxid);
+    }
 }
 
 GrpcPrimary::ReplicationInterface *PrimaryReplication::addAgent(
@@ -84,7 +148,7 @@ void PrimaryReplication::onTransaction(transaction_t && transaction)
 
 void PrimaryReplication::startTimer()
 {
-    timer_.expires_from_now(boost::posix_time::seconds{server_.config().cluster_replication_housekeeping_timer_});
+    timer_.expires_from_now(boost::posix_time::milliseconds{server_.config().cluster_replication_housekeeping_timer_});
     timer_.async_wait([this](const auto ec) {
         if (ec) {
             if (ec == boost::asio::error::operation_aborted) {
@@ -107,14 +171,24 @@ void PrimaryReplication::startTimer()
 
 void PrimaryReplication::housekeeping()
 {
-    std::lock_guard lock{mutex_};
+    optional<uint64_t> confirmed;
+    {
+        std::lock_guard lock{mutex_};
 
-    LOG_TRACE << "PrimaryReplication::housekeeping() - "
-              "Deleting zombie agents where the RPC request/stream is done with.";
-    erase_if(follower_agents_, [](auto& item) {
-        return item.second->expired();
-    });
+        LOG_TRACE << "PrimaryReplication::housekeeping() - "
+                  "Deleting zombie agents where the RPC request/stream is done with.";
+        erase_if(follower_agents_, [](auto& item) {
+            return item.second->expired();
+        });
+
+        for(const auto& [_, agent] : follower_agents_) {
+            if (!agent->isDone()) {
+                confirmed = min(agent->lastConfirmedTrx(), confirmed.value_or(agent->lastConfirmedTrx()));
+            }
+        }
+    }
 
+    server_.db().pruneTrxLog(confirmed);
 }
 
 uint64_t PrimaryReplication::getMinTrxIdForAllAgents()
@@ -152,18 +226,46 @@ PrimaryReplication::Agent::Agent(PrimaryReplication& parent,
 
 void PrimaryReplication::Agent::iterateDb()
 {
+    auto need_bootstrap = [this](uint64_t first) {
+        LOG_WARN << *this << " iterateDb - The follower needs transaction #"
+                 << (last_enqueued_trxid_ + 1)
+                 << ", but the oldest transaction in the transaction-log is #"
+                 << first << ". The follower must be bootstrapped again.";
+
+        if (auto client = client_.lock()) {
+            auto update = make_shared<grpc::nsblast::pb::SyncUpdate>();
+            update->set_isinsync(false);
+            update->set_needbootstrap(true);
+            update->set_firstretainedtrxid(first);
+            client->enqueue(std::move(update));
+        }
+
+        setState(State::DONE);
+    };
+
+    if (const auto first = parent_.server().db().firstRetainedTrxId();
+        last_enqueued_trxid_ + 1 < first) {
+        need_bootstrap(first);
+        return;
+    }
+
     auto trx = parent_.server().db().dbTransaction();
 
     const ResourceIf::RealKey key{last_enqueued_trxid_, ResourceIf::RealKey::Class::TRXID};
     bool queue_was_filled = false;
+    optional<uint64_t> hole_at;
 
-    auto fn = [this, &queue_was_filled](ResourceIf::TransactionIf::key_t key, span_t value) mutable {
+    auto fn = [this, &queue_was_filled, &hole_at](ResourceIf::TransactionIf::key_t key, span_t value) mutable {
         auto update = make_shared<grpc::nsblast::pb::SyncUpdate>();
         update->set_isinsync(false); // We are iterating, so not in sync (streaming).
         auto mtrx = update->mutable_trx();
         if (!mtrx->ParseFromArray(value.data(), value.size())) [[unlikely]] {
             LOG_ERROR << *this << " iterateDb - Failed to deserialize the transaction "
                       << "for " << key;
+        } else if (mtrx->id() != last_enqueued_trxid_ + 1) [[unlikely]] {
+            // The transactions we need may have been pruned after we checked
+            // firstRetainedTrxId() above, but before the iterator was created.
+            hole_at = mtrx->id();
         } else if (auto client = client_.lock()) {
             // enqueue will return false if the queue is full
             const auto trx_id = mtrx->id();
@@ -180,6 +282,11 @@ void PrimaryReplication::Agent::iterateDb()
 
     trx->iterateFromPrevT(key, ResourceIf::Category::TRXLOG, std::move(fn));
 
+    if (hole_at) {
+        need_bootstrap(*hole_at);
+        return;
+    }
+
     if (!queue_was_filled) {
         LOG_TRACE << *this
                   << " The queue was not filled while iterating the stored transactions."
@@ -224,6 +331,10 @@ void PrimaryReplication::Agent::onTrxId(uint64_t trxId)
 {
     {
         lock_guard lock{mutex_};
+        if (!last_enqueued_trxid_ && state_ == State::ITERATING_DB) {
+            // The first request. Start after the last transaction the follower has.
+            last_enqueued_trxid_ = trxId;
+        }
         last_confirmed_trx_ = trxId;
         syncLater();
     }
@@ -149,11 +149,25 @@ public:
         return waiter_;
     }
 
+    /*! Get a waiter that is signaled when `quorum` followers have confirmed a trx-id
+     *
+     *  \param quorum Number of streaming followers that must confirm the
+     *         transaction. 0 means all of them, and returns waiter().
+     */
+    repl_waiter_t& waiter(size_t quorum);
+
     void checkAgents();
 
 private:
+    struct QuorumWaiter {
+        std::unique_ptr<repl_waiter_t> waiter;
+        uint64_t trxid = 0; // The highest trx-id confirmed by `quorum` followers
+    };
+
     void startTimer();
     void housekeeping();
+    void updateQuorumWaiters();
+    static bool isReplicated(uint64_t current, uint64_t constraint);
 
     // Returns 0 if there are no changes or no agents.
     uint64_t getMinTrxIdForAllAgents();
@@ -163,6 +177,7 @@ private:
     uint64_t minTrxIdForAllStreamingAgents_ = 0;
     uint64_t last_trxid_ = 0;
     std::map<boost::uuids::uuid, std::shared_ptr<Agent>> follower_agents_;
+    std::map<size_t, QuorumWaiter> quorum_waiters_;
     boost::asio::deadline_timer timer_{server_.ctx()};
     mutable std::mutex mutex_;
 };
@@ -86,7 +86,8 @@ bool ResourceIf::RealKey::isReversed(Class kclass) noexcept
 {
     return kclass == Class::ENTRY
            || kclass == Class::DIFF
-           || kclass == Class::ZONE;
+           || kclass == Class::ZONE
+           || kclass == Class::DIFF_INDEX;
 }
 
 ResourceIf::RealKey::Class ResourceIf::RealKey::kClass() const noexcept {
@@ -257,9 +258,9 @@ string_view toName(const ResourceIf::Category &cat)
 
 string_view toName(const ResourceIf::RealKey::Class &kclass)
 {
-    static constexpr array<string_view, 10> names = { "ENTRY", "DIFF", "TENANT", "USER",
+    static constexpr array<string_view, 11> names = { "ENTRY", "DIFF", "TENANT", "USER",
                                                     "ROLE", "ZONE", "TZONE", "TRXID", "ZRR",
-                                                    "TENANT_NAME"  };
+                                                    "TENANT_NAME", "DIFF_INDEX"  };
 
     return names.at(static_cast<size_t>(kclass));
 }
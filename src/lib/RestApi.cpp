@@ -2,6 +2,7 @@
 #include <set>
 #include <ranges>
 #include <algorithm>
+#include <charconv>
 
 #include <boost/json/src.hpp>
 #include <boost/unordered/unordered_flat_map.hpp>
@@ -222,14 +223,15 @@ void createDiffSequence(StorageBuilder& sb,
 }
 
 // Create and add a complete diff transaction for a normal update (one serial increment).
-void addDiff(string_view zoneName,
+// Returns the size of the stored diff.
+size_t addDiff(string_view zoneName,
              const RrSoa& oldSoa,
              const RrSoa& newSoa,
              const Entry& oldContent,
              const Entry& newContent,
              ResourceIf::TransactionIf& trx) {
 
-    assert(newSoa.serial() > oldSoa.serial());
+    assert(isSerialBefore(oldSoa.serial(), newSoa.serial()));
 
     LOG_TRACE << "addDiff: Creating diff for zone: " << zoneName;
 
@@ -259,6 +261,93 @@ void addDiff(string_view zoneName,
                   << " I will oevrwrite the existing data.";
     }
     trx.write(key, sb.buffer(), false, ResourceIf::Category::DIFF);
+    return sb.buffer().size();
+}
+
+// Get the serials and sizes of the diff's for a zone, from the oldest to the newest.
+// For zones that have diff's from before we kept the index, it's built from the diff's.
+pb::DiffIndex getDiffIndex(string_view zoneName, ResourceIf::TransactionIf& trx) {
+    pb::DiffIndex index;
+    string buffer;
+    if (trx.read({zoneName, key_class_t::DIFF_INDEX}, buffer, ResourceIf::Category::DIFF, false)) {
+        if (index.ParseFromString(buffer)) {
+            return index;
+        }
+        LOG_WARN << "getDiffIndex: Failed to parse the diff index for zone: "
+                 << zoneName << ". Rebuilding it.";
+        index.Clear();
+    }
+
+    const ResourceIf::RealKey first{zoneName, 0, key_class_t::DIFF};
+    trx.iterate(first, [&](auto key, auto value) {
+        if (!first.isSameFqdn(key)) {
+            return false;
+        }
+        auto diff = index.add_diffs();
+        diff->set_serial(get32bValueAt(key.bytes(), key.size() - sizeof(uint32_t)));
+        diff->set_size(value.size());
+        return true;
+    }, ResourceIf::Category::DIFF);
+
+    // The keys are sorted by the serial as an unsigned number. The serial may have
+    // wrapped around (RFC 1982), so we use the distance back from the newest serial.
+    if (!index.diffs().empty()) {
+        auto& diffs = *index.mutable_diffs();
+        const auto newest = max_element(diffs.begin(), diffs.end(), [](const auto& left, const auto& right) {
+            return isSerialBefore(left.serial(), right.serial());
+        })->serial();
+        sort(diffs.begin(), diffs.end(), [newest](const auto& left, const auto& right) {
+            return static_cast<uint32_t>(newest - left.serial())
+                   > static_cast<uint32_t>(newest - right.serial());
+        });
+    }
+
+    return index;
+}
+
+// Add a new diff to the zone's diff index, and delete the oldest diff's
+// that are outside the configured window. The newest diff is always kept.
+void pruneDiffs(string_view zoneName, uint32_t serial, size_t size,
+                const Config& config, ResourceIf::TransactionIf& trx) {
+    const auto max_diffs = config.dns_ixfr_max_diffs;
+    const auto max_bytes = config.dns_ixfr_max_diff_bytes;
+
+    auto index = getDiffIndex(zoneName, trx);
+    auto& diffs = *index.mutable_diffs();
+
+    // If the diff was overwritten, it's no longer at its old position.
+    if (auto it = find_if(diffs.begin(), diffs.end(), [serial](const auto& diff) {
+            return diff.serial() == serial;
+        }); it != diffs.end()) {
+        diffs.erase(it);
+    }
+
+    auto added = index.add_diffs();
+    added->set_serial(serial);
+    added->set_size(size);
+
+    size_t keep = 0;
+    size_t bytes = 0;
+    for(auto it = diffs.rbegin(); it != diffs.rend(); ++it) {
+        bytes += it->size();
+        if (keep && ((max_diffs && keep >= max_diffs) || (max_bytes && bytes > max_bytes))) {
+            break;
+        }
+        ++keep;
+    }
+
+    const auto remove = diffs.size() - static_cast<int>(keep);
+    if (remove) {
+        LOG_TRACE << "pruneDiffs: Deleting " << remove << " old diff's for zone: " << zoneName;
+        for(int i = 0; i < remove; ++i) {
+            const ResourceIf::RealKey key{zoneName, diffs.at(i).serial(), key_class_t::DIFF};
+            trx.remove(key, false, ResourceIf::Category::DIFF);
+        }
+        diffs.DeleteSubrange(0, remove);
+    }
+
+    const auto value = index.SerializeAsString();
+    trx.write({zoneName, key_class_t::DIFF_INDEX}, value, false, ResourceIf::Category::DIFF);
 }
 
 tuple<std::optional<Response>, shared_ptr<Session>, optional<pb::Tenant>, bool /*all */>
@@ -469,57 +558,81 @@ Response RestApi::onReqest(const Request &req)
 {
     const auto p = parse(req);
 
-    try {
-        if (p.what == "rr") {
-            return onResourceRecord(req, p);
-        }
+    // A bulk import commits in batches, so it can't simply be re-run.
+    const bool can_retry = req.type != Request::Type::GET
+                           && !(p.what == "zone" && p.operation == "import");
 
-        if (p.what == "zone") {
-            if (req.type == Request::Type::GET) {
-                if (!p.operation.empty()) {
-                    return {400, "Invalid operation"};
-                }
-                if (p.target.empty()) {
-                    return listZones(req, p);
-                }
-                return listZone(req, p);
+    for(unsigned attempt = 0;; ++attempt) {
+        try {
+            return route(req, p);
+        } catch(const ConflictException& ex) {
+            if (can_retry && attempt < config_.rest_write_retries) {
+                LOG_DEBUG << "RestApi::onReqest: Request " << req.uuid
+                          << " conflicted with another transaction. Retrying ("
+                          << (attempt + 1) << '/' << config_.rest_write_retries << ").";
+                continue;
             }
-            return onZone(req, p);
+            LOG_DEBUG << "RestApi::onReqest: Request " << req.uuid
+                      << " conflicted with another transaction. Giving up: " << ex.what();
+            return {ex.httpError(), ex.httpMessage()};
+        } catch(const nsblast::Exception& ex) {
+            LOG_DEBUG << "RestApi::onReqest: Cautht exception while processing request "
+                  << req.uuid << ": " << ex.what();
+            return {ex.httpError(), ex.httpMessage()};
         }
+    }
+}
 
-        if (p.what == "tenant") {
-            return onTenant(req, p);
-        }
+Response RestApi::route(const Request &req, const Parsed& p)
+{
+    if (p.what == "rr") {
+        return onResourceRecord(req, p);
+    }
 
-        if (p.what == "user") {
-            return onUser(req, p);
+    if (p.what == "zone") {
+        if (p.operation == "import") {
+            return onZoneImport(req, p);
         }
-
-        if (p.what == "role") {
-            return onRole(req, p);
+        if (req.type == Request::Type::GET) {
+            if (!p.operation.empty()) {
+                return {400, "Invalid operation"};
+            }
+            if (p.target.empty()) {
+                return listZones(req, p);
+            }
+            return listZone(req, p);
         }
+        return onZone(req, p);
+    }
 
-        if (p.what == "permissions") {
-            return onPermissions(req, p);
-        }
+    if (p.what == "tenant") {
+        return onTenant(req, p);
+    }
 
-        if (p.what == "config") {
-            if (p.operation == "master") {
-                return onConfigMaster(req, p);
-            }
-        }
+    if (p.what == "user") {
+        return onUser(req, p);
+    }
 
-        if (p.what == "backup") {
-            return onBackup(req, p);
-        }
+    if (p.what == "role") {
+        return onRole(req, p);
+    }
+
+    if (p.what == "permissions") {
+        return onPermissions(req, p);
+    }
 
-        if (p.what == "version") {
-            return onVersion(req, p);
+    if (p.what == "config") {
+        if (p.operation == "master") {
+            return onConfigMaster(req, p);
         }
-    } catch(const nsblast::Exception& ex) {
-        LOG_DEBUG << "RestApi::onReqest: Cautht exception while processing request "
-              << req.uuid << ": " << ex.what();
-        return {ex.httpError(), ex.httpMessage()};
+    }
+
+    if (p.what == "backup") {
+        return onBackup(req, p);
+    }
+
+    if (p.what == "version") {
+        return onVersion(req, p);
     }
 
     LOG_DEBUG << "Unknown subpath: " << p.what;
@@ -1453,6 +1566,7 @@ Response RestApi::onZone(const Request &req, const RestApi::Parsed &parsed)
     if (res) {
         return *res;
     }
+    const auto quorum = getQuorum(req);
     auto trx = resource_.transaction();
     auto lowercaseFqdn = toLower(parsed.target);
     auto exists = trx->zoneExists(lowercaseFqdn);
@@ -1510,7 +1624,7 @@ Response RestApi::onZone(const Request &req, const RestApi::Parsed &parsed)
             return {404, "The zone don't exist"};
         }
         try {
-            trx->remove({lowercaseFqdn, key_class_t::ENTRY}, true);
+            trx->dropZone(lowercaseFqdn);
         } catch(const NotFoundException&) {
             return {404, "The zone don't exist"};
         }
@@ -1524,13 +1638,250 @@ Response RestApi::onZone(const Request &req, const RestApi::Parsed &parsed)
     trx->commit();
     const auto repl_id = trx->replicationId();
 
-    if (auto waited = waitForReplication(req, repl_id)) {
+    if (auto waited = waitForReplication(req, repl_id, quorum)) {
         return makeReplyWithReplStatus(200, *waited);
     }
 
     return {rcode, "OK"};
 }
 
+Response RestApi::onZoneImport(const Request &req, const Parsed &parsed)
+{
+    // The body is NDJSON; one json object per line, with the same format as
+    // the payload for the 'rr' endpoint, and the fqdn for the entry in "fqdn".
+    // Each line replaces the entry for that fqdn. All the lines are validated
+    // before anything is written. The entries are then written in large
+    // batches, each committed and replicated as one transaction.
+    // The zones serial is incremented once, when all the entries are written.
+    // No diff's are created, so IXFR requests for older versions of the zone
+    // falls back to AXFR.
+
+    auto [res, session, tenant, all] = getSessionAndTenant(req, server());
+    if (res) {
+        return *res;
+    }
+
+    if (req.type != Request::Type::POST) {
+        return {405, "Only POST is valid for 'zone/{fqdn}/import'"};
+    }
+
+    const auto lowercaseZone = toLower(parsed.target);
+    if (!session->isAllowed(pb::Permission::UPDATE_ZONE, lowercaseZone)) {
+        return {403, "Access Denied"};
+    }
+
+    const auto quorum = getQuorum(req);
+    auto trx = resource_.transaction();
+    trx->setBulkMode();
+
+    size_t zone_len = 0;
+    optional<boost::uuids::uuid> tenant_id;
+    {
+        const auto zone = trx->lookup(lowercaseZone);
+        if (zone.empty() || !zone.flags().soa) {
+            return {404, "The zone don't exist"};
+        }
+
+        tenant_id = zone.tenantId();
+        if (!tenant_id) {
+            LOG_WARN_N << "Unable to establish what tenant who owns zone " << lowercaseZone;
+            return {500, "Unable to establish what tenant who owns this zone"};
+        }
+        if (*tenant_id != session->tenantId()) {
+            LOG_DEBUG_N << *session << " tried to import into zone "
+                        << lowercaseZone
+                        << " owned by tenant " << *tenant_id;
+            return {403, "Not your zone!"};
+        }
+
+        zone_len = zone.begin()->labels().size() - 1;
+    }
+
+    const auto batch_size = max<size_t>(config_.rest_import_batch_size, 1);
+    size_t entries = 0;
+    size_t batches = 0;
+    size_t in_batch = 0;
+    uint64_t repl_id = 0;
+
+    auto commitBatch = [&](bool more) {
+        trx->commit();
+        if (const auto id = trx->replicationId()) {
+            repl_id = id;
+        }
+        ++batches;
+        LOG_TRACE_N << "Committed batch #" << batches << " with " << in_batch
+                    << " entries for zone " << lowercaseZone;
+        in_batch = 0;
+        trx.reset();
+        if (more) {
+            trx = resource_.transaction();
+            trx->setBulkMode();
+        }
+    };
+
+    // Increment the serial in the current transaction and remove the zones
+    // diff's, as they can no longer be used to build a complete IXFR.
+    auto finishZone = [&]() -> uint32_t {
+        const auto zone = trx->lookup(lowercaseZone);
+        if (zone.empty() || !zone.flags().soa) {
+            throw Response{409, "The zone was deleted during the import"};
+        }
+
+        StorageBuilder sb;
+        sb.setTenantId(zone.tenantId());
+        const auto zone_fqdn = labelsToFqdnKey(zone.begin()->labels());
+        for(const auto& rr : zone) {
+            sb.createRr(zone_fqdn, rr.type(), rr.ttl(), rr.rdata());
+        }
+        sb.incrementSoaVersion(zone);
+        sb.finish();
+        trx->write({lowercaseZone, key_class_t::ENTRY}, sb.buffer(), false);
+
+        if (config_.dns_enable_ixfr) {
+            const ResourceIf::RealKey dkey{lowercaseZone, 0, key_class_t::DIFF};
+            vector<string> diffs;
+            trx->iterate(dkey, [&](auto key, auto /*value*/) {
+                if (!dkey.isSameFqdn(key)) {
+                    return false;
+                }
+                diffs.emplace_back(key.bytes());
+                return true;
+            }, ResourceIf::Category::DIFF);
+
+            for(const auto& key : diffs) {
+                trx->remove(ResourceIf::RealKey::Binary{key}, false, ResourceIf::Category::DIFF);
+            }
+            trx->remove({lowercaseZone, key_class_t::DIFF_INDEX}, false, ResourceIf::Category::DIFF);
+        }
+
+        return sb.soa()->serial();
+    };
+
+    // Validate the entire body before we commit anything, so that an
+    // error on some line don't leave the zone partially imported.
+    map<string, string> imported; // lowercase fqdn, entry
+    string_view body = req.body;
+    size_t line_no = 0;
+    while(!body.empty()) {
+        ++line_no;
+        auto line = body.substr(0, body.find('\n'));
+        body = body.substr(min(line.size() + 1, body.size()));
+        trim(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        auto json = parseJson(line);
+        if (!json.is_object()) {
+            throw Response{400, format("Line {}: Expected a json object", line_no)};
+        }
+
+        auto& obj = json.as_object();
+        const auto jfqdn = obj.if_contains("fqdn");
+        if (!jfqdn || !jfqdn->is_string()) {
+            throw Response{400, format("Line {}: Missing 'fqdn'", line_no)};
+        }
+        const string fqdn{jfqdn->as_string()};
+        auto lowercaseFqdn = toLower(fqdn);
+        obj.erase("fqdn");
+
+        if (lowercaseFqdn.size() <= lowercaseZone.size()
+            || !lowercaseFqdn.ends_with(lowercaseZone)
+            || lowercaseFqdn[lowercaseFqdn.size() - lowercaseZone.size() - 1] != '.') {
+            throw Response{400, format("Line {}: {} is not below the zone {}", line_no, fqdn, lowercaseZone)};
+        }
+
+        if (obj.contains("soa")) {
+            throw Response{400, format("Line {}: soa is only valid for the zone itself", line_no)};
+        }
+
+        // The name may be in (or be the apex of) a child zone hosted here,
+        // possibly owned by another tenant.
+        const auto existing = trx->lookupEntryAndSoa(lowercaseFqdn);
+        if (!existing.hasSoa()
+            || toLower(existing.soa().begin()->labels().string()) != lowercaseZone) {
+            throw Response{400, format("Line {}: {} is not in the zone {}", line_no, fqdn, lowercaseZone)};
+        }
+
+        if (!session->isAllowed(existing.hasRr() ? pb::Permission::UPDATE_RR : pb::Permission::CREATE_RR,
+                                lowercaseFqdn)) {
+            throw Response{403, format("Line {}: Access Denied for {}", line_no, fqdn)};
+        }
+
+        StorageBuilder sb;
+        sb.setTenantId(*tenant_id);
+        sb.setZoneLen(zone_len);
+        build(fqdn, config_.default_ttl, sb, json);
+        imported[std::move(lowercaseFqdn)] = string{sb.buffer().data(), sb.buffer().size()};
+    }
+
+    // Lines for the same fqdn replace each other
+    entries = imported.size();
+
+    // The SRV targets may be entries in the import
+    for(const auto& [lowercaseFqdn, entry] : imported) {
+        checkSrv(entry, *trx, &imported);
+    }
+
+    try {
+        for(const auto& [lowercaseFqdn, entry] : imported) {
+            trx->write({lowercaseFqdn, key_class_t::ENTRY}, entry, false);
+            server().auth().updateZoneRrIx(*trx, lowercaseFqdn, zone_len, true);
+
+            if (++in_batch >= batch_size) {
+                commitBatch(true);
+            }
+        }
+    } catch(...) {
+        LOG_DEBUG_N << "Import into zone " << lowercaseZone << " failed after "
+                    << batches << " committed batches.";
+        if (batches) {
+            // Some of the data is already committed. Let the world know.
+            try {
+                trx = resource_.transaction();
+                finishZone();
+                trx->commit();
+            } catch(...) {
+                LOG_WARN_N << "Failed to increment the serial for zone " << lowercaseZone
+                           << " after a failed import.";
+            }
+        }
+        throw;
+    }
+
+    const auto serial = finishZone();
+    commitBatch(false);
+
+    LOG_INFO_N << "Imported " << entries << " entries in " << batches
+               << " batches into zone " << lowercaseZone
+               << ". The serial is now " << serial;
+
+    if (config_.dns_enable_notify) {
+        try {
+            server_->notifications().notify(lowercaseZone);
+        } catch(const exception& ex) {
+            LOG_WARN_N << "Failed to notify slave servers about update of zone "
+                       << lowercaseZone << ": " << ex.what();
+        }
+    }
+
+    if (auto waited = waitForReplication(req, repl_id, quorum)) {
+        return makeReplyWithReplStatus(200, *waited);
+    }
+
+    boost::json::object json;
+    json["rcode"] = 200;
+    json["error"] = false;
+    json["message"] = "";
+    json["value"] = {
+        {"entries", entries},
+        {"batches", batches},
+        {"serial", serial}
+    };
+
+    return {200, "OK", boost::json::serialize(json)};
+}
+
 Response RestApi::onResourceRecord(const Request &req, const RestApi::Parsed &parsed)
 {
     auto [res, session, tenant, all] = getSessionAndTenant(req, server());
@@ -1538,6 +1889,7 @@ Response RestApi::onResourceRecord(const Request &req, const RestApi::Parsed &pa
         return *res;
     }
 
+    const auto quorum = getQuorum(req);
     StorageBuilder sb;
     auto trx = resource_.transaction();
     const auto lowercaseFqdn = toLower(parsed.target);
@@ -1807,8 +2159,9 @@ put:
             lowercaseSoaFqdn = toLower(existing.soa().begin()->labels().string());
         }
         assert(newSoa.has_value());
-        assert(newSoa->serial() > oldSoa.serial());
-        addDiff(lowercaseSoaFqdn, oldSoa, newSoa.value(), oldData, newData, *trx);
+        assert(isSerialBefore(oldSoa.serial(), newSoa->serial()));
+        const auto size = addDiff(lowercaseSoaFqdn, oldSoa, newSoa.value(), oldData, newData, *trx);
+        pruneDiffs(lowercaseSoaFqdn, newSoa->serial(), size, config_, *trx);
     }
 
     if (need_to_update_zrr) {
@@ -1837,7 +2190,7 @@ put:
         rcode = 201;
     }
 
-    if (auto waited = waitForReplication(req, repl_id)) {
+    if (auto waited = waitForReplication(req, repl_id, quorum)) {
         return makeReplyWithReplStatus(rcode, *waited);
     }
 
@@ -1926,7 +2279,8 @@ Response RestApi::onVersion(const yahat::Request &req, const Parsed &parsed)
     return {200, "OK", boost::json::serialize(json)};
 }
 
-void RestApi::checkSrv(span_t span, ResourceIf::TransactionIf& trx)
+void RestApi::checkSrv(span_t span, ResourceIf::TransactionIf& trx,
+                       const std::map<std::string, std::string> *pending)
 {
     if (!config_.dns_validate_srv_targets_locally) {
         return;
@@ -1942,17 +2296,33 @@ void RestApi::checkSrv(span_t span, ResourceIf::TransactionIf& trx)
         }
     }
 
+    const auto has_address_rr = [](const Entry& entry) {
+        for(const auto& rr : entry) {
+            const auto type = rr.type();
+            if (type == TYPE_A || type == TYPE_AAAA) {
+                return true;
+            }
+        }
+        return false;
+    };
+
     for (const auto& target : targets) {
-        auto e = trx.lookup(target);
         bool found_adress_rr = false;
-        for(const auto& err : e) {
-            const auto type = err.type();
-            if (type == TYPE_A || type == TYPE_AAAA) {
-                found_adress_rr = true;
-                break;
+        if (pending) {
+            if (auto it = pending->find(target); it != pending->end()) {
+                found_adress_rr = has_address_rr(Entry{it->second});
+                if (!found_adress_rr) {
+                    LOG_DEBUG << "RestApi::checkSrv target " << target
+                              << " is not pointing to a fqdn with A or AAAA records in the import.";
+                    throw Response{400, "SRV records' targets must point to an existing fqdn with address record(s)"};
+                }
+                continue;
             }
         }
-\
+
+        auto e = trx.lookup(target);
+        found_adress_rr = has_address_rr(e);
+
         LOG_DEBUG << "RestApi::checkSrv target " << target
                   << " in Srv for " << (e.empty() ? "*** NOT FOUND ***"s : e.begin()->labels().string())
                   << " is not pointing to a fqdn with A or AAAA records on this server.";
@@ -2306,7 +2676,24 @@ bool RestApi::getAppend(const yahat::Request &req) const
     return false;
 }
 
-std::optional<bool> RestApi::waitForReplication(const yahat::Request &req, uint64_t trxid)
+size_t RestApi::getQuorum(const yahat::Request &req) const
+{
+    static constexpr size_t max_quorum = 255;
+
+    if (const auto value = getQueryArg(req, "quorum")) {
+        const auto *end = value->data() + value->size();
+        size_t quorum = 0;
+        const auto [ptr, ec] = from_chars(value->data(), end, quorum);
+        if (ec != errc{} || ptr != end || quorum < 1 || quorum > max_quorum) {
+            throw Response{400, format("quorum must be between 1 and {}", max_quorum)};
+        }
+        return quorum;
+    }
+
+    return 0; // All the followers
+}
+
+std::optional<bool> RestApi::waitForReplication(const yahat::Request &req, uint64_t trxid, size_t quorum)
 {
     if (auto it = req.arguments.find("wait"); it != req.arguments.end()) {
         if (auto seconds = std::stoi(string{it->second})) {
@@ -2315,9 +2702,13 @@ std::optional<bool> RestApi::waitForReplication(const yahat::Request &req, uint6
                 return false;
             }
 
-            LOG_TRACE_N << "Waiting for replication up to " << seconds << " seconds...";
+            // The wait suspends the coroutine for the request. The HTTP worker-thread
+            // is free to serve other requests until the waiter resumes us.
+            LOG_TRACE_N << "Waiting for replication to "
+                        << (quorum ? to_string(quorum) : "all"s)
+                        << " followers up to " << seconds << " seconds...";
             boost::system::error_code ec;
-            server().primaryReplication().waiter().wait(
+            server().primaryReplication().waiter(quorum).wait(
                 trxid, chrono::seconds{seconds}, (*req.yield)[ec]);
             LOG_TRACE_N << "Done waiting for replication. wait status: " << ec;
             return !ec.failed();
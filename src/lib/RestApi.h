@@ -1,5 +1,7 @@
 #pragma once
 
+#include <map>
+
 #include <boost/json.hpp>
 
 #include "nsblast/nsblast.h"
@@ -42,17 +44,26 @@ public:
     yahat::Response onPermissions(const yahat::Request &req, const Parsed& parsed);
     yahat::Response onUser(const yahat::Request &req, const Parsed& parsed);
     yahat::Response onZone(const yahat::Request &req, const Parsed& parsed);
+    yahat::Response onZoneImport(const yahat::Request &req, const Parsed& parsed);
     yahat::Response onResourceRecord(const yahat::Request &req, const Parsed& parsed);
     yahat::Response onConfigMaster(const yahat::Request &req, const Parsed& parsed);
     yahat::Response onBackup(const yahat::Request &req, const Parsed& parsed);
     yahat::Response onVersion(const yahat::Request &req, const Parsed& parsed);
-    void checkSrv(span_t span, ResourceIf::TransactionIf& trx);
+    /*! Check that the SRV targets in the entry have address records
+     *
+     *  \param pending Entries that are about to be written, and replace the
+     *      entries with the same fqdn in the database.
+     *  \throws Response 400 if a target don't have address records
+     */
+    void checkSrv(span_t span, ResourceIf::TransactionIf& trx,
+                  const std::map<std::string, std::string> *pending = {});
     bool hasAccess(const yahat::Request& req, pb::Permission) const noexcept;
     bool hasAccess(const yahat::Request& req, std::string_view lowercaseFqdn, pb::Permission) const noexcept;
     yahat::Response listTenants(const yahat::Request &req, const Parsed& parsed);
     yahat::Response listZones(const yahat::Request &req, const Parsed& parsed);
     yahat::Response listZone(const yahat::Request &req, const Parsed& parsed);
 private:
+    yahat::Response route(const yahat::Request &req, const Parsed& parsed);
     size_t getPageSize(const yahat::Request &req) const;
     std::string_view getFrom(const yahat::Request &req) const;
     // Forward is true, backwards is false
@@ -69,9 +80,14 @@ private:
         return *server_;
     }
 
+    // The `quorum` argument, 0 if it's not set. Throws a 400 Response if it's invalid.
+    // Must be called before the transaction is committed.
+    size_t getQuorum(const yahat::Request &req) const;
+
     // Returns false if there was a probem with the replication, including
-    // timeout.
-    std::optional<bool> waitForReplication(const yahat::Request &req, uint64_t trxid);
+    // timeout. If quorum is set, only that number of followers
+    // must confirm the transaction.
+    std::optional<bool> waitForReplication(const yahat::Request &req, uint64_t trxid, size_t quorum);
     yahat::Response startBackup(const yahat::Request &req, const Parsed& parsed);
     yahat::Response verifyBackup(const yahat::Request &req, const Parsed& parsed);
     yahat::Response listBackups(const yahat::Request &req, const Parsed& parsed);
@@ -1,7 +1,17 @@
 
+#include <algorithm>
 #include <chrono>
 
+#include <unistd.h>
+
+#include "rocksdb/cache.h"
 #include "rocksdb/db.h"
+#include "rocksdb/filter_policy.h"
+#include "rocksdb/rate_limiter.h"
+#include "rocksdb/slice_transform.h"
+#include "rocksdb/sst_file_writer.h"
+#include "rocksdb/statistics.h"
+#include "rocksdb/table.h"
 
 #include "RocksDbResource.h"
 #include "nsblast/logging.h"
@@ -20,6 +30,10 @@ using ROCKSDB_NAMESPACE::PinnableSlice;
 using ROCKSDB_NAMESPACE::ReadOptions;
 using ROCKSDB_NAMESPACE::Slice;
 //using ROCKSDB_NAMESPACE::Transaction;
+using ROCKSDB_NAMESPACE::OccValidationPolicy;
+using ROCKSDB_NAMESPACE::OptimisticTransactionDB;
+using ROCKSDB_NAMESPACE::OptimisticTransactionDBOptions;
+using ROCKSDB_NAMESPACE::OptimisticTransactionOptions;
 using ROCKSDB_NAMESPACE::TransactionDB;
 using ROCKSDB_NAMESPACE::TransactionDBOptions;
 
@@ -28,6 +42,31 @@ namespace nsblast::lib {
 
 namespace {
 
+/*! Prefix extractor for keys in the DIFF column family.
+ *
+ *  The key is the class, the reversed fqdn, a 0 byte and the serial
+ *  as a 32 bit integer. The prefix is the key without the serial,
+ *  so that all the diff's for a zone share the same prefix.
+ *  The DIFF_INDEX keys in the same column family are not in the domain.
+ */
+class DiffPrefixTransform : public rocksdb::SliceTransform {
+public:
+    const char *Name() const override {
+        return "nsblast.DiffPrefix";
+    }
+
+    rocksdb::Slice Transform(const rocksdb::Slice& key) const override {
+        assert(InDomain(key));
+        return {key.data(), key.size() - sizeof(uint32_t)};
+    }
+
+    bool InDomain(const rocksdb::Slice& key) const override {
+        // class + at least one byte fqdn + 0 + serial
+        return key.size() >= 2 + 1 + sizeof(uint32_t)
+               && key[0] == static_cast<char>(ResourceIf::RealKey::Class::DIFF);
+    }
+};
+
 
 class DbLogger : public rocksdb::Logger {
 public:
@@ -103,7 +142,8 @@ DbLogger &dbLogger() {
 }
 
 template <typename T = rocksdb::BackupEngine>
-[[nodiscard]] auto getBackupEngine(const std::filesystem::path &backupDir, std::mutex& mutex) {
+[[nodiscard]] auto getBackupEngine(const std::filesystem::path &backupDir, std::mutex& mutex,
+                                   uint64_t rateLimit = 0) {
     using namespace rocksdb;
 
     unique_lock lock(mutex, try_to_lock);
@@ -114,6 +154,7 @@ template <typename T = rocksdb::BackupEngine>
 
     BackupEngineOptions opts{backupDir.string(),
                              nullptr, true, &dbLogger()};
+    opts.backup_rate_limit = rateLimit;
     T* backup_engine = {};
 
     auto status = T::Open(opts, Env::Default(), &backup_engine);
@@ -126,52 +167,35 @@ template <typename T = rocksdb::BackupEngine>
     return make_pair(makeSharedFrom(backup_engine), std::move(lock)); // RAAI object for backup_engine
 }
 
-
-} // anon ns
-
-RocksDbResource::Transaction::Transaction(RocksDbResource &owner)
-    : owner_{owner}
+template <typename T>
+ResourceIf::TransactionIf::RrAndSoa lookupEntryAndSoaT(T& trx, string_view fqdn, const ZoneIndex *index)
 {
-    LOG_TRACE << "Beginning transaction " << uuid();
-    assert(!trx_);
-
-    trx_.reset(owner.db().BeginTransaction({}));
-
-    if (!trx_) {
-        LOG_ERROR << "Failed to start transaction " << uuid();
-        throw InternalErrorException{"Failed to start transaction", "Database error/transaction"};
-    }
-
-    // Nice to have the same name in rocksdb logs
-    trx_->SetName(boost::uuids::to_string(uuid()));
-    ++owner_.transaction_count_;
-}
+    if (index) {
+        // Find the zone in memory, so we only need to read the rr and the soa.
+        const auto match = index->findClosest(fqdn);
+        if (match.zone.empty()) {
+            LOG_TRACE << "lookupEntryAndSoa: Not found in the zone index";
+            return {};
+        }
 
-RocksDbResource::Transaction::~Transaction()
-{
-    LOG_TRACE << "Ending " << (trx_ ? "actual" : "closed/failed")  << " transaction " << uuid();
-    if (trx_) {
-        try {
-            rollback_();
-        }  catch (const runtime_error& ex) {
-            LOG_WARN << "RocksDbResource::Transaction::~Transaction - Caught exception from rollback(): "
-                     << ex.what();
+        if (match.zone.size() == fqdn.size()) {
+            if (auto e = trx.lookup(fqdn); e && e.flags().soa) {
+                return {std::move(e)};
+            }
+        } else if (auto soa = trx.lookup(match.zone); soa && soa.flags().soa) {
+            return {trx.lookup(fqdn), std::move(soa)};
         }
 
-        trx_.reset();
-        --owner_.transaction_count_;
+        // The index was not in sync with the database. Use the slow path.
+        LOG_TRACE << "lookupEntryAndSoa: Stale zone index for " << match.zone;
     }
-}
 
-ResourceIf::TransactionIf::RrAndSoa
-RocksDbResource::Transaction::lookupEntryAndSoa(string_view fqdn)
-{
-    EntryWithBuffer rr;
+    ResourceIf::TransactionIf::EntryWithBuffer rr;
     string_view key = fqdn;
     bool first = true;
     while(!key.empty()) {
         LOG_TRACE << "lookupEntryAndSoa: key=" << key;
-        if (auto e = lookup(key)) {
+        if (auto e = trx.lookup(key)) {
             if (e.flags().soa) {
                 if (first) {
                     // This is an exact match. RR and Soa is the same
@@ -209,12 +233,200 @@ RocksDbResource::Transaction::lookupEntryAndSoa(string_view fqdn)
     return {}; // Not found
 }
 
+template <typename T>
+bool existsT(T& trx, string_view fqdn, uint16_t type)
+{
+    try {
+        auto b = trx.read(ResourceIf::RealKey{fqdn, key_class_t::ENTRY});
+        Entry entry{b->data()};
+
+        if (type == TYPE_SOA) {
+            return entry.flags().soa;
+        }
+
+        for(auto it : entry) {
+            if (it.type() == type) {
+                return true;
+            }
+        }
+
+    }  catch (const NotFoundException&) {
+        ;
+    }
+
+    return false;
+}
+
+/*! Iterate over the apex and the children of a zone
+ *
+ *  \param newIterator Functor that creates an iterator over the entry
+ *         column family with (options).
+ */
+template <typename fnT>
+void iterateZoneT(ResourceIf::TransactionIf::key_t zoneKey, ReadOptions options,
+                  size_t readahead, fnT newIterator,
+                  const ResourceIf::TransactionIf::iterator_fn_t& fn)
+{
+    using RealKey = ResourceIf::RealKey;
+
+    const Slice apex{zoneKey.data(), zoneKey.size()};
+
+    // The reversed names of the children all starts with the
+    // reversed zone-name and a dot.
+    string children{zoneKey.bytes()}, upper{zoneKey.bytes()};
+    children.push_back('.');
+    upper.push_back('/'); // '.' + 1
+    const Slice upper_bound{upper};
+
+    // A zone transfer reads the zone once. Don't let it push the
+    // hot data for the DNS server out of the block cache.
+    options.iterate_upper_bound = &upper_bound;
+    options.fill_cache = false;
+    options.readahead_size = readahead;
+
+    auto it = newIterator(options);
+    it->Seek(apex);
+    if (it->Valid() && it->key() == apex) {
+        if (!fn({RealKey::Binary{it->key()}}, it->value())) {
+            return;
+        }
+    }
+
+    const Slice prefix{children};
+    for(it->Seek(prefix); it->Valid(); it->Next()) {
+        const auto k = it->key();
+        if (!k.starts_with(prefix)) {
+            break;
+        }
+
+        // Skip names with an escaped dot right after the zone-name
+        if (k.size() > prefix.size() && k[prefix.size()] == '\\') {
+            continue;
+        }
+
+        if (!fn({RealKey::Binary{k}}, it->value())) {
+            return;
+        }
+    }
+}
+
+/*! Look up a batch of entries with a single MultiGet call
+ *
+ *  \param multiGet Functor that calls MultiGet on the relevant
+ *         rocksdb object with (numKeys, keys, values, statuses).
+ */
+template <typename fnT>
+vector<ResourceIf::TransactionIf::EntryWithBuffer>
+lookupBatchT(const vector<string_view>& fqdns, uint64_t trxId, fnT multiGet)
+{
+    using BufferImpl = RocksDbResource::Transaction::BufferImpl;
+
+    vector<ResourceIf::TransactionIf::EntryWithBuffer> entries;
+    if (fqdns.empty()) {
+        return entries;
+    }
+
+    vector<ResourceIf::RealKey> keys;
+    keys.reserve(fqdns.size());
+    vector<Slice> slices;
+    slices.reserve(fqdns.size());
+    for(const auto fqdn : fqdns) {
+        const auto& key = keys.emplace_back(fqdn, key_class_t::ENTRY);
+        slices.emplace_back(key.data(), key.size());
+    }
+
+    vector<PinnableSlice> values(fqdns.size());
+    vector<rocksdb::Status> statuses(fqdns.size());
+
+    multiGet(slices.size(), slices.data(), values.data(), statuses.data());
+
+    entries.reserve(fqdns.size());
+    for(size_t i = 0; i < statuses.size(); ++i) {
+        const auto& status = statuses[i];
+        if (status.ok()) {
+            auto buffer = make_unique<BufferImpl>();
+            buffer->ps_ = std::move(values[i]);
+            buffer->prepare();
+            entries.emplace_back(std::move(buffer));
+            continue;
+        }
+
+        if (status.IsNotFound()) {
+            entries.emplace_back();
+            continue;
+        }
+
+        LOG_WARN << "RocksDbResource::lookupBatch - Read from transaction "
+                 << trxId << " key: " << keys[i]
+                 << " failed with status: " << status.ToString();
+
+        throw InternalErrorException{status.ToString(), "Database error"};
+    }
+
+    return entries;
+}
+
+} // anon ns
+
+RocksDbResource::Transaction::Transaction(RocksDbResource &owner)
+    : owner_{owner}
+{
+    LOG_TRACE << "Beginning transaction " << id();
+    assert(!trx_);
+
+    trx_.reset(owner.beginTransaction());
+
+    if (!trx_) {
+        LOG_ERROR << "Failed to start transaction " << id();
+        throw InternalErrorException{"Failed to start transaction", "Database error/transaction"};
+    }
+
+    // Nice to have the same name in rocksdb logs.
+    // Optimistic transactions cannot be named.
+    if (!owner.isOptimistic()) {
+        trx_->SetName(to_string(id()));
+    }
+    ++owner_.transaction_count_;
+}
+
+RocksDbResource::Transaction::~Transaction()
+{
+    LOG_TRACE << "Ending " << (trx_ ? "actual" : "closed/failed")  << " transaction " << id();
+    if (trx_) {
+        try {
+            rollback_();
+        }  catch (const runtime_error& ex) {
+            LOG_WARN << "RocksDbResource::Transaction::~Transaction - Caught exception from rollback(): "
+                     << ex.what();
+        }
+
+        trx_.reset();
+        --owner_.transaction_count_;
+    }
+}
+
+ResourceIf::TransactionIf::RrAndSoa
+RocksDbResource::Transaction::lookupEntryAndSoa(string_view fqdn)
+{
+    // The index don't know about our own, uncommitted changes
+    return lookupEntryAndSoaT(*this, fqdn, dirty_ ? nullptr : owner_.zoneIndex());
+}
+
 ResourceIf::TransactionIf::EntryWithBuffer
 RocksDbResource::Transaction::lookup(std::string_view fqdn)
 {
     return read(RealKey{fqdn, key_class_t::ENTRY}, Category::ENTRY, false);
 }
 
+vector<ResourceIf::TransactionIf::EntryWithBuffer>
+RocksDbResource::Transaction::lookupBatch(const vector<string_view>& fqdns)
+{
+    return lookupBatchT(fqdns, id(), [this](size_t numKeys, const Slice *keys,
+                                           PinnableSlice *values, rocksdb::Status *statuses) {
+        trx_->MultiGet({}, owner_.handle(Category::ENTRY), numKeys, keys, values, statuses);
+    });
+}
+
 void RocksDbResource::Transaction::iterate(ResourceIf::TransactionIf::key_t key,
                                            ResourceIf::TransactionIf::iterator_fn_t fn,
                                            Category category)
@@ -222,6 +434,15 @@ void RocksDbResource::Transaction::iterate(ResourceIf::TransactionIf::key_t key,
     iterateT(key, category, std::move(fn));
 }
 
+void RocksDbResource::Transaction::iterateZone(ResourceIf::TransactionIf::key_t zoneKey,
+                                               ResourceIf::TransactionIf::iterator_fn_t fn)
+{
+    iterateZoneT(zoneKey, {}, owner_.config_.rocksdb_bulk_readahead_size,
+                 [this](const ReadOptions& options) {
+        return makeUniqueFrom(trx_->GetIterator(options, owner_.handle(Category::ENTRY)));
+    }, fn);
+}
+
 bool RocksDbResource::Transaction::keyExists(ResourceIf::TransactionIf::key_t key, Category category)
 {
     rocksdb::PinnableSlice ps;
@@ -243,25 +464,7 @@ bool RocksDbResource::Transaction::keyExists(ResourceIf::TransactionIf::key_t ke
 
 bool RocksDbResource::Transaction::exists(string_view fqdn, uint16_t type)
 {
-    try {
-        auto b = read(key_t{fqdn, key_class_t::ENTRY});
-        Entry entry{b->data()};
-
-        if (type == TYPE_SOA) {
-            return entry.flags().soa;
-        }
-
-        for(auto it : entry) {
-            if (it.type() == type) {
-                return true;
-            }
-        }
-
-    }  catch (const NotFoundException&) {
-        ;
-    }
-
-    return false;
+    return existsT(*this, fqdn, type);
 }
 
 void RocksDbResource::Transaction::write(ResourceIf::TransactionIf::key_t key,
@@ -269,13 +472,15 @@ void RocksDbResource::Transaction::write(ResourceIf::TransactionIf::key_t key,
                                          bool isNew, Category category)
 {
     LOG_TRACE << "RocksDbResource::Transaction::write - Write to transaction "
-              << uuid() << " key: " <<  key
+              << id() << " key: " <<  key
               << ", category " << category;
 
     if (isNew && keyExists(key)) {
         throw AlreadyExistException{"Key exists"};
     }
-    const auto status = trx_->Put(owner_.handle(category), toSlice(key.key()), toSlice(data));
+    const auto status = bulk_mode_
+        ? trx_->PutUntracked(owner_.handle(category), toSlice(key.key()), toSlice(data))
+        : trx_->Put(owner_.handle(category), toSlice(key.key()), toSlice(data));
 
     if (!status.ok()) {
         throw InternalErrorException{"Rocksdb write failed: "s + status.ToString(), "Database error"};
@@ -297,6 +502,7 @@ void RocksDbResource::Transaction::write(ResourceIf::TransactionIf::key_t key,
         }
     }
 
+    addEntryChange(key, ZoneIndex::toKind(data), category);
     dirty_ = true;
 }
 
@@ -304,7 +510,7 @@ ResourceIf::TransactionIf::read_ptr_t
 RocksDbResource::Transaction::read(ResourceIf::TransactionIf::key_t key, Category category, bool throwIfNoeExixt)
 {
     LOG_TRACE << "RocksDbResource::Transaction::read - Read from transaction "
-              << uuid() << " key: " << key
+              << id() << " key: " << key
               << ", category " << category;
 
     auto rval = make_unique<BufferImpl>();
@@ -325,7 +531,7 @@ RocksDbResource::Transaction::read(ResourceIf::TransactionIf::key_t key, Categor
     }
 
     LOG_WARN << "RocksDbResource::Transaction::read - Read from transaction "
-              << uuid() << " key: " << key
+              << id() << " key: " << key
               << ", category " << category
               << " failed with status: " << status.ToString();
 
@@ -336,7 +542,7 @@ bool RocksDbResource::Transaction::read(ResourceIf::TransactionIf::key_t key, st
                                         ResourceIf::Category category, bool throwIfNoeExixt)
 {
     LOG_TRACE << "RocksDbResource::Transaction::read (string) - Read from transaction "
-              << uuid() << " key: " << key
+              << id() << " key: " << key
               << ", category " << category;
 
     const auto status = trx_->Get({}, owner_.handle(category), toSlice(key.key()), &buffer);
@@ -353,7 +559,7 @@ bool RocksDbResource::Transaction::read(ResourceIf::TransactionIf::key_t key, st
     }
 
     LOG_WARN << "RocksDbResource::Transaction::read (string) - Read from transaction "
-              << uuid() << " key: " << key
+              << id() << " key: " << key
               << ", category " << category
               << " failed with status: " << status.ToString();
     throw InternalErrorException{status.ToString(), "Database error"};
@@ -367,40 +573,32 @@ void RocksDbResource::Transaction::remove(ResourceIf::TransactionIf::key_t key,
                   << key << ", category " << category
                   << " recursively.";
 
-        // Assumption: The iterator starts at key, and we can do a memcmp to
-        // figure out if we are still iterating the same zone
+        // The iterator starts at key. All the keys that starts with key are
+        // removed. For fqdn's, only the key itself and it's children are removed.
         //
-        // Note that DeleteRange is probably a better option for large zones.
-        // Unfortunately, it's not yet available in transactions
+        // Note that this is slow for large zones. Use dropZone() to delete a zone.
+        const auto prefix = toSlice(key.key());
+        const bool is_fqdn = RealKey::isReversed(key.kClass());
         rocksdb::ReadOptions options = {};
         auto it = makeUniqueFrom(trx_->GetIterator(options, owner_.handle(category)));
-        for(it->Seek(toSlice(key.key())); it->Valid() ; it->Next()) {
+        for(it->Seek(prefix); it->Valid() ; it->Next()) {
             const auto ck = it->key();
-            const auto extra_len = static_cast<int>(ck.size() - key.size());
-            if (extra_len < 0) {
+            if (!ck.starts_with(prefix)) {
                 break;
             }
-            if (extra_len > 0) {
-                // Validate that ck is a desecndent of key
-                assert(ck.size() > key.size() - 1);
-                if (ck[ck.size() - key.size() - 1] != '.') {
-                    break;
-                }
-                if (extra_len > 1) {
-                    // Corner-case - escaped dot in the same location as the zone-dot, but for a different zone
-                    if (ck[ck.size() - key.size() - 2] == '\\') {
-                        break;
-                    }
+
+            if (is_fqdn && ck.size() > prefix.size()) {
+                // Skip siblings, like "bexample.com" for "example.com" and
+                // names with an escaped dot right after the zone-name.
+                if (ck[prefix.size()] != '.'
+                    || (ck.size() > prefix.size() + 1 && ck[prefix.size() + 1] == '\\')) {
+                    continue;
                 }
             }
 
-            assert(extra_len >= 0);
-            // Check that the zone-part of ck is equal to the zone (that we have not skipped beoynd the zone)
-            if (memcmp(ck.data() + extra_len, key.data(), key.size()) != 0) {
-                break;
-            }
-            trx_->Delete(owner_.handle(category), it->key());
-            addDeletedToTrxlog(key, category);
+            trx_->Delete(owner_.handle(category), ck);
+            addDeletedToTrxlog({ck.data(), ck.size()}, category);
+            addEntryChange({RealKey::Binary{{ck.data(), ck.size()}}}, {}, category);
         }
     } else {
         LOG_TRACE << "RocksDbResource::Transaction::remove Removing key "
@@ -408,6 +606,104 @@ void RocksDbResource::Transaction::remove(ResourceIf::TransactionIf::key_t key,
 
         trx_->Delete(owner_.handle(category), toSlice(key));
         addDeletedToTrxlog(key, category);
+        addEntryChange(key, {}, category);
+    }
+
+    dirty_ = true;
+}
+
+void RocksDbResource::Transaction::dropZone(string_view fqdn)
+{
+    LOG_TRACE << "RocksDbResource::Transaction::dropZone Dropping zone "
+              << fqdn << " in transaction " << id();
+
+    // The apex goes trough the transaction, so that it's locked
+    const RealKey key{fqdn, key_class_t::ENTRY};
+    remove(key, false, Category::ENTRY);
+
+    // Everything below the apex. The reversed names of the children
+    // all starts with the reversed zone-name and a dot.
+    string from{key.bytes()}, to{key.bytes()};
+    from.push_back('.');
+    to.push_back('/'); // '.' + 1
+
+    // Names with an escaped dot right after the zone-name, like "a\.example.com",
+    // are siblings of the zone and must be kept.
+    vector<pair<string, string>> keep;
+    keep.emplace_back(from + '\\', from + ']'); // '\\' + 1
+
+    // Child zones may belong to other tenants. We keep them, with everything
+    // below them. The zones are registered in the ACCOUNT column family, with
+    // the same (reversed) key as the apex entry.
+    {
+        const RealKey zone_key{fqdn, RealKey::Class::ZONE};
+        string prefix{zone_key.bytes()};
+        prefix.push_back('.');
+        rocksdb::ReadOptions options = {};
+        auto it = makeUniqueFrom(trx_->GetIterator(options, owner_.handle(Category::ACCOUNT)));
+        for(it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+            const auto ck = it->key();
+            if (ck.size() > prefix.size() && ck[prefix.size()] == '\\') {
+                continue; // Escaped dot. Not below the zone.
+            }
+
+            const RealKey child{RealKey{RealKey::Binary{{ck.data(), ck.size()}}}.dataAsString(),
+                                key_class_t::ENTRY};
+            LOG_DEBUG << "RocksDbResource::Transaction::dropZone Keeping child zone "
+                      << child << " below " << fqdn;
+            keep.emplace_back(child.bytes(), child.bytes() + '\0');
+            keep.emplace_back(child.bytes() + '.', child.bytes() + '/');
+        }
+    }
+
+    sort(keep.begin(), keep.end());
+    for(const auto& [keep_from, keep_to] : keep) {
+        if (from < keep_from) {
+            removeRange(from, keep_from, Category::ENTRY);
+        }
+        from = max(from, keep_to);
+    }
+    if (from < to) {
+        removeRange(from, to, Category::ENTRY);
+    }
+
+    // All the diffs for the zone
+    const RealKey diff_key{fqdn, key_class_t::DIFF};
+    from = diff_key.bytes();
+    to = diff_key.bytes();
+    from.push_back(0);
+    to.push_back(1);
+    removeRange(from, to, Category::DIFF);
+    remove({fqdn, key_class_t::DIFF_INDEX}, false, Category::DIFF);
+}
+
+void RocksDbResource::Transaction::removeRange(span_t from, span_t to, Category category)
+{
+    LOG_TRACE << "RocksDbResource::Transaction::removeRange Removing a range of "
+              << from.size() << " byte keys, category " << category
+              << " in transaction " << id();
+
+    // Transactions don't support DeleteRange, so we add it to the underlaying write-batch.
+    // It's applied in order with the other operations when the transaction is committed.
+    auto *batch = trx_->GetWriteBatch()->GetWriteBatch();
+    const auto status = batch->DeleteRange(owner_.handle(category), toSlice(from), toSlice(to));
+    if (!status.ok()) {
+        throw InternalErrorException{"Rocksdb delete range failed: "s + status.ToString(), "Database error"};
+    }
+
+    if (category == Category::ENTRY) {
+        if (!disable_trxlog_ && owner_.config_.db_log_transactions) {
+            if (!trxlog_) {
+                trxlog_ = make_unique<pb::Transaction>();
+            }
+            auto part = trxlog_->add_parts();
+            part->set_key(from.data(), from.size());
+            part->set_endkey(to.data(), to.size());
+            part->set_columnfamilyix(static_cast<int32_t>(category));
+        }
+
+        entry_changes_.push_back({RealKey{RealKey::Binary{from}}.dataAsString(), {},
+                                  RealKey{RealKey::Binary{to}}.dataAsString()});
     }
 
     dirty_ = true;
@@ -417,13 +713,32 @@ void RocksDbResource::Transaction::commit()
 {
     call_once(once_, [&] {
         handleTrxLog();
-        LOG_TRACE << "Committing transaction " << uuid();
+
+        // If T1 and T2 both change the same zone, and T2 applies its changes
+        // to the zone index before T1, T1 would undo T2's changes in the index.
+        unique_lock index_lock{owner_.zone_index_commit_mutex_, defer_lock};
+        if (!entry_changes_.empty()) {
+            index_lock.lock();
+        }
+
+        LOG_TRACE << "Committing transaction " << id();
         auto status = trx_->Commit();
         if (!status.ok()) {
-            LOG_ERROR << "Transaction " << uuid() << " failed: " << status.ToString();
+            if (status.IsBusy() || status.IsTryAgain()) {
+                // Optimistic transaction that failed validation
+                LOG_DEBUG << "Transaction " << id() << " conflicted with another transaction: "
+                          << status.ToString();
+                throw ConflictException{"Transaction conflicted with another transaction"};
+            }
+            LOG_ERROR << "Transaction " << id() << " failed: " << status.ToString();
             throw runtime_error{"Failed to commit transaction"};
         }
 
+        if (!entry_changes_.empty()) {
+            owner_.onEntriesChanged(entry_changes_);
+            index_lock.unlock();
+        }
+
         if (trxlog_ && owner_.on_trx_cb_) {
             try {
                 owner_.on_trx_cb_(std::move(trxlog_));
@@ -442,6 +757,14 @@ void RocksDbResource::Transaction::rollback()
     rollback_();
 }
 
+void RocksDbResource::Transaction::setBulkMode()
+{
+    if (!bulk_mode_) {
+        LOG_TRACE << "Transaction " << id() << " is switching to bulk mode.";
+        bulk_mode_ = true;
+    }
+}
+
 string RocksDbResource::Transaction::getRocksdbVersion()
 {
     return rocksdb::GetRocksVersionAsString();
@@ -451,9 +774,11 @@ void RocksDbResource::Transaction::handleTrxLog()
 {
     if (trxlog_ && trxlog_->parts_size()) {
         trxlog_->set_node(owner_.config_.node_name);
-        trxlog_->set_uuid(uuid().begin(), uuid().size());
+        // The replicated transaction needs a globally unique id
+        const auto uuid = newUuid();
+        trxlog_->set_uuid(uuid.begin(), uuid.size());
         trxlog_->set_time(std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now().time_since_epoch()).count());
+            std::chrono::system_clock::now().time_since_epoch()).count());
 
         // The ordering may not be exactely right, as we can't control the
         // order of transactions execution without serializing them, but we can assume that
@@ -491,85 +816,511 @@ void RocksDbResource::Transaction::addDeletedToTrxlog(span_t key, Category categ
     }
 }
 
+void RocksDbResource::Transaction::addEntryChange(key_t key, std::optional<ZoneIndex::Kind> kind,
+                                                  Category category)
+{
+    if (category == Category::ENTRY) {
+        entry_changes_.push_back({key.dataAsString(), kind});
+    }
+}
+
 void RocksDbResource::Transaction::rollback_()
 {
     call_once(once_, [&] {
         if (dirty_) {
-            LOG_TRACE << "Rolling back transaction " << uuid();
+            LOG_TRACE << "Rolling back transaction " << id();
         } else {
-            LOG_TRACE << "Closing clean transaction " << uuid();
+            LOG_TRACE << "Closing clean transaction " << id();
         }
         auto status = trx_->Rollback();
         if (!status.ok()) {
-            LOG_ERROR << "Transaction rollback failed " << uuid() << " : " << status.ToString();
+            LOG_ERROR << "Transaction rollback failed " << id() << " : " << status.ToString();
             throw InternalErrorException{"Failed to rollback transaction", "Database error/rollback"};
         }
     });
 }
 
-RocksDbResource::RocksDbResource(const Config &config)
-    : config_{config}
+RocksDbResource::ReadTransaction::ReadTransaction(RocksDbResource &owner, bool consistent)
+    : owner_{owner}
 {
-    preInit();
+    if (consistent) {
+        snapshot_ = owner_.db().GetSnapshot();
+        options_.snapshot = snapshot_;
+    }
 }
 
-RocksDbResource::RocksDbResource(Server &server)
-: server_{&server}, config_{server.config()}
+RocksDbResource::ReadTransaction::~ReadTransaction()
 {
-    preInit();
+    if (snapshot_) {
+        owner_.db().ReleaseSnapshot(snapshot_);
+    }
 }
 
+ResourceIf::TransactionIf::RrAndSoa
+RocksDbResource::ReadTransaction::lookupEntryAndSoa(string_view fqdn)
+{
+    return lookupEntryAndSoaT(*this, fqdn, owner_.zoneIndex());
+}
 
-void RocksDbResource::preInit()
+ResourceIf::TransactionIf::EntryWithBuffer
+RocksDbResource::ReadTransaction::lookup(std::string_view fqdn)
 {
-    rocksdb::ColumnFamilyOptions o = rocksdb_options_;
-    cfd_.emplace_back(rocksdb::kDefaultColumnFamilyName, o);
-    cfd_.emplace_back("masterZone", o);
-    cfd_.emplace_back("entry", o);
-    cfd_.emplace_back("diff", o);
-    cfd_.emplace_back("account", o);
-    cfd_.emplace_back("trxlog", o);
+    return read(RealKey{fqdn, key_class_t::ENTRY}, Category::ENTRY, false);
 }
 
-RocksDbResource::~RocksDbResource()
+vector<ResourceIf::TransactionIf::EntryWithBuffer>
+RocksDbResource::ReadTransaction::lookupBatch(const vector<string_view>& fqdns)
 {
-    close();
+    return lookupBatchT(fqdns, id(), [this](size_t numKeys, const Slice *keys,
+                                           PinnableSlice *values, rocksdb::Status *statuses) {
+        owner_.db().MultiGet(options_, owner_.handle(Category::ENTRY), numKeys, keys, values, statuses);
+    });
 }
 
-std::unique_ptr<ResourceIf::TransactionIf> RocksDbResource::transaction()
+void RocksDbResource::ReadTransaction::iterate(ResourceIf::TransactionIf::key_t key,
+                                               ResourceIf::TransactionIf::iterator_fn_t fn,
+                                               Category category)
 {
-    return make_unique<Transaction>(*this);
+    auto it = makeUniqueFrom(owner_.db().NewIterator(options_, owner_.handle(category)));
+    for(it->Seek({key.data(), key.size()}); it->Valid(); it->Next()) {
+        const auto& k = it->key();
+        if (!key.isSameKeyClass(k)) [[unlikely]] {
+            return;
+        }
+        if (!fn({RealKey::Binary{k}}, it->value())) {
+            return;
+        }
+    }
 }
 
-void RocksDbResource::init()
+void RocksDbResource::ReadTransaction::iterateZone(ResourceIf::TransactionIf::key_t zoneKey,
+                                                   ResourceIf::TransactionIf::iterator_fn_t fn)
 {
-    rocksdb_options_.db_write_buffer_size = config_.rocksdb_db_write_buffer_size;
+    iterateZoneT(zoneKey, options_, owner_.config_.rocksdb_bulk_readahead_size,
+                 [this](const ReadOptions& options) {
+        return makeUniqueFrom(owner_.db().NewIterator(options, owner_.handle(Category::ENTRY)));
+    }, fn);
+}
 
-    if (config_.rocksdb_optimize_for_small_db) {
-        LOG_INFO << "RocksDbResource::init - OptimizeForSmallDb";
-        rocksdb_options_.OptimizeForSmallDb();
-    }
+bool RocksDbResource::ReadTransaction::keyExists(ResourceIf::TransactionIf::key_t key, Category category)
+{
+    rocksdb::PinnableSlice ps;
 
-    if (config_.rocksdb_background_threads) {
-        LOG_INFO << "RocksDbResource::init - IncreaseParallelism("
-                 << config_.rocksdb_background_threads << ")";
-        rocksdb_options_.IncreaseParallelism(config_.rocksdb_background_threads);
+    const auto status = owner_.db().Get(options_, owner_.handle(category), {key.data(), key.size()}, &ps);
+
+    if (status.ok()) {
+        return true;
     }
 
-    prepareDirs();
-    if (needBootstrap()) {
-        bootstrap();
-    } else {
-        open();
-        loadTrxId();
+    if (status.IsNotFound()) {
+        return false;
     }
+
+    LOG_WARN << "RocksDbResource::ReadTransaction::keyExists: " << status.ToString();
+
+    throw runtime_error{status.ToString()};
 }
 
-void RocksDbResource::close()
+bool RocksDbResource::ReadTransaction::exists(string_view fqdn, uint16_t type)
 {
-    // https://stackoverflow.com/questions/56173836/rocksdb-assertion-last-ref-failed-when-closing-db-while-using-unique-pointers
+    return existsT(*this, fqdn, type);
+}
 
-    LOG_INFO << "Closing RocksDB. " << transaction_count_ << " active transactions.";
+void RocksDbResource::ReadTransaction::write(ResourceIf::TransactionIf::key_t key,
+                                             ResourceIf::TransactionIf::data_t /*data*/,
+                                             bool /*isNew*/, Category category)
+{
+    LOG_WARN << "RocksDbResource::ReadTransaction::write - Attempt to write key "
+             << key << ", category " << category << " in read-only transaction " << id();
+    throw InternalErrorException{"Write in read-only transaction", "Database error/read-only"};
+}
+
+ResourceIf::TransactionIf::read_ptr_t
+RocksDbResource::ReadTransaction::read(ResourceIf::TransactionIf::key_t key, Category category, bool throwIfNoeExixt)
+{
+    LOG_TRACE << "RocksDbResource::ReadTransaction::read - Read from read-only transaction "
+              << id() << " key: " << key
+              << ", category " << category;
+
+    auto rval = make_unique<BufferImpl>();
+
+    const auto status = owner_.db().Get(options_, owner_.handle(category), {key.data(), key.size()}, &rval->ps_);
+
+    if (status.ok()) {
+        rval->prepare();
+        return rval;
+    }
+
+    if (status.IsNotFound()) {
+        if (throwIfNoeExixt) {
+            throw NotFoundException{"Key not found"};
+        }
+
+        return {};
+    }
+
+    LOG_WARN << "RocksDbResource::ReadTransaction::read - Read from read-only transaction "
+             << id() << " key: " << key
+             << ", category " << category
+             << " failed with status: " << status.ToString();
+
+    throw InternalErrorException{status.ToString(), "Database error"};
+}
+
+bool RocksDbResource::ReadTransaction::read(ResourceIf::TransactionIf::key_t key, string &buffer,
+                                            ResourceIf::Category category, bool throwIfNoeExixt)
+{
+    LOG_TRACE << "RocksDbResource::ReadTransaction::read (string) - Read from read-only transaction "
+              << id() << " key: " << key
+              << ", category " << category;
+
+    const auto status = owner_.db().Get(options_, owner_.handle(category), {key.data(), key.size()}, &buffer);
+
+    if (status.ok()) {
+        return true;
+    }
+
+    if (status.IsNotFound()) {
+        if (throwIfNoeExixt) {
+            throw NotFoundException{"Key not found"};
+        }
+        return false;
+    }
+
+    LOG_WARN << "RocksDbResource::ReadTransaction::read (string) - Read from read-only transaction "
+             << id() << " key: " << key
+             << ", category " << category
+             << " failed with status: " << status.ToString();
+    throw InternalErrorException{status.ToString(), "Database error"};
+}
+
+void RocksDbResource::ReadTransaction::remove(ResourceIf::TransactionIf::key_t key,
+                                              bool /*recursive*/, Category category)
+{
+    LOG_WARN << "RocksDbResource::ReadTransaction::remove - Attempt to remove key "
+             << key << ", category " << category << " in read-only transaction " << id();
+    throw InternalErrorException{"Remove in read-only transaction", "Database error/read-only"};
+}
+
+void RocksDbResource::ReadTransaction::dropZone(string_view fqdn)
+{
+    LOG_WARN << "RocksDbResource::ReadTransaction::dropZone - Attempt to drop zone "
+             << fqdn << " in read-only transaction " << id();
+    throw InternalErrorException{"Remove in read-only transaction", "Database error/read-only"};
+}
+
+void RocksDbResource::ReadTransaction::removeRange(span_t /*from*/, span_t /*to*/, Category category)
+{
+    LOG_WARN << "RocksDbResource::ReadTransaction::removeRange - Attempt to remove a range, category "
+             << category << " in read-only transaction " << id();
+    throw InternalErrorException{"Remove in read-only transaction", "Database error/read-only"};
+}
+
+void RocksDbResource::ReadTransaction::commit()
+{
+    ; // Nothing to commit
+}
+
+void RocksDbResource::ReadTransaction::rollback()
+{
+    ; // Nothing to roll back
+}
+
+RocksDbResource::RocksDbResource(const Config &config)
+    : config_{config}
+{
+}
+
+RocksDbResource::RocksDbResource(Server &server)
+: server_{&server}, config_{server.config()}
+{
+}
+
+
+void RocksDbResource::prepareColumnFamilies()
+{
+    // Must match the order of the constants DEFAULT .. TRXLOG
+
+    std::shared_ptr<rocksdb::Cache> cache;
+    if (config_.rocksdb_block_cache_size) {
+        if (config_.rocksdb_block_cache_type == "hyperclock") {
+            cache = rocksdb::HyperClockCacheOptions(config_.rocksdb_block_cache_size, 0).MakeSharedCache();
+        } else if (config_.rocksdb_block_cache_type == "lru") {
+            cache = rocksdb::NewLRUCache(config_.rocksdb_block_cache_size);
+        } else {
+            LOG_ERROR << "RocksDbResource::prepareColumnFamilies - Unknown block cache type: "
+                      << config_.rocksdb_block_cache_type;
+            throw runtime_error{"Unknown rocksdb block cache type"};
+        }
+
+        LOG_INFO << "RocksDbResource::prepareColumnFamilies - Using a shared "
+                 << config_.rocksdb_block_cache_type << " block cache of "
+                 << config_.rocksdb_block_cache_size << " bytes";
+    }
+
+    const auto makeTableOptions = [&] {
+        rocksdb::BlockBasedTableOptions to;
+        if (cache) {
+            to.block_cache = cache;
+        }
+        // Keep the memory use bounded by the cache size
+        to.cache_index_and_filter_blocks = true;
+        to.pin_l0_filter_and_index_blocks_in_cache = true;
+        return to;
+    };
+
+    const rocksdb::ColumnFamilyOptions defaults = rocksdb_options_;
+
+    auto makeOptions = [&](const rocksdb::BlockBasedTableOptions& to) {
+        auto o = defaults;
+        o.table_factory.reset(rocksdb::NewBlockBasedTableFactory(to));
+        return o;
+    };
+
+    // Options for the column families that don't need special treatment
+    const auto common = makeOptions(makeTableOptions());
+
+    // Point lookups. Most negative lookups can be answered by the bloom filter.
+    auto entry = common;
+    if (config_.rocksdb_entry_bloom_bits > 0) {
+        auto to = makeTableOptions();
+        to.filter_policy.reset(rocksdb::NewBloomFilterPolicy(config_.rocksdb_entry_bloom_bits));
+        to.whole_key_filtering = true;
+        entry = makeOptions(to);
+    }
+
+    // Looked up and iterated per zone
+    auto diff = common;
+    if (config_.rocksdb_diff_prefix_bloom) {
+        auto to = makeTableOptions();
+        to.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10));
+        to.whole_key_filtering = false;
+        diff = makeOptions(to);
+        diff.prefix_extractor = make_shared<DiffPrefixTransform>();
+    }
+
+    // Append only, and read sequentially. The old transactions are
+    // removed by pruneTrxLog(), which keeps track of the first retained id.
+    auto trxlog = common;
+
+    cfd_.clear();
+    cfd_.emplace_back(rocksdb::kDefaultColumnFamilyName, common);
+    cfd_.emplace_back("masterZone", common);
+    cfd_.emplace_back("entry", entry);
+    cfd_.emplace_back("diff", diff);
+    cfd_.emplace_back("account", common);
+    cfd_.emplace_back("trxlog", trxlog);
+}
+
+RocksDbResource::~RocksDbResource()
+{
+    close();
+}
+
+std::unique_ptr<ResourceIf::TransactionIf> RocksDbResource::transaction()
+{
+    return make_unique<Transaction>(*this);
+}
+
+std::unique_ptr<ResourceIf::TransactionIf> RocksDbResource::readOnlyTransaction(bool consistent)
+{
+    return make_unique<ReadTransaction>(*this, consistent);
+}
+
+void RocksDbResource::updateMetrics()
+{
+    if (!server_ || !db_) {
+        return;
+    }
+
+    auto& m = server_->metrics().rocksdb();
+
+    if (const auto& stats = rocksdb_options_.statistics; stats && m.block_cache_hits) {
+        m.block_cache_hits->set(stats->getTickerCount(rocksdb::BLOCK_CACHE_HIT));
+        m.block_cache_misses->set(stats->getTickerCount(rocksdb::BLOCK_CACHE_MISS));
+        m.bloom_useful->set(stats->getTickerCount(rocksdb::BLOOM_FILTER_USEFUL));
+        m.bloom_full_positive->set(stats->getTickerCount(rocksdb::BLOOM_FILTER_FULL_POSITIVE));
+        m.bloom_full_true_positive->set(stats->getTickerCount(rocksdb::BLOOM_FILTER_FULL_TRUE_POSITIVE));
+        m.bloom_prefix_useful->set(stats->getTickerCount(rocksdb::BLOOM_FILTER_PREFIX_USEFUL));
+        m.memtable_hits->set(stats->getTickerCount(rocksdb::MEMTABLE_HIT));
+        m.memtable_misses->set(stats->getTickerCount(rocksdb::MEMTABLE_MISS));
+        m.compaction_read_bytes->set(stats->getTickerCount(rocksdb::COMPACT_READ_BYTES));
+        m.compaction_write_bytes->set(stats->getTickerCount(rocksdb::COMPACT_WRITE_BYTES));
+        m.stall_micros->set(stats->getTickerCount(rocksdb::STALL_MICROS));
+    }
+
+    for(size_t i = 0; i < m.sst_files_size.size() && i < cfh_.size(); ++i) {
+        uint64_t size = 0;
+        if (m.sst_files_size[i]
+            && db_->GetIntProperty(cfh_[i], rocksdb::DB::Properties::kTotalSstFilesSize, &size)) {
+            m.sst_files_size[i]->set(size);
+        }
+    }
+
+    if (const auto& limiter = rocksdb_options_.rate_limiter; limiter && m.rate_limit) {
+        m.rate_limit->set(static_cast<uint64_t>(limiter->GetBytesPerSecond()));
+        for(size_t i = 0; i < m.rate_limiter_bytes.size(); ++i) {
+            const auto pri = static_cast<rocksdb::Env::IOPriority>(i);
+            if (m.rate_limiter_bytes[i]) {
+                m.rate_limiter_bytes[i]->set(static_cast<uint64_t>(limiter->GetTotalBytesThrough(pri)));
+            }
+            if (m.rate_limiter_requests[i]) {
+                m.rate_limiter_requests[i]->set(static_cast<uint64_t>(limiter->GetTotalRequests(pri)));
+            }
+        }
+    }
+}
+
+void RocksDbResource::startMetricsTimer()
+{
+    assert(server_);
+    if (!config_.metrics_rocksdb_interval) {
+        return;
+    }
+
+    if (!metrics_timer_) {
+        metrics_timer_.emplace(server_->ctx());
+    }
+
+    metrics_timer_->expires_from_now(boost::posix_time::seconds{config_.metrics_rocksdb_interval});
+    metrics_timer_->async_wait([this](const auto ec) {
+        if (ec) {
+            if (ec == boost::asio::error::operation_aborted) {
+                LOG_TRACE << "RocksDbResource metrics timer aborted.";
+                return;
+            }
+            LOG_WARN << "RocksDbResource metrics timer unexpected error: " << ec;
+        } else {
+            try {
+                updateMetrics();
+            } catch (const exception& ex) {
+                LOG_ERROR << "RocksDbResource metrics timer: exception from updateMetrics(): "
+                          << ex.what();
+            }
+        }
+
+        startMetricsTimer();
+    });
+}
+
+void RocksDbResource::setEntriesChangedCallback(on_entries_changed_cb_t cb)
+{
+    lock_guard lock{entries_changed_mutex_};
+    on_entries_changed_cb_ = std::move(cb);
+}
+
+void RocksDbResource::onEntriesChanged(const ZoneIndex::changes_t &changes)
+{
+    // Without the index, we don't know if the zones changed
+    bool zones_changed = true;
+    if (config_.db_zone_index) {
+        zones_changed = zone_index_.apply(changes);
+    }
+
+    callEntriesChangedCallback(changes, zones_changed);
+}
+
+void RocksDbResource::callEntriesChangedCallback(const ZoneIndex::changes_t &changes, bool zonesChanged)
+{
+    on_entries_changed_cb_t cb;
+    {
+        lock_guard lock{entries_changed_mutex_};
+        cb = on_entries_changed_cb_;
+    }
+
+    if (cb) {
+        try {
+            cb(changes, zonesChanged);
+        } catch(const exception& ex) {
+            LOG_ERROR << "RocksDbResource::onEntriesChanged - "
+                      << "Caught exception from callback: " << ex.what();
+        }
+    }
+}
+
+const ZoneIndex *RocksDbResource::zoneIndex() const noexcept
+{
+    if (config_.db_zone_index && zone_index_.ready()) {
+        return &zone_index_;
+    }
+
+    return {};
+}
+
+void RocksDbResource::init()
+{
+    rocksdb_options_.db_write_buffer_size = config_.rocksdb_db_write_buffer_size;
+
+    if (config_.rocksdb_optimize_for_small_db) {
+        LOG_INFO << "RocksDbResource::init - OptimizeForSmallDb";
+        rocksdb_options_.OptimizeForSmallDb();
+    }
+
+    if (config_.rocksdb_background_threads) {
+        LOG_INFO << "RocksDbResource::init - IncreaseParallelism("
+                 << config_.rocksdb_background_threads << ")";
+        rocksdb_options_.IncreaseParallelism(config_.rocksdb_background_threads);
+    }
+
+    if (config_.rocksdb_statistics) {
+        LOG_INFO << "RocksDbResource::init - Collecting statistics";
+        rocksdb_options_.statistics = rocksdb::CreateDBStatistics();
+    }
+
+    if (config_.rocksdb_rate_limit) {
+        LOG_INFO << "RocksDbResource::init - Limiting flush and compaction I/O to "
+                 << config_.rocksdb_rate_limit << " bytes per second"
+                 << (config_.rocksdb_rate_limit_auto_tune ? " (auto-tuned)" : "");
+
+        // kAllIo also limits the compaction reads. Flushes are requested at
+        // IO_HIGH and compactions at IO_LOW, so flushes are not starved.
+        // User reads and writes are not affected.
+        rocksdb_options_.rate_limiter.reset(rocksdb::NewGenericRateLimiter(
+            static_cast<int64_t>(config_.rocksdb_rate_limit),
+            100 * 1000 /* refill period in microseconds */,
+            10 /* fairness */,
+            rocksdb::RateLimiter::Mode::kAllIo,
+            config_.rocksdb_rate_limit_auto_tune));
+    }
+
+    prepareColumnFamilies();
+
+    if (config_.db_secondary) {
+        if (needBootstrap()) {
+            LOG_ERROR << "RocksDbResource::init - There is no database at " << getDbPath()
+                      << " to open as a secondary instance.";
+            throw runtime_error{"No database to open as a secondary instance"};
+        }
+        openSecondary();
+        loadTrxId();
+        loadZoneIndex();
+        return;
+    }
+
+    prepareDirs();
+    if (needBootstrap()) {
+        bootstrap();
+        zone_index_.setReady();
+    } else {
+        open();
+        loadTrxId();
+        loadZoneIndex();
+    }
+}
+
+void RocksDbResource::close()
+{
+    // https://stackoverflow.com/questions/56173836/rocksdb-assertion-last-ref-failed-when-closing-db-while-using-unique-pointers
+
+    LOG_INFO << "Closing RocksDB. " << transaction_count_ << " active transactions.";
+
+    if (metrics_timer_) {
+        metrics_timer_->cancel();
+    }
+
+    if (catchup_timer_) {
+        catchup_timer_->cancel();
+    }
 
     // Make sure any ongoing backup is aborted before we shut down the DD engine.
     std::optional<thread> backup_thd;
@@ -606,10 +1357,13 @@ void RocksDbResource::close()
         }
 
 
-        auto result = db_->SyncWAL();
-        if (!result.ok()) {
-            LOG_ERROR << "RocksDbResource::~RocksDbResource - Failed to sync WAL: "
-                      << result.ToString();
+        rocksdb::Status result;
+        if (!secondary_) {
+            result = db_->SyncWAL();
+            if (!result.ok()) {
+                LOG_ERROR << "RocksDbResource::~RocksDbResource - Failed to sync WAL: "
+                          << result.ToString();
+            }
         }
 
         LOG_TRACE << "RocksDbResource::~RocksDbResource - Closing db_";
@@ -622,6 +1376,19 @@ void RocksDbResource::close()
         LOG_TRACE << "RocksDbResource::~RocksDbResource - deleting db_";
         delete db_;
         db_ = {};
+
+        if (!tmp_secondary_path_.empty()) {
+            LOG_DEBUG << "RocksDbResource::close - Removing the secondary path " << tmp_secondary_path_;
+            std::error_code ec;
+            filesystem::remove_all(tmp_secondary_path_, ec);
+            if (ec) {
+                LOG_WARN << "RocksDbResource::close - Failed to remove the secondary path "
+                         << tmp_secondary_path_ << ": " << ec.message();
+            }
+            tmp_secondary_path_.clear();
+        }
+        txn_db_ = {};
+        optimistic_db_ = {};
     }
 }
 
@@ -642,6 +1409,329 @@ uint64_t RocksDbResource::getLastCommittedTransactionId()
     return 0;
 }
 
+uint64_t RocksDbResource::pruneTrxLog(std::optional<uint64_t> confirmedTrxId, bool force)
+{
+    if (!config_.cluster_trxlog_retention_count
+        && !config_.cluster_trxlog_retention_age
+        && !config_.cluster_trxlog_prune_confirmed) {
+        return 0;
+    }
+
+    {
+        const auto now = chrono::steady_clock::now();
+        lock_guard lock{mutex_};
+        if (!force && now < next_trxlog_prune_) {
+            return 0;
+        }
+        next_trxlog_prune_ = now + chrono::seconds{config_.cluster_trxlog_prune_interval};
+    }
+
+    // On followers, trx_id_ is not used, so we look it up
+    const auto last = getLastCommittedTransactionId();
+    if (last <= 1) {
+        return 0;
+    }
+
+    // Delete all transactions with id <= prune_to
+    uint64_t prune_to = 0;
+
+    if (config_.cluster_trxlog_retention_count
+        && last > config_.cluster_trxlog_retention_count) {
+        prune_to = last - config_.cluster_trxlog_retention_count;
+    }
+
+    if (config_.cluster_trxlog_prune_confirmed && confirmedTrxId) {
+        prune_to = max(prune_to, *confirmedTrxId);
+    }
+
+    if (config_.cluster_trxlog_retention_age) {
+        const auto now = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+        const auto expired = static_cast<uint64_t>(now)
+                             - (config_.cluster_trxlog_retention_age * 1000);
+
+        ReadOptions o;
+        o.fill_cache = false;
+        const RealKey first{first_retained_trx_id_, RealKey::Class::TRXID};
+        auto it = makeUniqueFrom(db_->NewIterator(o, handle(Category::TRXLOG)));
+        pb::Transaction trx;
+        for(it->Seek({first.data(), first.size()}); it->Valid(); it->Next()) {
+            if (!trx.ParseFromArray(it->value().data(), it->value().size())) {
+                LOG_WARN << "RocksDbResource::pruneTrxLog - Failed to deserialize transaction "
+                         << RealKey{RealKey::Binary{it->key()}};
+                break;
+            }
+            if (trx.time() >= expired) {
+                break;
+            }
+            prune_to = max(prune_to, trx.id());
+        }
+    }
+
+    // Always keep the last transaction. We need it to get the trx-id after a restart.
+    prune_to = min(prune_to, last - 1);
+
+    if (prune_to < first_retained_trx_id_) {
+        return 0;
+    }
+
+    const RealKey from{uint64_t{0}, RealKey::Class::TRXID};
+    const RealKey to{prune_to + 1, RealKey::Class::TRXID};
+
+    LOG_DEBUG << "RocksDbResource::pruneTrxLog - Deleting transactions "
+              << first_retained_trx_id_ << " to " << prune_to;
+
+    // The transaction-log is only appended to, so we don't need
+    // the transaction db's locking here.
+    const auto status = db_->GetRootDB()->DeleteRange(
+        rocksdb::WriteOptions{}, handle(Category::TRXLOG),
+        {from.data(), from.size()}, {to.data(), to.size()});
+
+    if (!status.ok()) {
+        LOG_ERROR << "RocksDbResource::pruneTrxLog - DeleteRange failed: " << status.ToString();
+        throw runtime_error{"Failed to prune the transaction-log"};
+    }
+
+    first_retained_trx_id_ = prune_to + 1;
+    LOG_INFO << "RocksDbResource::pruneTrxLog - Pruned the transaction-log. The oldest retained "
+             << "transaction is now #" << first_retained_trx_id_;
+    return prune_to;
+}
+
+void RocksDbResource::prepareReplicated(ReplicatedBatch &batch, const pb::Transaction &trx)
+{
+    const auto trxid = trx.id();
+
+    for(const auto& part : trx.parts()) {
+        string_view op = "write";
+        rocksdb::Status status;
+        try {
+            auto *cf = handle(ResourceIf::toCatecory(part.columnfamilyix()));
+            if (part.has_value()) {
+                status = batch.batch.Put(cf, part.key(), part.value());
+            } else if (part.has_endkey()) {
+                op = "remove range from";
+                status = batch.batch.DeleteRange(cf, part.key(), part.endkey());
+            } else {
+                op = "remove";
+                status = batch.batch.Delete(cf, part.key());
+            }
+        } catch (const exception& ex) {
+            status = rocksdb::Status::InvalidArgument(ex.what());
+        }
+
+        if (!status.ok()) {
+            LOG_WARN << "RocksDbResource::prepareReplicated - Failed to " << op << ' '
+                     << RealKey{RealKey::Binary{part.key()}} << " of transaction #" << trxid
+                     << ": " << status.ToString();
+        }
+    }
+
+    // Also write the transaction-log entry
+    const RealKey key{trxid, RealKey::Class::TRXID};
+    const auto status = batch.batch.Put(handle(Category::TRXLOG), {key.data(), key.size()},
+                                        trx.SerializeAsString());
+    if (!status.ok()) {
+        LOG_ERROR << "RocksDbResource::prepareReplicated - Failed to add transaction #"
+                  << trxid << " to the transaction-log: " << status.ToString();
+        throw runtime_error{"Failed to prepare a replicated transaction"};
+    }
+
+    addEntryChanges(trx, batch.changes);
+    batch.trxId = trxid;
+}
+
+void RocksDbResource::commitReplicated(ReplicatedBatch &batch)
+{
+    assert(db_);
+
+    LOG_TRACE << "RocksDbResource::commitReplicated - Writing " << batch.batch.Count()
+              << " operations up to trx #" << batch.trxId;
+
+    lock_guard index_lock{zone_index_commit_mutex_};
+    const auto status = db_->GetRootDB()->Write(rocksdb::WriteOptions{}, &batch.batch);
+    if (!status.ok()) {
+        LOG_ERROR << "RocksDbResource::commitReplicated - Failed to write trx #"
+                  << batch.trxId << ": " << status.ToString();
+        throw runtime_error{"Failed to write replicated transactions"};
+    }
+
+    if (!batch.changes.empty()) {
+        onEntriesChanged(batch.changes);
+    }
+}
+
+RocksDbResource::Snapshot RocksDbResource::exportSnapshot(const std::filesystem::path &dir)
+{
+    assert(db_);
+    filesystem::create_directories(dir);
+
+    auto release = [this](const rocksdb::Snapshot *snapshot) {
+        db_->ReleaseSnapshot(snapshot);
+    };
+    unique_ptr<const rocksdb::Snapshot, decltype(release)> snapshot{db_->GetSnapshot(), release};
+
+    ReadOptions o;
+    o.snapshot = snapshot.get();
+    o.fill_cache = false;
+    o.readahead_size = config_.rocksdb_bulk_readahead_size;
+    o.total_order_seek = true; // DIFF has a prefix extractor
+
+    Snapshot rval;
+    {
+        auto it = makeUniqueFrom(db_->NewIterator(o, handle(Category::TRXLOG)));
+        it->SeekToLast();
+        if (it->Valid()) {
+            rval.trxId = getValueAt<uint64_t>(span_t{it->key()}, 1);
+            rval.lastTrx = it->value().ToString();
+        }
+    }
+
+    for(const auto category : {Category::ENTRY, Category::DIFF, Category::ACCOUNT}) {
+        const auto ix = static_cast<size_t>(category);
+        auto it = makeUniqueFrom(db_->NewIterator(o, cfh_.at(ix)));
+        it->SeekToFirst();
+        if (!it->Valid()) {
+            if (!it->status().ok()) {
+                LOG_ERROR << "RocksDbResource::exportSnapshot - Failed to iterate over "
+                          << cfd_[ix].name << ": " << it->status().ToString();
+                throw runtime_error{"Failed to export the database"};
+            }
+            continue;
+        }
+
+        const auto path = dir / (cfd_[ix].name + ".sst");
+        rocksdb::SstFileWriter writer{rocksdb::EnvOptions{},
+                                      Options{rocksdb_options_, cfd_[ix].options},
+                                      cfh_[ix]};
+        auto status = writer.Open(path.string());
+        size_t count = 0;
+        for(; status.ok() && it->Valid(); it->Next(), ++count) {
+            status = writer.Put(it->key(), it->value());
+        }
+        if (status.ok()) {
+            status = it->status();
+        }
+        if (status.ok()) {
+            status = writer.Finish();
+        }
+        if (!status.ok()) {
+            LOG_ERROR << "RocksDbResource::exportSnapshot - Failed to export "
+                      << cfd_[ix].name << " to " << path << ": " << status.ToString();
+            throw runtime_error{"Failed to export the database"};
+        }
+
+        LOG_DEBUG << "RocksDbResource::exportSnapshot - Exported " << count
+                  << " keys from " << cfd_[ix].name << " to " << path;
+        rval.files.emplace_back(category, path);
+    }
+
+    LOG_INFO << "RocksDbResource::exportSnapshot - Exported a snapshot at trx #"
+             << rval.trxId << " to " << dir;
+    return rval;
+}
+
+void RocksDbResource::importSnapshot(const Snapshot &snapshot)
+{
+    assert(db_);
+    assert(!secondary_);
+
+    // Writes directly to the root db bypass the transaction db's locking.
+    // That's OK, as nothing else writes to these column families on a follower
+    // while it bootstraps.
+    auto *root = db_->GetRootDB();
+
+    auto check = [](const rocksdb::Status& status, string_view what) {
+        if (!status.ok()) {
+            LOG_ERROR << "RocksDbResource::importSnapshot - Failed to " << what
+                      << ": " << status.ToString();
+            throw runtime_error{"Failed to import the database snapshot"};
+        }
+    };
+
+    // The transaction-log changes are synced, so that a crash
+    // can't leave a trx-id that don't match the data.
+    rocksdb::WriteOptions sync_write;
+    sync_write.sync = true;
+
+    auto clear = [&](Category category) {
+        ReadOptions o;
+        o.total_order_seek = true; // DIFF has a prefix extractor
+        auto it = makeUniqueFrom(db_->NewIterator(o, handle(category)));
+        it->SeekToLast();
+        check(it->status(), "find the last key");
+        if (!it->Valid()) {
+            return;
+        }
+
+        auto end = it->key().ToString();
+        end.push_back(0);
+        check(root->DeleteRange(category == Category::TRXLOG ? sync_write : rocksdb::WriteOptions{},
+                                handle(category), {}, end),
+              "delete existing data");
+    };
+
+    LOG_INFO << "RocksDbResource::importSnapshot - Importing a snapshot at trx #"
+             << snapshot.trxId << " with " << snapshot.files.size() << " files.";
+
+    // The follower may be serving DNS queries. Make it fail them until the
+    // new data is in place, rather than answer from a half-empty database.
+    importing_ = true;
+    ScopedExit se{[this] {
+        importing_ = false;
+    }};
+    zone_index_.setReady(false);
+    callEntriesChangedCallback({}, true);
+
+    // Forget our transaction-id first. If we crash before the import is complete,
+    // we start with trx-id 0, and bootstrap again.
+    clear(Category::TRXLOG);
+    trx_id_ = 0;
+
+    for(const auto category : {Category::ENTRY, Category::DIFF, Category::ACCOUNT}) {
+        clear(category);
+    }
+
+    for(const auto& [category, path] : snapshot.files) {
+        switch(category) {
+        case Category::ENTRY:
+        case Category::DIFF:
+        case Category::ACCOUNT:
+            break;
+        default:
+            LOG_ERROR << "RocksDbResource::importSnapshot - Unexpected column-family "
+                      << ResourceIf::toInt(category) << " for " << path;
+            throw runtime_error{"Unexpected column-family in the database snapshot"};
+        }
+
+        rocksdb::IngestExternalFileOptions options;
+        options.move_files = true;
+        check(db_->IngestExternalFile(handle(category), {path.string()}, options),
+              "ingest "s + path.string());
+    }
+
+    // The trx-id is written last, when all the data is in place
+    if (snapshot.trxId) {
+        auto value = snapshot.lastTrx;
+        if (value.empty()) {
+            // We only need the id to continue from the snapshot
+            pb::Transaction trx;
+            trx.set_id(snapshot.trxId);
+            value = trx.SerializeAsString();
+        }
+
+        const RealKey key{snapshot.trxId, RealKey::Class::TRXID};
+        check(root->Put(sync_write, handle(Category::TRXLOG),
+                        {key.data(), key.size()}, value),
+              "write the transaction-log");
+    }
+
+    loadTrxId();
+    reloadZoneIndex();
+
+    LOG_INFO << "RocksDbResource::importSnapshot - Done. trx-id is now " << trx_id_;
+}
+
 void RocksDbResource::backup(std::filesystem::path backupDir,
                              bool syncFirst, boost::uuids::uuid uuid)
 {
@@ -649,12 +1739,14 @@ void RocksDbResource::backup(std::filesystem::path backupDir,
 
     backupDir = getBackupPath(backupDir);
 
-    auto [handle, lock] = getBackupEngine(backupDir, backup_mutex_);
+    auto [handle, lock] = getBackupEngine(backupDir, backup_mutex_, config_.backup_rate_limit);
 
     const auto uuid_str = toLower(boost::uuids::to_string(uuid));
 
     CreateBackupOptions backup_opts;
     backup_opts.flush_before_backup = syncFirst;
+    // Let the DNS and API threads win when they compete with the backup for the CPU
+    backup_opts.decrease_background_thread_cpu_priority = true;
     BackupID id = {};
 
     LOG_INFO << "Starting database backup " << uuid_str << " to path " << backupDir;
@@ -880,14 +1972,7 @@ void RocksDbResource::open()
     rocksdb_options_.create_if_missing = false;
     rocksdb_options_.create_missing_column_families = true;
 
-    TransactionDBOptions txn_db_options;
-    const auto status = TransactionDB::Open(rocksdb_options_, txn_db_options, getDbPath(), cfd_, &cfh_, &db_);
-    if (!status.ok()) {
-        LOG_ERROR << "Failed to open database " << getDbPath()
-                  << ' ' << status.ToString();
-        throw runtime_error{"Failed to open database"};
-    }
-
+    openDb();
 }
 
 void RocksDbResource::bootstrap()
@@ -898,15 +1983,229 @@ void RocksDbResource::bootstrap()
     filesystem::create_directories(getDbPath());
     rocksdb_options_.create_if_missing = true;
     rocksdb_options_.create_missing_column_families = true;
-    TransactionDBOptions txn_db_options;
-    const auto status = TransactionDB::Open(rocksdb_options_, txn_db_options, getDbPath(), cfd_, &cfh_, &db_);
+    openDb();
+    bootstrapped_ = true;
+}
+
+void RocksDbResource::openDb()
+{
+    assert(!db_);
+
+    rocksdb::Status status;
+    if (config_.rocksdb_transaction_db == "optimistic") {
+        LOG_DEBUG << "RocksDbResource::openDb - Using optimistic transactions.";
+        OptimisticTransactionDBOptions otxn_db_options;
+        otxn_db_options.validate_policy = OccValidationPolicy::kValidateParallel;
+        status = OptimisticTransactionDB::Open(rocksdb_options_, otxn_db_options, getDbPath(),
+                                               cfd_, &cfh_, &optimistic_db_);
+        db_ = optimistic_db_;
+    } else if (config_.rocksdb_transaction_db == "pessimistic") {
+        TransactionDBOptions txn_db_options;
+        status = TransactionDB::Open(rocksdb_options_, txn_db_options, getDbPath(), cfd_, &cfh_, &txn_db_);
+        db_ = txn_db_;
+    } else {
+        LOG_ERROR << "RocksDbResource::openDb - Unknown transaction db type: "
+                  << config_.rocksdb_transaction_db;
+        throw runtime_error{"Unknown rocksdb transaction db type"};
+    }
+
     if (!status.ok()) {
-        LOG_ERROR << "Failed to create database " << getDbPath()
+        LOG_ERROR << "Failed to open database " << getDbPath()
                   << ' ' << status.ToString();
-        throw runtime_error{"Failed to create the database"};
+        throw runtime_error{"Failed to open database"};
     }
+}
 
-    bootstrapped_ = true;
+void RocksDbResource::openSecondary()
+{
+    assert(!db_);
+
+    const auto path = getSecondaryPath();
+    LOG_INFO << "Opening RocksDB " << rocksdb::GetRocksVersionAsString()
+             << ": " << getDbPath() << " as a secondary instance with path " << path;
+
+    filesystem::create_directories(path);
+    if (config_.db_secondary_path.empty()) {
+        tmp_secondary_path_ = path;
+    }
+
+    // Required by RocksDB for secondary instances
+    rocksdb_options_.max_open_files = -1;
+
+    const auto status = rocksdb::DB::OpenAsSecondary(rocksdb_options_, getDbPath(), path,
+                                                     cfd_, &cfh_, &db_);
+    if (!status.ok()) {
+        LOG_ERROR << "Failed to open database " << getDbPath()
+                  << " as a secondary instance: " << status.ToString();
+        throw runtime_error{"Failed to open database as a secondary instance"};
+    }
+
+    secondary_ = true;
+    last_sequence_ = db_->GetLatestSequenceNumber();
+}
+
+string RocksDbResource::getSecondaryPath() const
+{
+    if (!config_.db_secondary_path.empty()) {
+        return config_.db_secondary_path;
+    }
+
+    filesystem::path p = config_.db_path;
+    p /= format("secondary-{}", getpid());
+    return p.string();
+}
+
+bool RocksDbResource::catchUpWithPrimary()
+{
+    assert(secondary_);
+    assert(db_);
+
+    const auto status = db_->TryCatchUpWithPrimary();
+    if (!status.ok()) {
+        LOG_WARN << "RocksDbResource::catchUpWithPrimary - Failed: " << status.ToString();
+        return false;
+    }
+
+    const auto sequence = db_->GetLatestSequenceNumber();
+    if (sequence == last_sequence_) {
+        return true;
+    }
+
+    LOG_TRACE << "RocksDbResource::catchUpWithPrimary - Sequence changed from "
+              << last_sequence_ << " to " << sequence;
+    last_sequence_ = sequence;
+
+    const auto prev_trx_id = trx_id_.load();
+    loadTrxId();
+
+    if (trx_id_ == prev_trx_id) {
+        if (config_.db_log_transactions) {
+            // Changes that are not in the trxlog don't affect DNS
+            return true;
+        }
+
+        // We have no idea what changed
+        reloadZoneIndex();
+        return true;
+    }
+
+    if (first_retained_trx_id_ > prev_trx_id + 1) {
+        LOG_DEBUG << "RocksDbResource::catchUpWithPrimary - Transactions after #"
+                  << prev_trx_id << " may have been pruned from the trxlog. Reloading the zone index.";
+        reloadZoneIndex();
+        return true;
+    }
+
+    replayTrxLog(prev_trx_id + 1);
+    return true;
+}
+
+void RocksDbResource::replayTrxLog(uint64_t fromTrxId)
+{
+    ZoneIndex::changes_t changes;
+
+    ReadOptions o;
+    o.fill_cache = false;
+    auto it = makeUniqueFrom(db_->NewIterator(o, handle(Category::TRXLOG)));
+    const RealKey from{fromTrxId, RealKey::Class::TRXID};
+    for(it->Seek({from.data(), from.size()}); it->Valid(); it->Next()) {
+        pb::Transaction trx;
+        if (!trx.ParseFromArray(it->value().data(), it->value().size())) {
+            LOG_WARN << "RocksDbResource::replayTrxLog - Failed to deserialize a transaction. "
+                     << "Reloading the zone index.";
+            reloadZoneIndex();
+            return;
+        }
+
+        addEntryChanges(trx, changes);
+    }
+
+    LOG_TRACE << "RocksDbResource::replayTrxLog - Found " << changes.size()
+              << " changed entries from trx #" << fromTrxId;
+
+    if (!changes.empty()) {
+        onEntriesChanged(changes);
+    }
+}
+
+void RocksDbResource::addEntryChanges(const pb::Transaction &trx, ZoneIndex::changes_t &changes)
+{
+    for(const auto& part : trx.parts()) {
+        if (static_cast<size_t>(part.columnfamilyix()) != ENTRY) {
+            continue;
+        }
+
+        const RealKey key{RealKey::Binary{part.key()}};
+        if (part.has_endkey()) {
+            changes.push_back({key.dataAsString(), {},
+                               RealKey{RealKey::Binary{part.endkey()}}.dataAsString()});
+        } else if (part.has_value()) {
+            changes.push_back({key.dataAsString(), ZoneIndex::toKind(part.value())});
+        } else {
+            changes.push_back({key.dataAsString(), {}});
+        }
+    }
+}
+
+void RocksDbResource::reloadZoneIndex()
+{
+    // Make the DNS server use the database while we re-build the index
+    zone_index_.setReady(false);
+    loadZoneIndex();
+
+    // We don't know what changed
+    callEntriesChangedCallback({}, true);
+}
+
+void RocksDbResource::startCatchUpTimer()
+{
+    assert(server_);
+    assert(secondary_);
+
+    if (!catchup_timer_) {
+        catchup_timer_.emplace(server_->ctx());
+    }
+
+    catchup_timer_->expires_from_now(boost::posix_time::milliseconds{config_.db_secondary_catchup_interval});
+    catchup_timer_->async_wait([this](const auto ec) {
+        if (ec) {
+            if (ec == boost::asio::error::operation_aborted) {
+                LOG_TRACE << "RocksDbResource catch-up timer aborted.";
+                return;
+            }
+            LOG_WARN << "RocksDbResource catch-up timer unexpected error: " << ec;
+        } else {
+            try {
+                catchUpWithPrimary();
+            } catch (const exception& ex) {
+                LOG_ERROR << "RocksDbResource catch-up timer: exception from catchUpWithPrimary(): "
+                          << ex.what();
+            }
+        }
+
+        startCatchUpTimer();
+    });
+}
+
+rocksdb::Transaction *RocksDbResource::beginTransaction()
+{
+    if (secondary_) {
+        LOG_WARN << "RocksDbResource::beginTransaction - Cannot write to a secondary instance.";
+        throw InternalErrorException{"Cannot write to a secondary instance", "Database is read-only"};
+    }
+
+    if (optimistic_db_) {
+        // Take a snapshot when the transaction starts, so that the commit
+        // fails if any key we write was changed by someone else after that.
+        // Without it, the keys are only validated from the time they are
+        // written, and read-modify-write sequences could lose updates.
+        OptimisticTransactionOptions options;
+        options.set_snapshot = true;
+        return optimistic_db_->BeginTransaction({}, options);
+    }
+
+    assert(txn_db_);
+    return txn_db_->BeginTransaction({});
 }
 
 bool RocksDbResource::needBootstrap() const
@@ -925,6 +2224,36 @@ void RocksDbResource::loadTrxId()
 {
     trx_id_ = getLastCommittedTransactionId();
     LOG_DEBUG << "RocksDbResource::loadTrxId - trx_id is set to " << trx_id_;
+
+    ReadOptions o;
+    auto it = makeUniqueFrom(db_->NewIterator(o, handle(Category::TRXLOG)));
+    it->SeekToFirst();
+    first_retained_trx_id_ = it->Valid() ? getValueAt<uint64_t>(span_t{it->key()}, 1) : trx_id_ + 1;
+    LOG_DEBUG << "RocksDbResource::loadTrxId - The oldest retained transaction is #"
+              << first_retained_trx_id_;
+}
+
+void RocksDbResource::loadZoneIndex()
+{
+    if (!config_.db_zone_index) {
+        return;
+    }
+
+    LOG_INFO << "RocksDbResource::loadZoneIndex - Loading the zone index...";
+    zone_index_.clear();
+
+    ReadOptions o;
+    o.fill_cache = false;
+    auto it = makeUniqueFrom(db_->NewIterator(o, handle(Category::ENTRY)));
+    for(it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (const auto kind = ZoneIndex::toKind(it->value())) {
+            zone_index_.set(RealKey{RealKey::Binary{it->key()}}.dataAsString(), *kind);
+        }
+    }
+
+    zone_index_.setReady();
+    LOG_INFO << "RocksDbResource::loadZoneIndex - The zone index has "
+             << zone_index_.size() << " zones and delegations.";
 }
 
 std::filesystem::path RocksDbResource::getBackupPath(std::filesystem::path path) const
@@ -1,13 +1,20 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/json.hpp>
 
 #include "nsblast/nsblast.h"
 #include "nsblast/ResourceIf.h"
+#include "nsblast/ZoneIndex.h"
 #include "proto/nsblast.pb.h"
 
 #include "rocksdb/db.h"
+#include "rocksdb/write_batch.h"
 #include "rocksdb/utilities/backup_engine.h"
+#include "rocksdb/utilities/optimistic_transaction_db.h"
 #include "rocksdb/utilities/transaction.h"
 #include "rocksdb/utilities/transaction_db.h"
 
@@ -38,7 +45,9 @@ public:
         // TransactionIf interface
         RrAndSoa lookupEntryAndSoa(std::string_view fqdn) override;
         EntryWithBuffer lookup(std::string_view fqdn) override;
+        std::vector<EntryWithBuffer> lookupBatch(const std::vector<std::string_view>& fqdns) override;
         void iterate(key_t, iterator_fn_t fn, Category category = Category::ENTRY) override;
+        void iterateZone(key_t zoneKey, iterator_fn_t fn) override;
         bool keyExists(key_t key, Category category = Category::ENTRY) override;
         bool exists(std::string_view fqdn, uint16_t type) override;
         void write(key_t key, data_t data, bool isNew, Category category = Category::ENTRY) override;
@@ -47,6 +56,9 @@ public:
         void remove(key_t key, bool recursive, Category category = Category::ENTRY) override;
         void commit() override;
         void rollback() override;
+        void setBulkMode() override;
+        void dropZone(std::string_view fqdn) override;
+        void removeRange(span_t from, span_t to, Category category) override;
         uint64_t replicationId() const noexcept override {
             return replication_id_;
         }
@@ -138,6 +150,7 @@ public:
     private:
         void handleTrxLog();
         void addDeletedToTrxlog(span_t key, Category category);
+        void addEntryChange(key_t key, std::optional<ZoneIndex::Kind> kind, Category category);
         void rollback_();
 
         RocksDbResource& owner_;
@@ -145,19 +158,66 @@ public:
         std::unique_ptr<ROCKSDB_NAMESPACE::Transaction> trx_;
         bool dirty_ = false;
         bool disable_trxlog_ = false;
+        bool bulk_mode_ = false;
         std::unique_ptr<pb::Transaction> trxlog_;
         uint64_t replication_id_ = 0;
+        ZoneIndex::changes_t entry_changes_;
 
         // TransactionIf interface
     public:
     };
 
+    /*! Read-only transaction
+     *
+     *  Reads directly from the database, without the overhead of
+     *  a rocksdb::Transaction. Optionally uses a snapshot to get
+     *  consistent reads.
+     */
+    class ReadTransaction : public ResourceIf::TransactionIf {
+    public:
+        using BufferImpl = Transaction::BufferImpl;
+
+        ReadTransaction(RocksDbResource& owner, bool consistent = false);
+        ~ReadTransaction();
+
+        // TransactionIf interface
+        RrAndSoa lookupEntryAndSoa(std::string_view fqdn) override;
+        EntryWithBuffer lookup(std::string_view fqdn) override;
+        std::vector<EntryWithBuffer> lookupBatch(const std::vector<std::string_view>& fqdns) override;
+        void iterate(key_t, iterator_fn_t fn, Category category = Category::ENTRY) override;
+        void iterateZone(key_t zoneKey, iterator_fn_t fn) override;
+        bool keyExists(key_t key, Category category = Category::ENTRY) override;
+        bool exists(std::string_view fqdn, uint16_t type) override;
+        void write(key_t key, data_t data, bool isNew, Category category = Category::ENTRY) override;
+        read_ptr_t read(key_t key, Category category = Category::ENTRY, bool throwIfNoeExixt = true) override;
+        bool read(key_t key, std::string& buffer, Category category = Category::ENTRY, bool throwIfNoeExixt = true) override;
+        void remove(key_t key, bool recursive, Category category = Category::ENTRY) override;
+        void dropZone(std::string_view fqdn) override;
+        void removeRange(span_t from, span_t to, Category category) override;
+        void commit() override;
+        void rollback() override;
+        uint64_t replicationId() const noexcept override {
+            return 0;
+        }
+
+    private:
+        RocksDbResource& owner_;
+        const rocksdb::Snapshot *snapshot_ = {};
+        rocksdb::ReadOptions options_;
+    };
+
     RocksDbResource(const Config& config); // For unit tests
     RocksDbResource(Server& server); // For use
     ~RocksDbResource();
 
     // ResourceIf interface
     std::unique_ptr<TransactionIf> transaction() override;
+    std::unique_ptr<TransactionIf> readOnlyTransaction(bool consistent = false) override;
+    const ZoneIndex *zoneIndex() const noexcept override;
+    bool available() const noexcept override {
+        return !importing_;
+    }
+    void setEntriesChangedCallback(on_entries_changed_cb_t cb) override;
 
     auto dbTransaction() {
         return std::make_unique<Transaction>(*this);
@@ -182,6 +242,11 @@ public:
         return bootstrapped_;
     }
 
+    /*! True if the database was opened as an OptimisticTransactionDB */
+    bool isOptimistic() const noexcept {
+        return optimistic_db_ != nullptr;
+    }
+
     const auto& config() const noexcept {
         return config_;
     }
@@ -196,6 +261,118 @@ public:
 
     uint64_t getLastCommittedTransactionId();
 
+    /*! Id of the oldest transaction that may still be in the transaction-log.
+     *
+     *  A follower that needs transactions before this id can not catch
+     *  up by replaying the log. It must be bootstrapped again.
+     */
+    uint64_t firstRetainedTrxId() const noexcept {
+        return first_retained_trx_id_;
+    }
+
+    /*! Delete old transactions from the transaction-log.
+     *
+     *  Applies the retention policy from the configuration. Does nothing if
+     *  it was done less than `cluster_trxlog_prune_interval` seconds ago,
+     *  unless `force` is true.
+     *
+     *  \param confirmedTrxId The highest transaction-id that all the
+     *         known followers have confirmed, if known.
+     *  \param force Prune now, regardless of when it was done the last time.
+     *
+     *  \return The number of the last deleted transaction, or 0 if nothing was deleted.
+     */
+    uint64_t pruneTrxLog(std::optional<uint64_t> confirmedTrxId = {}, bool force = false);
+
+    /*! A consistent copy of the zone-data, exported to SST files.
+     *
+     *  Used to bootstrap new followers.
+     */
+    struct Snapshot {
+        /*! The last transaction that is included in the snapshot */
+        uint64_t trxId = 0;
+
+        /*! The serialized transaction-log entry for trxId, if it is still in the log */
+        std::string lastTrx;
+
+        /*! One SST file for each column-family that contains data */
+        std::vector<std::pair<Category, std::filesystem::path>> files;
+    };
+
+    /*! Export the entry, diff and account column-families to SST files.
+     *
+     *  The data is read from one RocksDB snapshot, so the files are
+     *  consistent with `Snapshot::trxId`.
+     *
+     *  \param dir Directory for the files. It is created if it don't exist.
+     *
+     *  \throws std::runtime_error on errors
+     */
+    Snapshot exportSnapshot(const std::filesystem::path& dir);
+
+    /*! Replace the entry, diff and account data with a snapshot from exportSnapshot()
+     *
+     *  The files are moved into the database. The transaction-log is
+     *  replaced with `Snapshot::lastTrx`, so that the transaction-id
+     *  continues from `Snapshot::trxId`.
+     *
+     *  The transaction-log is cleared before the data is replaced, and
+     *  `Snapshot::lastTrx` is written last. If the server crash during the
+     *  import, it starts with transaction-id 0, and bootstraps again.
+     *
+     *  \throws std::runtime_error on errors
+     */
+    void importSnapshot(const Snapshot& snapshot);
+
+    /*! Transactions from the primary, prepared to be written directly to the database.
+     *
+     *  Followers use this to apply replicated transactions without the
+     *  overhead of a database transaction. The replication is the only
+     *  writer to a follower's zone-data, so there is nothing to lock.
+     */
+    struct ReplicatedBatch {
+        rocksdb::WriteBatch batch;
+        ZoneIndex::changes_t changes;
+        uint64_t trxId = 0; // The last transaction in the batch
+    };
+
+    /*! Add a transaction from the primary to a batch
+     *
+     *  The transaction is also added to the transaction-log. This method
+     *  don't access the database, and can be called from any thread.
+     */
+    void prepareReplicated(ReplicatedBatch& batch, const pb::Transaction& trx);
+
+    /*! Write a batch from prepareReplicated() to the database
+     *
+     *  \throws std::runtime_error on errors
+     */
+    void commitReplicated(ReplicatedBatch& batch);
+
+    /*! Copy RocksDB's statistics and properties to the metrics for the server */
+    void updateMetrics();
+
+    /*! Call updateMetrics() every `metrics_rocksdb_interval` seconds */
+    void startMetricsTimer();
+
+    /*! True if the database was opened as a read-only secondary instance */
+    bool isSecondary() const noexcept {
+        return secondary_;
+    }
+
+    /*! Catch up with the primary instance.
+     *
+     *  Only valid for a secondary instance. Updates the zone index and
+     *  notifies the entries-changed callback about the changes the
+     *  primary instance made since the last time.
+     *
+     *  \return false if RocksDB failed to catch up.
+     */
+    bool catchUpWithPrimary();
+
+    /*! Call catchUpWithPrimary() every `db_secondary_catchup_interval` milliseconds */
+    void startCatchUpTimer();
+
     void setTransactionCallback(on_trx_cb_t && cb) {
         assert(!on_trx_cb_);
         on_trx_cb_ = std::move(cb);
@@ -273,26 +450,54 @@ private:
 
     rocksdb::ColumnFamilyHandle * handle(const Category category);
 
-    void preInit();
+    void prepareColumnFamilies();
     void open();
     void bootstrap();
     bool needBootstrap() const;
     std::string getDbPath() const;
     void loadTrxId();
+    void loadZoneIndex();
+    void onEntriesChanged(const ZoneIndex::changes_t& changes);
+    void callEntriesChangedCallback(const ZoneIndex::changes_t& changes, bool zonesChanged);
     std::filesystem::path getBackupPath(std::filesystem::path path) const;
+    rocksdb::Transaction *beginTransaction();
+    void openDb();
+    void openSecondary();
+    std::string getSecondaryPath() const;
+    void replayTrxLog(uint64_t fromTrxId);
+    static void addEntryChanges(const pb::Transaction& trx, ZoneIndex::changes_t& changes);
+    void reloadZoneIndex();
 
     const Config& config_;
-    rocksdb::TransactionDB *db_ = {};
+    rocksdb::DB *db_ = {};
+    rocksdb::TransactionDB *txn_db_ = {};
+    rocksdb::OptimisticTransactionDB *optimistic_db_ = {};
     std::vector<rocksdb::ColumnFamilyDescriptor> cfd_;
     std::vector<rocksdb::ColumnFamilyHandle *> cfh_;
     bool bootstrapped_ = false;
     std::atomic_int transaction_count_{0};
     rocksdb::Options rocksdb_options_;
     std::atomic_uint64_t trx_id_{0};
+    std::atomic_uint64_t first_retained_trx_id_{1};
+    std::chrono::steady_clock::time_point next_trxlog_prune_;
     on_trx_cb_t on_trx_cb_;
     std::weak_ptr<rocksdb::BackupEngine> active_backup_;
     std::optional<std::thread> backup_thread_;
     boost::uuids::uuid active_backup_uuid_;
+    ZoneIndex zone_index_;
+    // Held while committing and applying entry changes, so the zone index
+    // sees the changes in the same order as the database.
+    std::mutex zone_index_commit_mutex_;
+    // Set while importSnapshot() replaces the data
+    std::atomic_bool importing_{false};
+    on_entries_changed_cb_t on_entries_changed_cb_;
+    std::mutex entries_changed_mutex_;
+    std::optional<boost::asio::deadline_timer> metrics_timer_;
+    bool secondary_ = false;
+    // The default secondary path, that we delete when we close the database
+    std::string tmp_secondary_path_;
+    uint64_t last_sequence_ = 0;
+    std::optional<boost::asio::deadline_timer> catchup_timer_;
 
     yahat::Metrics::Counter<double> *backup_already_running_{};
     yahat::Metrics::Counter<double> *backups_ok{};
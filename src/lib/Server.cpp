@@ -182,6 +182,16 @@ void Server::start()
 {
     LOG_DEBUG_N << "Starting Rocksdb...";
     startRocksDb();
+    if (!config_.disable_metrics) {
+        db().updateMetrics();
+        db().startMetricsTimer();
+    }
+
+    if (config_.db_secondary) {
+        startSecondary();
+        return;
+    }
+
     LOG_DEBUG_N << "Starting Auth...";
     startAuth();
 
@@ -221,6 +231,23 @@ void Server::start()
     runWorker("main thread");
 }
 
+void Server::startSecondary()
+{
+    LOG_INFO << "Running as a DNS-only server on a secondary database instance. "
+             << "HTTP, the REST API, replication and backups are disabled.";
+
+    LOG_DEBUG_N << "Starting IO threads...";
+    startIoThreads();
+
+    LOG_DEBUG_N << "Starting Dns...";
+    startDns();
+
+    db().startCatchUpTimer();
+
+    LOG_DEBUG_N << "Main thread joining the thread-pool...";
+    runWorker("main thread");
+}
+
 void Server::resetAuth()
 {
     startRocksDb();
@@ -254,7 +281,17 @@ void Server::startRocksDb(bool init)
 void Server::startIoThreads()
 {
     handleSignals();
-    for(size_t i = 1; i < config().num_dns_threads; ++i) {
+
+    auto num_threads = config().num_dns_threads;
+#ifdef SO_REUSEPORT
+    if (config().dns_reuseport_workers) {
+        // The DNS workers have their own threads. The shared pool
+        // only handles the other work, like timers, HTTP and replication.
+        num_threads = min<size_t>(num_threads, 2);
+    }
+#endif
+
+    for(size_t i = 1; i < num_threads; ++i) {
         workers_.emplace_back([this, i] {
             runWorker("worker thread #"s + to_string(i));
         });
@@ -345,6 +382,13 @@ void Server::initReplication()
     } else if (config_.cluster_role == "follower") {
         role_ = Role::CLUSTER_FOLLOWER;
     }
+
+    if (config_.cluster_sync_compression != "none"
+        && config_.cluster_sync_compression != "lz4") {
+        LOG_ERROR << "Server::initReplication - Unknown cluster-sync-compression: "
+                  << config_.cluster_sync_compression;
+        throw runtime_error{"Unknown cluster-sync-compression"};
+    }
 }
 
 void Server::StartReplication()
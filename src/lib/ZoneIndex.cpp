@@ -0,0 +1,125 @@
+
+#include <algorithm>
+
+#include "nsblast/ZoneIndex.h"
+#include "nsblast/util.h"
+#include "nsblast/logging.h"
+
+using namespace std;
+
+namespace nsblast::lib {
+
+optional<ZoneIndex::Kind> ZoneIndex::toKind(span_t entry) noexcept
+{
+    if (entry.size() < sizeof(StorageTypes::Header)) {
+        return {};
+    }
+
+    const auto& hdr = *reinterpret_cast<const StorageTypes::Header *>(entry.data());
+    if (hdr.flags.soa) {
+        return Kind::ZONE;
+    }
+
+    if (hdr.flags.ns) {
+        return Kind::CUT;
+    }
+
+    return {};
+}
+
+void ZoneIndex::set(string_view fqdn, Kind kind)
+{
+    unique_lock lock{mutex_};
+    index_.insert_or_assign(string{fqdn}, kind);
+}
+
+void ZoneIndex::erase(string_view fqdn)
+{
+    unique_lock lock{mutex_};
+    if (auto it = index_.find(fqdn); it != index_.end()) {
+        index_.erase(it);
+    }
+}
+
+bool ZoneIndex::apply(const changes_t &changes)
+{
+    bool changed = false;
+    if (changes.empty()) {
+        return changed;
+    }
+
+    unique_lock lock{mutex_};
+    for(const auto& change : changes) {
+        if (change.end) {
+            assert(!change.kind);
+            // Compare from the end, like the reversed keys in the database
+            const auto before = [](string_view a, string_view b) {
+                return lexicographical_compare(a.rbegin(), a.rend(), b.rbegin(), b.rend());
+            };
+            const auto erased = boost::unordered::erase_if(index_, [&](const auto& v) {
+                return !before(v.first, change.fqdn) && before(v.first, *change.end);
+            });
+            LOG_TRACE << "ZoneIndex::apply - Removed " << erased
+                      << " entries in the range " << change.fqdn
+                      << " - " << *change.end;
+
+            // The caller can't know what names were affected.
+            changed = true;
+            continue;
+        }
+
+        auto it = index_.find(change.fqdn);
+        if (change.kind) {
+            if (it == index_.end()) {
+                index_.emplace(change.fqdn, *change.kind);
+                changed = true;
+            } else if (it->second != *change.kind) {
+                it->second = *change.kind;
+                changed = true;
+            }
+        } else if (it != index_.end()) {
+            index_.erase(it);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+ZoneIndex::Match ZoneIndex::findClosest(string_view fqdn) const
+{
+    Match match;
+
+    shared_lock lock{mutex_};
+    for(span_t key = fqdn; !key.empty(); key = getNextKey(key)) {
+        const string_view name{key.data(), key.size()};
+        if (auto it = index_.find(name); it != index_.end()) {
+            if (it->second == Kind::ZONE) {
+                match.zone = name;
+                return match;
+            }
+
+            // The top-most cut below the zone is the one that matters.
+            // Anything below it is occluded data.
+            match.cut = name;
+        }
+    }
+
+    // Not inside any of our zones
+    match.cut = {};
+    return match;
+}
+
+size_t ZoneIndex::size() const
+{
+    shared_lock lock{mutex_};
+    return index_.size();
+}
+
+void ZoneIndex::clear()
+{
+    unique_lock lock{mutex_};
+    index_.clear();
+}
+
+} // ns
@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <atomic>
 #include <random>
 #include <regex>
 
@@ -37,6 +38,23 @@ boost::uuids::uuid newUuid()
     return uuid_gen_();
 }
 
+uint64_t newRequestId() noexcept
+{
+    // Each thread reserves a block of ids from the global counter, so the
+    // shared atomic is only touched once for every `block_size` ids.
+    constexpr uint64_t block_size = 1 << 16;
+    static atomic_uint64_t next_block{1};
+    thread_local uint64_t next = 0;
+    thread_local uint64_t end = 0;
+
+    if (next == end) [[unlikely]] {
+        next = next_block.fetch_add(block_size, memory_order_relaxed);
+        end = next + block_size;
+    }
+
+    return next++;
+}
+
 FqdnKey labelsToFqdnKey(const Labels &labels) {
     return toFqdnKey(labels.string());
 }
@@ -61,6 +61,21 @@ int main(int argc, char* argv[]) {
         ("db-path,d",
             po::value<string>(&config.db_path)->default_value(config.db_path),
             "Path to the database directory")
+        ("db-zone-index",
+            po::value(&config.db_zone_index)->default_value(config.db_zone_index),
+            "Keep an in-memory index of all zones and delegations, to avoid database lookups "
+            "when the DNS server looks for the zone for a name.")
+        ("db-secondary",
+            po::value(&config.db_secondary)->default_value(config.db_secondary),
+            "Open the database as a read-only secondary instance and serve DNS only. "
+            "The primary instance must be a normal nsblast server running on the same host.")
+        ("db-secondary-path",
+            po::value(&config.db_secondary_path)->default_value(config.db_secondary_path),
+            "Directory for the secondary instance's own files. Defaults to db-path/secondary-<pid>, "
+            "which is deleted on shutdown.")
+        ("db-secondary-catchup-interval",
+            po::value(&config.db_secondary_catchup_interval)->default_value(config.db_secondary_catchup_interval),
+            "Milliseconds between each time a secondary instance catches up with the primary.")
         ("log-to-console,C",
              po::value<string>(&log_level_console)->default_value(log_level_console),
              "Log-level to the console; one of 'info', 'debug', 'trace'. Empty string to disable.")
@@ -95,6 +110,9 @@ int main(int argc, char* argv[]) {
         ("sync-before-backup",
          po::value(&config.sync_before_backup)->default_value(config.sync_before_backup),
          "Tells RocksDB to sync the database before starting a backup")
+        ("backup-rate-limit",
+         po::value(&config.backup_rate_limit)->default_value(config.backup_rate_limit),
+         "Max bytes per second written by a backup. 0 == no limit.")
         ("restore-backup",
          po::value(&restore_backup_id),
          "This option will attempt to restore backup id# to the database directory and "
@@ -134,6 +152,39 @@ int main(int argc, char* argv[]) {
         ("cluster-repl-agent-queue-size",
              po::value(&config.cluster_repl_agent_max_queue_size)->default_value(config.cluster_repl_agent_max_queue_size),
              "The number of transactions that can be queued for a follower before the follower is regarded as not being up to date.")
+        ("cluster-trxlog-retention-count",
+             po::value(&config.cluster_trxlog_retention_count)->default_value(config.cluster_trxlog_retention_count),
+             "Max number of transactions to keep in the transaction-log. 0 == no limit.")
+        ("cluster-trxlog-retention-age",
+             po::value(&config.cluster_trxlog_retention_age)->default_value(config.cluster_trxlog_retention_age),
+             "Max age in seconds for transactions in the transaction-log. 0 == no limit.")
+        ("cluster-trxlog-prune-confirmed",
+             po::value(&config.cluster_trxlog_prune_confirmed)->default_value(config.cluster_trxlog_prune_confirmed),
+             "Delete transactions from the transaction-log when all the connected followers have confirmed them. "
+             "Followers that are not connected are not considered, and may have to be bootstrapped again.")
+        ("cluster-trxlog-prune-interval",
+             po::value(&config.cluster_trxlog_prune_interval)->default_value(config.cluster_trxlog_prune_interval),
+             "Seconds between each time the retention policy for the transaction-log is enforced.")
+        ("cluster-sync-batch-max-bytes",
+             po::value(&config.cluster_sync_batch_max_bytes)->default_value(config.cluster_sync_batch_max_bytes),
+             "Max size in bytes of the transactions the primary sends to a follower in one message. 0 == one transaction per message.")
+        ("cluster-sync-batch-max-delay",
+             po::value(&config.cluster_sync_batch_max_delay)->default_value(config.cluster_sync_batch_max_delay),
+             "Milliseconds the primary may wait for more transactions to fill a batch. 0 == don't wait.")
+        ("cluster-follower-bootstrap",
+             po::value(&config.cluster_follower_bootstrap)->default_value(config.cluster_follower_bootstrap),
+             "Let a new follower, or a follower that has fallen too far behind, "
+             "bootstrap from a snapshot of the primary's database.")
+        ("cluster-sync-compression",
+             po::value(&config.cluster_sync_compression)->default_value(config.cluster_sync_compression),
+             "Compression of the updates the primary sends to the followers. One of: none, lz4")
+        ("cluster-sync-compression-min-bytes",
+             po::value(&config.cluster_sync_compression_min_bytes)->default_value(config.cluster_sync_compression_min_bytes),
+             "Updates smaller than this number of bytes are sent uncompressed.")
+        ("cluster-follower-apply-queue-size",
+             po::value(&config.cluster_follower_apply_queue_size)->default_value(config.cluster_follower_apply_queue_size),
+             "Max number of updates from the primary a follower prepares in parallel or waits to commit. "
+             "0 == apply each update in a database transaction when it is received.")
         ;
 
     po::options_description http("HTTP/API server");
@@ -147,11 +198,17 @@ int main(int argc, char* argv[]) {
          "Enable the '/swagger' endpoint to interactively explore the REST API")
 #endif
         ("disable-metrics",
-         po::bool_switch(&config.disable_http),
+         po::bool_switch(&config.disable_metrics),
          "Disables the /metrics endpoint.")
         ("disable-metrics-auth",
          po::bool_switch(&config.no_metrics_auth),
          "Disables authentication for the /metrics endpoint.")
+        ("metrics-rocksdb-interval",
+         po::value(&config.metrics_rocksdb_interval)->default_value(config.metrics_rocksdb_interval),
+         "Seconds between each update of the metrics we get from RocksDB. 0 == disabled.")
+        ("metrics-dns-perf-sample-rate",
+         po::value(&config.metrics_dns_perf_sample_rate)->default_value(config.metrics_dns_perf_sample_rate),
+         "Sample RocksDB's PerfContext for one in this many UDP DNS requests. 0 == disabled.")
 #ifdef NSBLAST_WITH_UI
             ("with-ui",
              po::bool_switch(&config.ui),
@@ -172,6 +229,12 @@ int main(int argc, char* argv[]) {
         ("http-num-threads",
             po::value<size_t>(&config.http.num_http_threads)->default_value(config.http.num_http_threads),
             "Threads for the embedded HTTP server")
+        ("http-import-batch-size",
+            po::value<size_t>(&config.rest_import_batch_size)->default_value(config.rest_import_batch_size),
+            "Max number of entries to write in each database transaction during a bulk zone import")
+        ("http-write-retries",
+            po::value(&config.rest_write_retries)->default_value(config.rest_write_retries),
+            "Number of times to retry a REST write request that conflicts with a concurrent transaction")
         ;
 
     po::options_description odns("DNS server");
@@ -188,9 +251,26 @@ int main(int argc, char* argv[]) {
         ("dns-tcp-idle-time",
             po::value<uint32_t>(&config.dns_tcp_idle_time)->default_value(config.dns_tcp_idle_time),
             "Idle-time in seconds for TCP sessions for the DNS protocol")
+        ("dns-tcp-max-inflight",
+            po::value<uint32_t>(&config.dns_tcp_max_inflight)->default_value(config.dns_tcp_max_inflight),
+            "Max number of requests processed in parallel on one DNS TCP connection")
+        ("dns-tcp-max-queued-bytes",
+            po::value<size_t>(&config.dns_tcp_max_queued_bytes)->default_value(config.dns_tcp_max_queued_bytes),
+            "Max bytes of replies waiting to be sent on one DNS TCP connection. 0 disables the limit.")
         ("dns-num-threads",
             po::value<size_t>(&config.num_dns_threads)->default_value(config.num_dns_threads),
             "Threads for the DNS server")
+        ("dns-udp-batch-size",
+            po::value<size_t>(&config.dns_udp_batch_size)->default_value(config.dns_udp_batch_size),
+            "Max number of UDP datagrams to receive and send per system-call (recvmmsg/sendmmsg). "
+            "0 disables batching. Linux only.")
+        ("dns-reuseport-workers",
+            po::value<bool>(&config.dns_reuseport_workers)->default_value(config.dns_reuseport_workers),
+            "Run dns-num-threads DNS workers, each with it's own io_context and SO_REUSEPORT sockets. "
+            "The shared thread-pool is then limited to two threads.")
+        ("dns-pin-workers",
+            po::value<bool>(&config.dns_pin_workers)->default_value(config.dns_pin_workers),
+            "Pin each DNS worker to a CPU core. Requires dns-reuseport-workers. Linux only.")
         ("dns-enable-notify",
             po::value<bool>(&config.dns_enable_notify)->default_value(config.dns_enable_notify),
             "A master server sens DNS NOTIFY messages to slave servers when a zone is changed.")
@@ -198,9 +278,21 @@ int main(int argc, char* argv[]) {
          po::value<bool>(&config.dns_enable_ixfr)->default_value(config.dns_enable_ixfr),
          "Enable IXFR from a master server to it's slaves. This adds aome extra data in the database "
          "for each change that is made to a zone.")
+        ("dns-ixfr-max-diffs",
+         po::value(&config.dns_ixfr_max_diffs)->default_value(config.dns_ixfr_max_diffs),
+         "Max number of IXFR diff's to keep for each zone. Older diff's are deleted. 0 == no limit.")
+        ("dns-ixfr-max-diff-bytes",
+         po::value(&config.dns_ixfr_max_diff_bytes)->default_value(config.dns_ixfr_max_diff_bytes),
+         "Max total size in bytes of the IXFR diff's to keep for each zone. 0 == no limit.")
         ("dns-notify-port",
             po::value<uint16_t>(&config.dns_notify_to_port)->default_value(config.dns_notify_to_port),
            "Port number to send NOTIFY messages to when a zone change")
+        ("dns-answer-cache-size",
+            po::value<size_t>(&config.dns_answer_cache_size)->default_value(config.dns_answer_cache_size),
+            "Max number of rendered replies to cache. 0 disables the cache.")
+        ("dns-answer-cache-shards",
+            po::value<size_t>(&config.dns_answer_cache_shards)->default_value(config.dns_answer_cache_shards),
+            "Number of shards (locks) in the answer cache.")
         ("default-nameserver",
           po::value(&config.default_name_servers),
           "Default name-servers to use for new zones. The first definition will be used as the primary."
@@ -218,6 +310,33 @@ int main(int argc, char* argv[]) {
         ("rocksdb-background-threads",
          po::value(&config.rocksdb_background_threads)->default_value(config.rocksdb_background_threads),
          "Number of threads for flush and compaction. 0 == use default.")
+        ("rocksdb-block-cache-size",
+         po::value(&config.rocksdb_block_cache_size)->default_value(config.rocksdb_block_cache_size),
+         "Size of the block cache shared by all the column families. 0 == use RocksDB's default.")
+        ("rocksdb-block-cache-type",
+         po::value(&config.rocksdb_block_cache_type)->default_value(config.rocksdb_block_cache_type),
+         "Type of block cache. One of: lru, hyperclock")
+        ("rocksdb-entry-bloom-bits",
+         po::value(&config.rocksdb_entry_bloom_bits)->default_value(config.rocksdb_entry_bloom_bits),
+         "Bits per key for the bloom filter for DNS entries. 0 == no filter.")
+        ("rocksdb-diff-prefix-bloom",
+         po::value(&config.rocksdb_diff_prefix_bloom)->default_value(config.rocksdb_diff_prefix_bloom),
+         "Use a bloom filter on the fqdn-prefix of the IXFR diff's.")
+        ("rocksdb-statistics",
+         po::value(&config.rocksdb_statistics)->default_value(config.rocksdb_statistics),
+         "Collect internal statistics in RocksDB, and export them to /metrics.")
+        ("rocksdb-transaction-db",
+         po::value(&config.rocksdb_transaction_db)->default_value(config.rocksdb_transaction_db),
+         "Type of transaction database. One of: pessimistic, optimistic")
+        ("rocksdb-rate-limit",
+         po::value(&config.rocksdb_rate_limit)->default_value(config.rocksdb_rate_limit),
+         "Max bytes per second for flush and compaction I/O. 0 == no limit.")
+        ("rocksdb-rate-limit-auto-tune",
+         po::value(&config.rocksdb_rate_limit_auto_tune)->default_value(config.rocksdb_rate_limit_auto_tune),
+         "Let RocksDB adjust the rate limit to the actual need, with rocksdb-rate-limit as the upper bound.")
+        ("rocksdb-bulk-readahead-size",
+         po::value(&config.rocksdb_bulk_readahead_size)->default_value(config.rocksdb_bulk_readahead_size),
+         "Readahead size in bytes for bulk reads, like zone transfers. 0 == use RocksDB's default.")
         ;
 
     po::options_description cg("Certificate Generator");
@@ -168,6 +168,11 @@ public:
 
     const std::string default_role_name = "default";
 
+    // Threads in the shared thread-pool, in addition to the callers thread
+    size_t numIoThreads() const noexcept {
+        return workers_.size();
+    }
+
     auto& operator -> () {
         return db_;
     }
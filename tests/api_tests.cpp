@@ -711,6 +711,33 @@ TEST(ApiRequest, onZoneExists) {
     }
 }
 
+TEST(ApiRequest, onZoneInvalidQuorum) {
+
+    MockServer svr;
+    {
+        auto json = getZoneJson();
+        auto req = makeRequest(svr, "zone", "example.com", boost::json::serialize(json), yahat::Request::Type::POST);
+        req.arguments["wait"] = "1";
+
+        RestApi api{svr};
+        auto parsed = api.parse(req);
+
+        for(const auto *quorum : {"many", "0", "256", "2x", ""}) {
+            req.arguments["quorum"] = quorum;
+            try {
+                api.onZone(req, parsed);
+                ADD_FAILURE() << "Expected a 400 response for quorum=" << quorum;
+            } catch(const yahat::Response& res) {
+                EXPECT_EQ(res.code, 400);
+            }
+        }
+
+        // The zone must not be created when the request is rejected
+        auto trx = svr.db().transaction();
+        EXPECT_FALSE(trx->zoneExists("example.com"));
+    }
+}
+
 TEST(ApiRequest, postRrWithSoa) {
     const string_view fqdn{"example.com"};
 
@@ -1392,6 +1419,268 @@ TEST(ApiRequest, diffCreatedForDeleteChild) {
     }
 }
 
+TEST(ApiRequest, diffWindowIsEnforced) {
+    const string_view fqdn{"www.example.com"};
+    const string_view soa_fqdn{"example.com"};
+
+    MockServer svr;
+    {
+        svr->config().dns_enable_ixfr = true;
+        svr->config().dns_ixfr_max_diffs = 2;
+        svr->createTestZone();
+
+        RestApi api{svr};
+        for(auto i = 0; i < 4; ++i) {
+            auto req = makeRequest(svr, "rr", fqdn, getAJson(), yahat::Request::Type::PUT);
+            auto parsed = api.parse(req);
+            auto res = api.onResourceRecord(req, parsed);
+            EXPECT_LT(res.code, 300);
+        }
+
+        EXPECT_EQ(getSoaSerial(soa_fqdn, svr->resource()), DEFAULT_SOA_SERIAL + 4);
+
+        auto trx = svr->resource().transaction();
+        for(uint32_t serial = DEFAULT_SOA_SERIAL + 1; serial <= DEFAULT_SOA_SERIAL + 4; ++serial) {
+            const ResourceIf::RealKey key{soa_fqdn, serial, ResourceIf::RealKey::Class::DIFF};
+            EXPECT_EQ(trx->keyExists(key, ResourceIf::Category::DIFF), serial > DEFAULT_SOA_SERIAL + 2);
+        }
+    }
+}
+
+TEST(ApiRequest, diffWindowUsesSerialArithmetic) {
+    const string_view fqdn{"www.example.com"};
+    const string_view soa_fqdn{"example.com"};
+
+    MockServer svr;
+    {
+        svr->config().dns_enable_ixfr = true;
+        svr->config().dns_ixfr_max_diffs = 2;
+        svr->createTestZone();
+
+        // Diff's from before the serial wrapped around, and from before we kept an index.
+        const array<uint32_t, 3> old_serials = {4294967290u, 4294967295u, 10u};
+        {
+            auto trx = svr->resource().transaction();
+            for(const auto serial : old_serials) {
+                trx->write({soa_fqdn, serial, key_class_t::DIFF}, "diff"s, true, ResourceIf::Category::DIFF);
+            }
+            trx->commit();
+        }
+
+        RestApi api{svr};
+        auto req = makeRequest(svr, "rr", fqdn, getAJson(), yahat::Request::Type::PUT);
+        auto parsed = api.parse(req);
+        auto res = api.onResourceRecord(req, parsed);
+        EXPECT_LT(res.code, 300);
+
+        const auto serial = getSoaSerial(soa_fqdn, svr->resource());
+        EXPECT_EQ(serial, DEFAULT_SOA_SERIAL + 1);
+
+        auto trx = svr->resource().transaction();
+        EXPECT_FALSE(trx->keyExists({soa_fqdn, old_serials[0], key_class_t::DIFF}, ResourceIf::Category::DIFF));
+        EXPECT_FALSE(trx->keyExists({soa_fqdn, old_serials[1], key_class_t::DIFF}, ResourceIf::Category::DIFF));
+        EXPECT_TRUE(trx->keyExists({soa_fqdn, old_serials[2], key_class_t::DIFF}, ResourceIf::Category::DIFF));
+        EXPECT_TRUE(trx->keyExists({soa_fqdn, serial, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+
+        string buffer;
+        EXPECT_TRUE(trx->read({soa_fqdn, key_class_t::DIFF_INDEX}, buffer, ResourceIf::Category::DIFF, false));
+        pb::DiffIndex index;
+        EXPECT_TRUE(index.ParseFromString(buffer));
+        ASSERT_EQ(index.diffs_size(), 2);
+        EXPECT_EQ(index.diffs(0).serial(), old_serials[2]);
+        EXPECT_EQ(index.diffs(0).size(), 4);
+        EXPECT_EQ(index.diffs(1).serial(), serial);
+    }
+}
+
+TEST(ApiRequest, diffWindowByteLimitUsesStoredSizes) {
+    const string_view fqdn{"www.example.com"};
+    const string_view soa_fqdn{"example.com"};
+
+    MockServer svr;
+    {
+        svr->config().dns_enable_ixfr = true;
+        svr->config().dns_ixfr_max_diffs = 0;
+        svr->config().dns_ixfr_max_diff_bytes = 1;
+        svr->createTestZone();
+
+        RestApi api{svr};
+        for(auto i = 0; i < 3; ++i) {
+            auto req = makeRequest(svr, "rr", fqdn, getAJson(), yahat::Request::Type::PUT);
+            auto parsed = api.parse(req);
+            auto res = api.onResourceRecord(req, parsed);
+            EXPECT_LT(res.code, 300);
+        }
+
+        const auto serial = getSoaSerial(soa_fqdn, svr->resource());
+        EXPECT_EQ(serial, DEFAULT_SOA_SERIAL + 3);
+
+        // Only the newest diff is kept
+        auto trx = svr->resource().transaction();
+        string diff;
+        EXPECT_TRUE(trx->read({soa_fqdn, serial, key_class_t::DIFF}, diff, ResourceIf::Category::DIFF, false));
+        EXPECT_FALSE(trx->keyExists({soa_fqdn, serial - 1, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+
+        string buffer;
+        EXPECT_TRUE(trx->read({soa_fqdn, key_class_t::DIFF_INDEX}, buffer, ResourceIf::Category::DIFF, false));
+        pb::DiffIndex index;
+        EXPECT_TRUE(index.ParseFromString(buffer));
+        ASSERT_EQ(index.diffs_size(), 1);
+        EXPECT_EQ(index.diffs(0).serial(), serial);
+        EXPECT_EQ(index.diffs(0).size(), diff.size());
+    }
+}
+
+TEST(ApiRequest, importEntriesIntoZone) {
+    const string_view soa_fqdn{"example.com"};
+
+    MockServer svr;
+    {
+        svr->config().dns_enable_ixfr = true;
+        svr->config().rest_import_batch_size = 2;
+        svr->createTestZone();
+
+        RestApi api{svr};
+
+        // Create a diff, so we can check that the import removes it
+        {
+            auto req = makeRequest(svr, "rr", "www.example.com", getAJson(), yahat::Request::Type::POST);
+            auto parsed = api.parse(req);
+            auto res = api.onResourceRecord(req, parsed);
+            EXPECT_EQ(res.code, 201);
+            EXPECT_EQ(getSoaSerial(soa_fqdn, svr->resource()), DEFAULT_SOA_SERIAL + 1);
+        }
+
+        const string body = R"({"fqdn": "a.example.com", "a": ["127.0.0.1"]}
+{"fqdn": "B.example.com", "a": ["127.0.0.2"], "txt": ["teste"]}
+
+{"fqdn": "www.example.com", "aaaa": ["2001:db8::1"]}
+)";
+
+        auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+        auto res = api.onReqest(req);
+        EXPECT_EQ(res.code, 200);
+
+        auto json = boost::json::parse(res.body);
+        EXPECT_EQ(json.at("value").at("entries").to_number<int64_t>(), 3);
+        EXPECT_EQ(json.at("value").at("batches").to_number<int64_t>(), 2);
+
+        // Only one serial increment for the entire import
+        EXPECT_EQ(getSoaSerial(soa_fqdn, svr->resource()), DEFAULT_SOA_SERIAL + 2);
+
+        EXPECT_FALSE(lookup("a.example.com", svr->resource()).empty());
+        EXPECT_EQ(lookup("b.example.com", svr->resource()).count(), 2);
+
+        // The entry is replaced
+        auto www = lookup("www.example.com", svr->resource());
+        EXPECT_EQ(www.count(), 1);
+        EXPECT_EQ(www.begin()->type(), TYPE_AAAA);
+
+        // No diff's
+        auto trx = svr->resource().transaction();
+        const ResourceIf::RealKey key{soa_fqdn, DEFAULT_SOA_SERIAL + 1, ResourceIf::RealKey::Class::DIFF};
+        EXPECT_FALSE(trx->keyExists(key, ResourceIf::Category::DIFF));
+        const ResourceIf::RealKey import_key{soa_fqdn, DEFAULT_SOA_SERIAL + 2, ResourceIf::RealKey::Class::DIFF};
+        EXPECT_FALSE(trx->keyExists(import_key, ResourceIf::Category::DIFF));
+    }
+}
+
+TEST(ApiRequest, importEntriesOutsideZoneFails) {
+    MockServer svr;
+    svr->createTestZone();
+
+    RestApi api{svr};
+    const string body = R"({"fqdn": "www.otherexample.com", "a": ["127.0.0.1"]})";
+    auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+    EXPECT_THROW(api.onReqest(req), yahat::Response);
+    EXPECT_TRUE(lookup("www.otherexample.com", svr->resource()).empty());
+    EXPECT_EQ(getSoaSerial("example.com", svr->resource()), DEFAULT_SOA_SERIAL);
+}
+
+TEST(ApiRequest, importWithErrorCommitsNothing) {
+    MockServer svr;
+    svr->config().rest_import_batch_size = 1;
+    svr->createTestZone();
+
+    RestApi api{svr};
+
+    // The error is after several full batches
+    const string body = R"({"fqdn": "a.example.com", "a": ["127.0.0.1"]}
+{"fqdn": "b.example.com", "a": ["127.0.0.2"]}
+{"fqdn": "c.example.com", "a": ["127.0.0.3"]}
+{"fqdn": "d.example.com", "a": ["127.0.0.4"]
+)";
+    auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+    EXPECT_THROW(api.onReqest(req), yahat::Response);
+    EXPECT_TRUE(lookup("a.example.com", svr->resource()).empty());
+    EXPECT_TRUE(lookup("c.example.com", svr->resource()).empty());
+    EXPECT_EQ(getSoaSerial("example.com", svr->resource()), DEFAULT_SOA_SERIAL);
+}
+
+TEST(ApiRequest, importSrvTargetInTheImport) {
+    MockServer svr;
+    svr->config().dns_validate_srv_targets_locally = true;
+    svr->createTestZone();
+
+    RestApi api{svr};
+
+    {
+        // The target comes later in the import
+        const string body = R"({"fqdn": "_sip._tcp.example.com", "srv": [{"priority": 1, "weight": 1, "port": 5060, "target": "sip.example.com"}]}
+{"fqdn": "sip.example.com", "a": ["127.0.0.1"]}
+)";
+        auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+        auto res = api.onReqest(req);
+        EXPECT_EQ(res.code, 200);
+        EXPECT_FALSE(lookup("_sip._tcp.example.com", svr->resource()).empty());
+    }
+
+    {
+        // The import replaces the target with an entry without address records
+        const string body = R"({"fqdn": "_xmpp._tcp.example.com", "srv": [{"priority": 1, "weight": 1, "port": 5222, "target": "sip.example.com"}]}
+{"fqdn": "sip.example.com", "txt": ["no address"]}
+)";
+        auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+        EXPECT_THROW(api.onReqest(req), yahat::Response);
+        EXPECT_TRUE(lookup("_xmpp._tcp.example.com", svr->resource()).empty());
+    }
+}
+
+TEST(ApiRequest, importIntoChildZoneFails) {
+    MockServer svr;
+    svr->createTestZone();
+
+    // A child zone, owned by another tenant
+    const auto other_tenant = newUuid();
+    svr->createTestZone("sub.example.com", other_tenant);
+
+    RestApi api{svr};
+
+    for(const string body : {R"({"fqdn": "sub.example.com", "a": ["127.0.0.1"]})",
+                             R"({"fqdn": "www.sub.example.com", "a": ["127.0.0.1"]})"}) {
+        auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+        EXPECT_THROW(api.onReqest(req), yahat::Response);
+    }
+
+    // The child zone is intact
+    auto sub = lookup("sub.example.com", svr->resource());
+    EXPECT_TRUE(sub.flags().soa);
+    ASSERT_TRUE(sub.tenantId());
+    EXPECT_EQ(*sub.tenantId(), other_tenant);
+    EXPECT_TRUE(lookup("www.sub.example.com", svr->resource()).empty());
+    EXPECT_EQ(getSoaSerial("example.com", svr->resource()), DEFAULT_SOA_SERIAL);
+
+    // Repeated lines for the same name are one entry
+    const string body = R"({"fqdn": "a.example.com", "a": ["127.0.0.1"]}
+{"fqdn": "A.example.com", "a": ["127.0.0.2"]}
+)";
+    auto req = makeRequest(svr, "zone", "example.com/import", body, yahat::Request::Type::POST);
+    auto res = api.onReqest(req);
+    EXPECT_EQ(res.code, 200);
+    auto json = boost::json::parse(res.body);
+    EXPECT_EQ(json.at("value").at("entries").to_number<int64_t>(), 1);
+}
+
 TEST(ApiRequest, createTenant) {
     MockServer svr;
 
@@ -1,9 +1,16 @@
+#include <format>
+#include <thread>
 
+#include <unistd.h>
+
+#include "rocksdb/perf_context.h"
 #include "gtest/gtest.h"
 
 #include "TmpDb.h"
+#include "Metrics.h"
 
 #include "nsblast/DnsMessages.h"
+#include "nsblast/ZoneIndex.h"
 #include "nsblast/errors.h"
 
 using namespace std;
@@ -109,6 +116,119 @@ TEST(DbDeleteZone, nonexisting) {
     }
 }
 
+TEST(DbDeleteZone, dropZone) {
+    TmpDb db;
+
+    db.createTestZone();
+    db.createWwwA();
+    db.createTestZone("bexample.com");
+    db.createTestZone("x-example.com");
+
+    {
+        StorageBuilder sb;
+        sb.createNs("sub.example.com", 1000, "ns1.sub.example.com");
+        sb.setZoneLen(11);
+        sb.finish();
+
+        auto tx = db->transaction();
+        tx->write({"sub.example.com"sv, key_class_t::ENTRY}, sb.buffer(), true);
+        tx->write({"a.b.example.com"sv, key_class_t::ENTRY}, sb.buffer(), true);
+        tx->write({"example.com"sv, 1001, key_class_t::DIFF}, "diff"s, true, ResourceIf::Category::DIFF);
+        tx->write({"example.com"sv, 1002, key_class_t::DIFF}, "diff"s, true, ResourceIf::Category::DIFF);
+        tx->write({"bexample.com"sv, 1001, key_class_t::DIFF}, "diff"s, true, ResourceIf::Category::DIFF);
+        tx->commit();
+    }
+
+    EXPECT_EQ(db->zoneIndex()->size(), 5);
+
+    {
+        auto tx = db->transaction();
+        tx->dropZone("example.com");
+        tx->commit();
+    }
+
+    {
+        auto tx = db->transaction();
+        EXPECT_FALSE(tx->lookup("example.com"));
+        EXPECT_FALSE(tx->lookup("www.example.com"));
+        EXPECT_FALSE(tx->lookup("sub.example.com"));
+        EXPECT_FALSE(tx->lookup("a.b.example.com"));
+        EXPECT_FALSE(tx->keyExists({"example.com"sv, 1001, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+        EXPECT_FALSE(tx->keyExists({"example.com"sv, 1002, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+
+        // Other zones must not be affected
+        EXPECT_TRUE(tx->lookup("bexample.com"));
+        EXPECT_TRUE(tx->lookup("x-example.com"));
+        EXPECT_TRUE(tx->keyExists({"bexample.com"sv, 1001, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+    }
+
+    EXPECT_EQ(db->zoneIndex()->size(), 2);
+    EXPECT_TRUE(db->zoneIndex()->findClosest("www.sub.example.com").zone.empty());
+    EXPECT_EQ(db->zoneIndex()->findClosest("www.bexample.com").zone, "bexample.com");
+
+    // The names below the zone are replicated as one range-delete
+    {
+        auto tx = db->transaction();
+        string val;
+        ASSERT_TRUE(tx->read({db->getLastCommittedTransactionId(), key_class_t::TRXID},
+                             val, ResourceIf::Category::TRXLOG));
+        pb::Transaction trxlog;
+        ASSERT_TRUE(trxlog.ParseFromString(val));
+        // The range is split around names with an escaped dot after the zone-name
+        ASSERT_EQ(trxlog.parts_size(), 3);
+        EXPECT_FALSE(trxlog.parts(0).has_endkey());
+        EXPECT_FALSE(trxlog.parts(0).has_value());
+        EXPECT_TRUE(trxlog.parts(1).has_endkey());
+        EXPECT_TRUE(trxlog.parts(2).has_endkey());
+    }
+}
+
+TEST(DbDeleteZone, dropZoneKeepsChildZones) {
+    TmpDb db;
+    const auto other_tenant = boost::uuids::random_generator()();
+
+    db.createTestZone();
+    db.createWwwA();
+    db.createTestZone("sub.example.com", other_tenant);
+
+    {
+        StorageBuilder sb;
+        sb.createA("www.sub.example.com", 1000, boost::asio::ip::make_address_v4("127.0.0.5"));
+        sb.setZoneLen(15);
+        sb.finish();
+
+        auto tx = db->transaction();
+        tx->write({"www.sub.example.com"sv, key_class_t::ENTRY}, sb.buffer(), true);
+
+        // A sibling of the zone, in "com"
+        tx->write({"a\\.example.com"sv, key_class_t::ENTRY}, sb.buffer(), true);
+
+        // The zones are registered in the ACCOUNT column family
+        tx->write({"example.com"sv, key_class_t::ZONE}, "zone"s, true, ResourceIf::Category::ACCOUNT);
+        tx->write({"sub.example.com"sv, key_class_t::ZONE}, "zone"s, true, ResourceIf::Category::ACCOUNT);
+        tx->commit();
+    }
+
+    {
+        auto tx = db->transaction();
+        tx->dropZone("example.com");
+        tx->commit();
+    }
+
+    {
+        auto tx = db->transaction();
+        EXPECT_FALSE(tx->lookup("example.com"));
+        EXPECT_FALSE(tx->lookup("www.example.com"));
+        EXPECT_TRUE(tx->lookup("sub.example.com"));
+        EXPECT_TRUE(tx->lookup("www.sub.example.com"));
+        EXPECT_TRUE(tx->lookup("a\\.example.com"));
+        EXPECT_TRUE(tx->keyExists({"sub.example.com"sv, key_class_t::ZONE}, ResourceIf::Category::ACCOUNT));
+    }
+
+    EXPECT_EQ(db->zoneIndex()->findClosest("www.sub.example.com").zone, "sub.example.com");
+    EXPECT_TRUE(db->zoneIndex()->findClosest("www.example.com").zone.empty());
+}
+
 TEST(DbReadZone, exists) {
     TmpDb db;
     {
@@ -253,6 +373,61 @@ TEST(DbLookup, notFound) {
     }
 }
 
+TEST(DbReadOnly, lookupAndNoWrite) {
+    TmpDb db;
+    {
+        // Setup
+        const string_view fqdn = "example.com";
+        StorageBuilder sb;
+        sb.createSoa(fqdn, 1000, "hostmaster.example.com", "ns1.example.com", 1,
+                     1001, 1002, 1003, 1004);
+        sb.createNs(fqdn, 1000, "ns1.example.com");
+        sb.finish();
+
+        {
+            auto tx = db->transaction();
+            tx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+            tx->commit();
+        }
+
+        // Test
+        auto tx = db->readOnlyTransaction();
+        auto entry = tx->lookup(fqdn);
+
+        EXPECT_TRUE(entry);
+        EXPECT_EQ(entry.begin()->type(), TYPE_SOA);
+        EXPECT_TRUE(tx->keyExists({fqdn, key_class_t::ENTRY}));
+        EXPECT_TRUE(tx->zoneExists(fqdn));
+        EXPECT_FALSE(tx->lookup("www.example.com"));
+        EXPECT_TRUE(tx->lookupEntryAndSoa("www.example.com").hasSoa());
+        EXPECT_THROW(tx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), false), InternalErrorException);
+        EXPECT_THROW(tx->remove({fqdn, key_class_t::ENTRY}), InternalErrorException);
+    }
+}
+
+TEST(DbReadOnly, consistentSnapshot) {
+    TmpDb db;
+    {
+        const string_view fqdn = "example.com";
+        StorageBuilder sb;
+        sb.createSoa(fqdn, 1000, "hostmaster.example.com", "ns1.example.com", 1,
+                     1001, 1002, 1003, 1004);
+        sb.finish();
+
+        auto snapshot = db->readOnlyTransaction(true);
+        auto latest = db->readOnlyTransaction();
+
+        {
+            auto tx = db->transaction();
+            tx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+            tx->commit();
+        }
+
+        EXPECT_FALSE(snapshot->lookup(fqdn));
+        EXPECT_TRUE(latest->lookup(fqdn));
+    }
+}
+
 TEST(lookupEntryAndSoa, sameOk) {
     TmpDb db;
 
@@ -411,6 +586,486 @@ TEST(Rocksdb, canReload) {
     }
 }
 
+TEST(Rocksdb, iterateDiffsForZone) {
+    TmpDb db;
+
+    const string_view value = "diff";
+    {
+        auto tx = db->transaction();
+        for(const string_view zone : {"example.com", "www.example.com", "example.org"}) {
+            for(uint32_t serial = 1; serial <= 3; ++serial) {
+                tx->write({zone, serial, key_class_t::DIFF}, value, false, ResourceIf::Category::DIFF);
+            }
+        }
+        tx->commit();
+    }
+
+    // Re-open, so the data is read with the options for the diff column family
+    EXPECT_NO_THROW(db.reload());
+
+    auto tx = db->transaction();
+    const ResourceIf::RealKey key{"example.com", 2, key_class_t::DIFF};
+    vector<string> found;
+    tx->iterate(key, [&](auto k, auto /*value*/) {
+        if (!key.isSameFqdn(k)) {
+            return false;
+        }
+        found.emplace_back(k.dataAsString());
+        return true;
+    }, ResourceIf::Category::DIFF);
+
+    EXPECT_EQ(found.size(), 2);
+    EXPECT_EQ(found.front(), "example.com/2");
+    EXPECT_EQ(found.back(), "example.com/3");
+
+    EXPECT_FALSE(tx->keyExists({"example.net", 1, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+    EXPECT_TRUE(tx->keyExists({"example.org", 1, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+}
+
+TEST(Rocksdb, pruneTrxLog) {
+    TmpDb db;
+    db.config().cluster_trxlog_retention_count = 3;
+
+    for(auto i = 0; i < 10; ++i) {
+        db.createTestZone("example"s + to_string(i) + ".com");
+    }
+
+    const auto last = db->getLastCommittedTransactionId();
+    EXPECT_GE(last, 10);
+    EXPECT_EQ(db->firstRetainedTrxId(), 1);
+
+    EXPECT_EQ(db->pruneTrxLog({}, true), last - 3);
+    EXPECT_EQ(db->firstRetainedTrxId(), last - 2);
+
+    auto countTransactions = [&] {
+        size_t count = 0;
+        auto trx = db->transaction();
+        trx->iterate({uint64_t{0}, key_class_t::TRXID}, [&](auto /*key*/, auto /*value*/) {
+            ++count;
+            return true;
+        }, ResourceIf::Category::TRXLOG);
+        return count;
+    };
+
+    EXPECT_EQ(countTransactions(), 3);
+
+    // Nothing more to prune
+    EXPECT_EQ(db->pruneTrxLog({}, true), 0);
+
+    // The last transaction is always kept
+    db.config().cluster_trxlog_retention_count = 0;
+    db.config().cluster_trxlog_prune_confirmed = true;
+    EXPECT_EQ(db->pruneTrxLog(last, true), last - 1);
+    EXPECT_EQ(countTransactions(), 1);
+
+    db.reload();
+    EXPECT_EQ(db->firstRetainedTrxId(), last);
+    EXPECT_EQ(db->getLastCommittedTransactionId(), last);
+}
+
+TEST(Rocksdb, requestIdsAreUniqueAcrossThreads) {
+    const size_t num_threads = 8;
+    const size_t ids_per_thread = 10000;
+
+    vector<vector<uint64_t>> ids(num_threads);
+    {
+        vector<jthread> threads;
+        for(size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&ids, t] {
+                auto& my_ids = ids[t];
+                my_ids.reserve(ids_per_thread);
+                for(size_t i = 0; i < ids_per_thread; ++i) {
+                    my_ids.push_back(newRequestId());
+                }
+            });
+        }
+    }
+
+    vector<uint64_t> all;
+    for(const auto& my_ids : ids) {
+        ASSERT_EQ(my_ids.size(), ids_per_thread);
+        all.insert(all.end(), my_ids.begin(), my_ids.end());
+    }
+
+    ranges::sort(all);
+    EXPECT_EQ(ranges::adjacent_find(all), all.end());
+
+    // Transactions get their id the same way
+    TmpDb db;
+    auto trx1 = db->transaction();
+    auto trx2 = db->transaction();
+    EXPECT_NE(trx1->id(), trx2->id());
+}
+
+TEST(Rocksdb, trxLogHasUuid) {
+    TmpDb db;
+    ASSERT_TRUE(db.config().db_log_transactions);
+    db.createTestZone();
+    const auto first = db->getLastCommittedTransactionId();
+    db.createWwwA();
+    const auto second = db->getLastCommittedTransactionId();
+    ASSERT_GT(second, first);
+
+    auto getUuid = [&](uint64_t id) {
+        auto tx = db->transaction();
+        string val;
+        EXPECT_TRUE(tx->read({id, key_class_t::TRXID}, val, ResourceIf::Category::TRXLOG));
+        pb::Transaction trxlog;
+        EXPECT_TRUE(trxlog.ParseFromString(val));
+
+        boost::uuids::uuid uuid{};
+        EXPECT_EQ(trxlog.uuid().size(), uuid.size());
+        memcpy(uuid.begin(), trxlog.uuid().data(), min(trxlog.uuid().size(), uuid.size()));
+        return uuid;
+    };
+
+    // The replicated transactions still have a globally unique id
+    const auto uuid1 = getUuid(first);
+    const auto uuid2 = getUuid(second);
+    EXPECT_FALSE(uuid1.is_nil());
+    EXPECT_EQ(uuid1.version(), boost::uuids::uuid::version_random_number_based);
+    EXPECT_NE(uuid1, uuid2);
+}
+
+TEST(Rocksdb, updateMetricsWithRateLimiter) {
+    TmpDb db;
+    auto config = db.config();
+    config.rocksdb_rate_limit = 1024 * 1024;
+    config.db_path = (db.path() / "rate-limited").string();
+
+    Server server{config};
+    RocksDbResource rdb{server};
+    rdb.init();
+
+    auto& m = server.metrics().rocksdb();
+    ASSERT_NE(m.rate_limit, nullptr);
+    EXPECT_NO_THROW(rdb.updateMetrics());
+    EXPECT_NE(m.rate_limiter_bytes.at(rocksdb::Env::IO_HIGH), nullptr);
+    EXPECT_NE(m.rate_limiter_bytes.at(rocksdb::Env::IO_LOW), nullptr);
+    EXPECT_EQ(m.rate_limiter_bytes.at(rocksdb::Env::IO_MID), nullptr);
+}
+
+TEST(Rocksdb, perfContextSampleRestoresPerfLevel) {
+    TmpDb db;
+    auto config = db.config();
+    config.metrics_dns_perf_sample_rate = 1;
+    Server server{config};
+
+    for(const auto level : {rocksdb::PerfLevel::kDisable,
+                            rocksdb::PerfLevel::kEnableCount,
+                            rocksdb::PerfLevel::kEnableTime}) {
+        rocksdb::SetPerfLevel(level);
+        {
+            const Metrics::PerfContextSample sample{server.metrics(), 1};
+            EXPECT_GE(rocksdb::GetPerfLevel(), rocksdb::PerfLevel::kEnableTimeExceptForMutex);
+        }
+        EXPECT_EQ(rocksdb::GetPerfLevel(), level);
+    }
+
+    // Not sampling don't change the level
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+    {
+        const Metrics::PerfContextSample sample{server.metrics(), 0};
+        EXPECT_EQ(rocksdb::GetPerfLevel(), rocksdb::PerfLevel::kEnableCount);
+    }
+    EXPECT_EQ(rocksdb::GetPerfLevel(), rocksdb::PerfLevel::kEnableCount);
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+}
+
+TEST(Rocksdb, perfContextSampleKeepsTheCounters) {
+    TmpDb db;
+    db.createTestZone();
+    auto config = db.config();
+    config.metrics_dns_perf_sample_rate = 1;
+    Server server{config};
+
+    // Someone else is using the PerfContext
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+    auto *pc = rocksdb::get_perf_context();
+    pc->Reset();
+    pc->block_cache_hit_count = 1000;
+    {
+        const Metrics::PerfContextSample sample{server.metrics(), 1};
+        auto trx = db.resource().transaction();
+        EXPECT_FALSE(trx->lookup("example.com").empty());
+    }
+    EXPECT_GE(pc->block_cache_hit_count, 1000);
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+}
+
+TEST(DbOptimistic, conflictingCommitThrows) {
+    TmpDb db;
+    db.config().rocksdb_transaction_db = "optimistic";
+    db.reload();
+    EXPECT_TRUE(db->isOptimistic());
+
+    const string_view fqdn = "example.com";
+    StorageBuilder sb;
+    sb.createSoa(fqdn, 1000, "hostmaster.example.com", "ns1.example.com", 1,
+                 1001, 1002, 1003, 1004);
+    sb.finish();
+
+    auto tx1 = db->transaction();
+    auto tx2 = db->transaction();
+
+    tx1->write({fqdn, key_class_t::ENTRY}, sb.buffer(), false);
+    EXPECT_NO_THROW(tx1->commit());
+
+    // tx2 started before tx1 committed, so its write conflicts
+    tx2->write({fqdn, key_class_t::ENTRY}, sb.buffer(), false);
+    EXPECT_THROW(tx2->commit(), ConflictException);
+
+    // A new transaction sees the committed data and can write
+    auto tx3 = db->transaction();
+    EXPECT_TRUE(tx3->keyExists({fqdn, key_class_t::ENTRY}));
+    tx3->write({fqdn, key_class_t::ENTRY}, sb.buffer(), false);
+    EXPECT_NO_THROW(tx3->commit());
+}
+
+TEST(DbSecondary, catchUpWithPrimary) {
+    TmpDb db;
+    db.createTestZone();
+
+    auto config = db.config();
+    config.db_secondary = true;
+    config.db_secondary_path = (db.path() / "secondary").string();
+
+    RocksDbResource secondary{config};
+    secondary.init();
+    EXPECT_TRUE(secondary.isSecondary());
+
+    const auto *index = secondary.zoneIndex();
+    ASSERT_NE(index, nullptr);
+    EXPECT_EQ(index->findClosest("www.example.com").zone, "example.com");
+    EXPECT_TRUE(index->findClosest("www.example.org").zone.empty());
+
+    db.createTestZone("example.org");
+    EXPECT_TRUE(secondary.catchUpWithPrimary());
+    EXPECT_EQ(index->findClosest("www.example.org").zone, "example.org");
+
+    {
+        auto trx = secondary.readOnlyTransaction();
+        EXPECT_TRUE(trx->lookup("example.org"));
+    }
+
+    EXPECT_THROW(secondary.transaction(), InternalErrorException);
+}
+
+TEST(DbSecondary, defaultPathIsRemovedOnClose) {
+    TmpDb db;
+    db.createTestZone();
+
+    auto config = db.config();
+    config.db_secondary = true;
+    const auto path = db.path() / format("secondary-{}", getpid());
+
+    {
+        RocksDbResource secondary{config};
+        secondary.init();
+        EXPECT_TRUE(secondary.isSecondary());
+        EXPECT_TRUE(filesystem::is_directory(path));
+    }
+    EXPECT_FALSE(filesystem::exists(path));
+
+    // An explicit path is left alone
+    config.db_secondary_path = (db.path() / "secondary").string();
+    {
+        RocksDbResource secondary{config};
+        secondary.init();
+    }
+    EXPECT_TRUE(filesystem::is_directory(config.db_secondary_path));
+}
+
+TEST(DbIterateZone, boundedToZone) {
+    TmpDb db;
+    db.createTestZone();
+    db.createWwwA();
+
+    // Keys that sorts right before and after the children of example.com
+    db.createTestZone("x-example.com");
+    db.createTestZone("bexample.com");
+
+    const auto collect = [](ResourceIf::TransactionIf& trx) {
+        vector<string> names;
+        trx.iterateZone({"example.com"sv, key_class_t::ENTRY}, [&](auto key, auto /*value*/) {
+            names.emplace_back(key.dataAsString());
+            return true;
+        });
+        return names;
+    };
+
+    const vector<string> expected = {"example.com", "www.example.com"};
+
+    {
+        auto trx = db->readOnlyTransaction(true);
+        EXPECT_EQ(collect(*trx), expected);
+    }
+
+    {
+        auto trx = db->transaction();
+        EXPECT_EQ(collect(*trx), expected);
+    }
+}
+
+TEST(DbSnapshot, exportAndImport) {
+    TmpDb primary;
+    primary.createTestZone();
+    primary.createWwwA();
+    const auto trxid = primary->getLastCommittedTransactionId();
+    EXPECT_GT(trxid, 0);
+
+    TmpDb follower;
+    follower.createTestZone("example.org");
+
+    const auto snapshot = primary->exportSnapshot(primary.path() / "export");
+    EXPECT_EQ(snapshot.trxId, trxid);
+    EXPECT_FALSE(snapshot.lastTrx.empty());
+    EXPECT_FALSE(snapshot.files.empty());
+
+    follower->importSnapshot(snapshot);
+    EXPECT_EQ(follower->getLastCommittedTransactionId(), trxid);
+
+    {
+        auto trx = follower->readOnlyTransaction();
+        EXPECT_TRUE(trx->lookup("example.com"));
+        EXPECT_TRUE(trx->lookup("www.example.com"));
+        EXPECT_FALSE(trx->lookup("example.org"));
+    }
+
+    const auto *index = follower->zoneIndex();
+    ASSERT_NE(index, nullptr);
+    EXPECT_EQ(index->findClosest("www.example.com").zone, "example.com");
+    EXPECT_TRUE(index->findClosest("www.example.org").zone.empty());
+}
+
+TEST(DbSnapshot, unavailableWhileImporting) {
+    TmpDb primary;
+    primary.createTestZone();
+    primary.createWwwA();
+
+    TmpDb follower;
+    follower.createTestZone("example.org");
+    ASSERT_NE(follower->zoneIndex(), nullptr);
+
+    const auto snapshot = primary->exportSnapshot(primary.path() / "export");
+
+    // The cache must be cleared and the index disabled before the old data is removed
+    vector<pair<bool, bool>> calls; // available, has index
+    follower->setEntriesChangedCallback([&](const auto& /*changes*/, bool zonesChanged) {
+        EXPECT_TRUE(zonesChanged);
+        calls.emplace_back(follower->available(), follower->zoneIndex() != nullptr);
+    });
+
+    follower->importSnapshot(snapshot);
+    follower->setEntriesChangedCallback({});
+
+    ASSERT_GE(calls.size(), 2u);
+    EXPECT_FALSE(calls.front().first);
+    EXPECT_FALSE(calls.front().second);
+    EXPECT_TRUE(follower->available());
+    EXPECT_NE(follower->zoneIndex(), nullptr);
+}
+
+TEST(DbReplicated, commitInOrder) {
+    TmpDb primary;
+    primary.createTestZone();
+    primary.createWwwA();
+    const auto last = primary->getLastCommittedTransactionId();
+    ASSERT_GT(last, 1);
+
+    TmpDb follower;
+    RocksDbResource::ReplicatedBatch batch;
+    {
+        auto trx = primary->readOnlyTransaction();
+        for(uint64_t id = 1; id <= last; ++id) {
+            string buffer;
+            if (!trx->read({id, ResourceIf::RealKey::Class::TRXID}, buffer,
+                           ResourceIf::Category::TRXLOG, false)) {
+                continue;
+            }
+
+            pb::Transaction value;
+            ASSERT_TRUE(value.ParseFromString(buffer));
+            follower->prepareReplicated(batch, value);
+        }
+    }
+
+    EXPECT_EQ(batch.trxId, last);
+    follower->commitReplicated(batch);
+    EXPECT_EQ(follower->getLastCommittedTransactionId(), last);
+
+    {
+        auto trx = follower->readOnlyTransaction();
+        EXPECT_TRUE(trx->lookup("example.com"));
+        EXPECT_TRUE(trx->lookup("www.example.com"));
+    }
+
+    const auto *index = follower->zoneIndex();
+    ASSERT_NE(index, nullptr);
+    EXPECT_EQ(index->findClosest("www.example.com").zone, "example.com");
+}
+
+TEST(ZoneIndex, zonesAndCuts) {
+    TmpDb db;
+
+    const string_view fqdn = "example.com";
+    const string_view sub = "sub.example.com";
+    {
+        StorageBuilder sb;
+        sb.createSoa(fqdn, 1000, "hostmaster.example.com", "ns1.example.com", 1,
+                     1001, 1002, 1003, 1004);
+        sb.finish();
+
+        auto tx = db->transaction();
+        tx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+        tx->commit();
+    }
+
+    {
+        StorageBuilder sb;
+        sb.createNs(sub, 1000, "ns1.sub.example.com");
+        sb.setZoneLen(fqdn.size());
+        sb.finish();
+
+        auto tx = db->transaction();
+        tx->write({sub, key_class_t::ENTRY}, sb.buffer(), true);
+        tx->commit();
+    }
+
+    const auto check = [&] {
+        auto index = db->zoneIndex();
+        ASSERT_TRUE(index);
+        EXPECT_EQ(index->size(), 2);
+
+        auto match = index->findClosest("www.example.com");
+        EXPECT_EQ(match.zone, fqdn);
+        EXPECT_TRUE(match.cut.empty());
+
+        match = index->findClosest("a.b.sub.example.com");
+        EXPECT_EQ(match.zone, fqdn);
+        EXPECT_EQ(match.cut, sub);
+
+        match = index->findClosest("example.org");
+        EXPECT_TRUE(match.zone.empty());
+        EXPECT_TRUE(match.cut.empty());
+    };
+
+    check();
+
+    // The index must be re-built when the database is opened
+    EXPECT_NO_THROW(db.reload());
+    check();
+
+    {
+        auto tx = db->transaction();
+        tx->remove({fqdn, key_class_t::ENTRY}, true);
+        tx->commit();
+    }
+
+    EXPECT_EQ(db->zoneIndex()->size(), 0);
+    EXPECT_TRUE(db->zoneIndex()->findClosest("www.example.com").zone.empty());
+}
+
 TEST(RocksdbBackup, backup) {
     TmpDb db;
 
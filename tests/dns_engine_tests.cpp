@@ -1,5 +1,8 @@
+#include <format>
+
 #include "gtest/gtest.h"
 #include "RestApi.h"
+#include "AnswerCache.h"
 
 #include "TmpDb.h"
 
@@ -27,6 +30,56 @@ const char query_example_com[] =
         "\x10\x00\x00\x00\x00\x00\x00\x0c\x00\x0a\x00\x08\xb9\x72\xa1\xe6" \
         "\x66\x5e\xe1\x97";
 
+string makeQuery(uint16_t id, string_view fqdn, uint16_t type) {
+    MessageBuilder query;
+    query.createHeader(id, false, Message::Header::OPCODE::QUERY, true);
+    query.addQuestion(fqdn, type);
+    query.finish();
+
+    const auto span = query.span();
+    return {span.begin(), span.end()};
+}
+
+// A DNS query with the 2 byte length-prefix used on TCP
+string makeTcpQuery(uint16_t id, string_view fqdn, uint16_t type) {
+    const auto query = makeQuery(id, fqdn, type);
+    string out;
+    out.push_back(static_cast<char>(query.size() >> 8));
+    out.push_back(static_cast<char>(query.size() & 0xff));
+    out.append(query);
+    return out;
+}
+
+// Send one UDP query from each socket, and collect the replies
+vector<vector<char>> udpQueries(boost::asio::io_context& ctx,
+                                vector<boost::asio::ip::udp::socket>& sockets,
+                                const boost::asio::ip::udp::endpoint& ep,
+                                string_view fqdn, uint16_t type) {
+    vector<vector<char>> replies(sockets.size());
+    for(size_t i = 0; i < sockets.size(); ++i) {
+        const auto query = makeQuery(static_cast<uint16_t>(i + 1), fqdn, type);
+        sockets[i].send_to(boost::asio::buffer(query), ep);
+
+        auto& reply = replies[i];
+        reply.resize(4096);
+        sockets[i].async_receive(boost::asio::buffer(reply), [&reply](auto ec, size_t bytes) {
+            reply.resize(ec ? 0 : bytes);
+        });
+    }
+
+    ctx.run_for(5s);
+    ctx.restart();
+    return replies;
+}
+
+vector<char> readTcpReply(boost::asio::ip::tcp::socket& sock) {
+    array<uint8_t, 2> len{};
+    boost::asio::read(sock, boost::asio::buffer(len));
+    vector<char> buffer((len[0] << 8) + len[1]);
+    boost::asio::read(sock, boost::asio::buffer(buffer));
+    return buffer;
+}
+
 } // anon ns
 
 TEST(DnsEngine, requestQueryA) {
@@ -63,6 +116,141 @@ TEST(DnsEngine, requestQueryA) {
     }
 }
 
+TEST(DnsEngine, answerCache) {
+
+    MockServer ms;
+    {
+        ms->createTestZone();
+        ms->createWwwA();
+
+        DnsEngine dns{ms};
+        ASSERT_NE(dns.answerCache(), nullptr);
+
+        shared_ptr<MessageBuilder> mb;
+        auto cb = [&mb](shared_ptr<MessageBuilder>& data, bool final) {
+            mb = data;
+            EXPECT_TRUE(final);
+        };
+
+        DnsEngine::Request req;
+        req.span = query_www_example_com;
+        Message orig{query_www_example_com};
+
+        dns.processRequest(req, cb);
+        ASSERT_TRUE(mb);
+        const string first{mb->span().begin(), mb->span().end()};
+        EXPECT_EQ(dns.answerCache()->size(), 1);
+
+        // Same query with another id and case. Must be served from the cache.
+        string upper{query_www_example_com, sizeof(query_www_example_com) - 1};
+        upper[0] = 0x12;
+        upper[1] = 0x34;
+        upper[13] = 'W';
+        req.span = upper;
+        mb.reset();
+        dns.processRequest(req, cb);
+        ASSERT_TRUE(mb);
+        {
+            Message msg{mb->span()};
+            EXPECT_EQ(msg.header().id(), 0x1234);
+            EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::OK);
+            EXPECT_EQ(msg.getAnswers().count(), 2);
+            EXPECT_EQ(msg.getQuestions().begin()->labels().string(), "Www.example.com");
+            EXPECT_EQ(string(mb->span().begin() + 2, mb->span().end()), first.substr(2).replace(11, 1, "W"));
+        }
+
+        // Delete www. The cached reply must be invalidated.
+        {
+            auto trx = ms->resource().transaction();
+            trx->remove({"www.example.com", key_class_t::ENTRY});
+            trx->commit();
+        }
+        EXPECT_EQ(dns.answerCache()->size(), 0);
+
+        req.span = query_www_example_com;
+        mb.reset();
+        dns.processRequest(req, cb);
+        ASSERT_TRUE(mb);
+        Message msg{mb->span()};
+        EXPECT_EQ(msg.header().id(), orig.header().id());
+        EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::NAME_ERROR);
+        EXPECT_EQ(msg.getAnswers().count(), 0);
+    }
+}
+
+TEST(AnswerCache, putAfterUnrelatedInvalidation) {
+    AnswerCache cache{64, 1};
+    const string reply = "reply";
+
+    // A change to another name does not make the reply stale
+    auto generation = cache.generation();
+    cache.invalidate("other.example.com");
+    cache.put(AnswerCache::makeKey("www.example.com", TYPE_A, 512, false, false),
+              reply, {"www.example.com"}, generation);
+    EXPECT_EQ(cache.size(), 1);
+
+    // A change to a name the reply depends on does
+    generation = cache.generation();
+    cache.invalidate("mail.example.com");
+    cache.put(AnswerCache::makeKey("mail.example.com", TYPE_A, 512, false, false),
+              reply, {"mail.example.com"}, generation);
+    EXPECT_EQ(cache.size(), 1);
+
+    // So does clearing the cache
+    generation = cache.generation();
+    cache.clear();
+    cache.put(AnswerCache::makeKey("www.example.com", TYPE_A, 512, false, false),
+              reply, {"www.example.com"}, generation);
+    EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(AnswerCache, negativeRepliesHaveTheirOwnBudget) {
+    // 64 entries, where 8 can be negative
+    AnswerCache cache{64, 1};
+    const string reply = "reply";
+
+    for(auto i = 0; i < 10; ++i) {
+        const auto fqdn = format("host{}.example.com", i);
+        cache.put(AnswerCache::makeKey(fqdn, TYPE_A, 512, false, false), reply,
+                  {fqdn}, cache.generation());
+    }
+
+    // A flood of random names
+    for(auto i = 0; i < 1000; ++i) {
+        const auto fqdn = format("random{}.example.com", i);
+        cache.put(AnswerCache::makeKey(fqdn, TYPE_A, 512, false, false), reply,
+                  {fqdn}, cache.generation(), true);
+    }
+
+    EXPECT_EQ(cache.size(), 10 + 8);
+    for(auto i = 0; i < 10; ++i) {
+        const auto fqdn = format("host{}.example.com", i);
+        EXPECT_TRUE(cache.get(AnswerCache::makeKey(fqdn, TYPE_A, 512, false, false)));
+    }
+}
+
+TEST(AnswerCache, evictionKeepsUsedReplies) {
+    // 8 entries, where 7 can be positive
+    AnswerCache cache{8, 1};
+    const string reply = "reply";
+
+    const auto key = [](int i) {
+        return AnswerCache::makeKey(format("host{}.example.com", i), TYPE_A, 512, false, false);
+    };
+
+    for(auto i = 0; i < 7; ++i) {
+        cache.put(key(i), reply, {}, cache.generation());
+    }
+
+    // host0 is the oldest, but it's used, so host1 is evicted instead
+    EXPECT_TRUE(cache.get(key(0)));
+    cache.put(key(7), reply, {}, cache.generation());
+    EXPECT_EQ(cache.size(), 7);
+    EXPECT_TRUE(cache.get(key(0)));
+    EXPECT_FALSE(cache.get(key(1)));
+    EXPECT_TRUE(cache.get(key(7)));
+}
+
 TEST(DnsEngine, requestAllRespAll) {
 
     MockServer ms;
@@ -344,6 +532,338 @@ TEST(DnsEngine, ednsWithTwoOptRrs) {
     }
 }
 
+TEST(DnsEngine, additionalForMx) {
+
+    MockServer ms;
+    {
+        ms->createTestZone();
+
+        // Target for the MX record in the test-zone
+        {
+            StorageBuilder sb;
+            string_view fqdn = "mail.example.example.com";
+            sb.createA(fqdn, 1000, boost::asio::ip::make_address_v4("127.0.0.10"));
+            sb.setZoneLen(11);
+            sb.finish();
+
+            auto trx = ms->resource().transaction();
+            trx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+            trx->commit();
+        }
+
+        MessageBuilder query;
+        query.createHeader(1, false, Message::Header::OPCODE::QUERY, true);
+        query.addQuestion("example.com", TYPE_MX);
+        query.finish();
+
+        DnsEngine dns{ms};
+        DnsEngine::Request req;
+        req.span = query.span();
+
+        shared_ptr<MessageBuilder> mb;
+        auto cb = [&mb](shared_ptr<MessageBuilder>& data, bool final) {
+            mb = data;
+            EXPECT_TRUE(final);
+        };
+
+        dns.processRequest(req, cb);
+        ASSERT_TRUE(mb);
+        Message msg{mb->span()};
+
+        EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::OK);
+        EXPECT_EQ(msg.getAnswers().count(), 1);
+        EXPECT_EQ(msg.getAnswers().begin()->type(), TYPE_MX);
+        ASSERT_EQ(msg.getAdditional().count(), 1);
+        EXPECT_EQ(msg.getAdditional().begin()->type(), TYPE_A);
+        EXPECT_EQ(msg.getAdditional().begin()->labels().string(), "mail.example.example.com");
+    }
+}
+
+TEST(DnsEngine, referralWithGlue) {
+
+    MockServer ms;
+    {
+        ms->createTestZone();
+
+        // Delegate sub.example.com, with glue for the name-server
+        {
+            auto trx = ms->resource().transaction();
+            {
+                StorageBuilder sb;
+                string_view fqdn = "sub.example.com";
+                sb.createNs(fqdn, 1000, "ns1.sub.example.com");
+                sb.setZoneLen(11);
+                sb.finish();
+                trx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+            }
+            {
+                StorageBuilder sb;
+                string_view fqdn = "ns1.sub.example.com";
+                sb.createA(fqdn, 1000, boost::asio::ip::make_address_v4("127.0.0.11"));
+                sb.createA(fqdn, 1000, boost::asio::ip::make_address_v6("2001:db8::11"));
+                sb.setZoneLen(11);
+                sb.finish();
+                trx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+            }
+            trx->commit();
+        }
+
+        MessageBuilder query;
+        query.createHeader(1, false, Message::Header::OPCODE::QUERY, true);
+        query.addQuestion("www.sub.example.com", TYPE_A);
+        query.finish();
+
+        DnsEngine dns{ms};
+        DnsEngine::Request req;
+        req.span = query.span();
+
+        shared_ptr<MessageBuilder> mb;
+        auto cb = [&mb](shared_ptr<MessageBuilder>& data, bool final) {
+            mb = data;
+            EXPECT_TRUE(final);
+        };
+
+        dns.processRequest(req, cb);
+        ASSERT_TRUE(mb);
+        Message msg{mb->span()};
+
+        EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::OK);
+        EXPECT_EQ(msg.getAnswers().count(), 0);
+        ASSERT_EQ(msg.getAuthority().count(), 1);
+        EXPECT_EQ(msg.getAuthority().begin()->type(), TYPE_NS);
+        ASSERT_EQ(msg.getAdditional().count(), 2);
+        for(const auto& rr : msg.getAdditional()) {
+            EXPECT_EQ(rr.labels().string(), "ns1.sub.example.com");
+            EXPECT_TRUE(rr.type() == TYPE_A || rr.type() == TYPE_AAAA);
+        }
+    }
+}
+
+TEST(DnsEngine, tcpPipelinedRepliesOutOfOrder) {
+
+    MockServer ms;
+    ms->config().dns_endpoint = "127.0.0.1";
+    ms->config().dns_udp_port = "15353";
+    ms->config().dns_tcp_port = "15353";
+    ms->config().num_dns_threads = 4;
+
+    // Make the zone-transfer use many messages
+    ms->config().dns_max_large_tcp_buffer_size = 1024;
+    {
+        ms->createTestZone();
+        auto trx = ms->resource().transaction();
+        for(auto i = 0; i < 2000; ++i) {
+            const auto fqdn = format("host{}.example.com", i);
+            StorageBuilder sb;
+            sb.createA(fqdn, 1000, boost::asio::ip::make_address_v4("127.0.0.10"));
+            sb.setZoneLen(11);
+            sb.finish();
+            trx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+        }
+        trx->commit();
+    }
+    ms->createWwwA();
+
+    DnsEngine dns{ms};
+    dns.start();
+    ms.startIoThreads();
+
+    {
+        boost::asio::io_context ctx;
+        boost::asio::ip::tcp::socket sock{ctx};
+        sock.connect({boost::asio::ip::make_address("127.0.0.1"), 15353});
+
+        // The zone-transfer is first, but the reply to the second query
+        // should not have to wait until it's done.
+        const auto queries = makeTcpQuery(1, "example.com", QTYPE_AXFR)
+                             + makeTcpQuery(2, "www.example.com", TYPE_A);
+        boost::asio::write(sock, boost::asio::buffer(queries));
+
+        int a_reply = -1;
+        int axfr_done = -1;
+        size_t soa_count = 0;
+        for(int i = 0; (a_reply < 0 || axfr_done < 0) && i < 10000; ++i) {
+            const auto buffer = readTcpReply(sock);
+            Message msg{buffer};
+            if (msg.header().id() == 2) {
+                a_reply = i;
+                EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::OK);
+                EXPECT_EQ(msg.getAnswers().count(), 2);
+                continue;
+            }
+
+            EXPECT_EQ(msg.header().id(), 1);
+            for(const auto& rr : msg.getAnswers()) {
+                // The transfer starts and ends with the SOA
+                if (rr.type() == TYPE_SOA && ++soa_count == 2) {
+                    axfr_done = i;
+                }
+            }
+        }
+
+        ASSERT_GE(a_reply, 0);
+        ASSERT_GE(axfr_done, 0);
+        EXPECT_LT(a_reply, axfr_done);
+    }
+
+    ms.stop();
+}
+
+#ifdef __linux__
+TEST(DnsEngine, udpBatchedRepliesMatchQueries) {
+
+    const uint16_t port = 15355;
+    const size_t batch_size = 8;
+    // Several full batches, and a last batch that is only partially filled
+    const size_t num_queries = (batch_size * 3) + 3;
+
+    MockServer ms;
+    ms->config().dns_endpoint = "127.0.0.1";
+    ms->config().dns_udp_port = to_string(port);
+    ms->config().dns_tcp_port = to_string(port);
+    ms->config().num_dns_threads = 2;
+    ms->config().dns_udp_batch_size = batch_size;
+    {
+        ms->createTestZone();
+        auto trx = ms->resource().transaction();
+        for(size_t i = 1; i <= num_queries; ++i) {
+            const auto fqdn = format("host{}.example.com", i);
+            StorageBuilder sb;
+            sb.createA(fqdn, 1000, boost::asio::ip::make_address_v4(format("127.0.0.{}", i)));
+            sb.setZoneLen(11);
+            sb.finish();
+            trx->write({fqdn, key_class_t::ENTRY}, sb.buffer(), true);
+        }
+        trx->commit();
+    }
+
+    DnsEngine dns{ms};
+    dns.start();
+    ms.startIoThreads();
+
+    const boost::asio::ip::udp::endpoint ep{boost::asio::ip::make_address("127.0.0.1"), port};
+    boost::asio::io_context ctx;
+
+    // A few clients, so each batch of replies goes to different endpoints
+    vector<boost::asio::ip::udp::socket> sockets;
+    for(auto i = 0; i < 4; ++i) {
+        sockets.emplace_back(ctx, boost::asio::ip::udp::endpoint{boost::asio::ip::udp::v4(), 0});
+    }
+
+    // Send all the queries back to back, so they are queued on the servers socket
+    for(size_t i = 1; i <= num_queries; ++i) {
+        const auto query = makeQuery(static_cast<uint16_t>(i), format("host{}.example.com", i), TYPE_A);
+        sockets[i % sockets.size()].send_to(boost::asio::buffer(query), ep);
+    }
+
+    vector<int> replies(num_queries + 1);
+    size_t received = 0;
+    vector<vector<char>> buffers(sockets.size(), vector<char>(4096));
+    std::function<void(size_t)> receive = [&](size_t ix) {
+        auto& buffer = buffers[ix];
+        sockets[ix].async_receive(boost::asio::buffer(buffer), [&, ix](auto ec, size_t bytes) {
+            if (ec) {
+                return;
+            }
+
+            Message msg{span_t{buffer.data(), bytes}};
+            const auto id = msg.header().id();
+            ASSERT_GE(id, 1);
+            ASSERT_LE(id, num_queries);
+            EXPECT_EQ(id % sockets.size(), ix);
+            ++replies[id];
+            EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::OK);
+            ASSERT_EQ(msg.getAnswers().count(), 1);
+            const RrA a{msg.span(), msg.getAnswers().begin()->offset()};
+            EXPECT_EQ(a.address().to_string(), format("127.0.0.{}", id));
+
+            if (++received == num_queries) {
+                ctx.stop();
+                return;
+            }
+            receive(ix);
+        });
+    };
+
+    for(size_t i = 0; i < sockets.size(); ++i) {
+        receive(i);
+    }
+    ctx.run_for(5s);
+
+    EXPECT_EQ(received, num_queries);
+    for(size_t i = 1; i <= num_queries; ++i) {
+        EXPECT_EQ(replies[i], 1) << "Unexpected number of replies to query #" << i;
+    }
+
+    ms.stop();
+}
+#endif
+
+#ifdef SO_REUSEPORT
+TEST(DnsEngine, reusePortWorkers) {
+
+    MockServer ms;
+    ms->config().dns_endpoint = "127.0.0.1";
+    // Let the OS pick the ports. All the workers must use the same ports.
+    ms->config().dns_udp_port = "0";
+    ms->config().dns_tcp_port = "0";
+    ms->config().num_dns_threads = 4;
+    ms->config().dns_reuseport_workers = true;
+    ms->createTestZone();
+    ms->createWwwA();
+
+    DnsEngine dns{ms};
+    dns.start();
+    ms.startIoThreads();
+
+    // The DNS workers don't use the shared thread-pool
+    EXPECT_EQ(ms.numIoThreads(), 1);
+
+    const auto port = dns.udpPort();
+    const auto tcp_port = dns.tcpPort();
+    ASSERT_NE(port, 0);
+    ASSERT_NE(tcp_port, 0);
+
+    const boost::asio::ip::udp::endpoint ep{boost::asio::ip::make_address("127.0.0.1"), port};
+    boost::asio::io_context ctx;
+
+    {
+        // The port is bound with SO_REUSEPORT, so we are allowed to bind it as well
+        boost::asio::ip::udp::socket sock{ctx, boost::asio::ip::udp::v4()};
+        sock.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>{true});
+        boost::system::error_code ec;
+        sock.bind(ep, ec);
+        EXPECT_FALSE(ec) << ec.message();
+    }
+
+    // Many source ports, so the kernel spreads the queries over the workers
+    vector<boost::asio::ip::udp::socket> sockets;
+    for(auto i = 0; i < 16; ++i) {
+        sockets.emplace_back(ctx, boost::asio::ip::udp::endpoint{boost::asio::ip::udp::v4(), 0});
+    }
+
+    const auto replies = udpQueries(ctx, sockets, ep, "www.example.com", TYPE_A);
+    for(size_t i = 0; i < replies.size(); ++i) {
+        ASSERT_FALSE(replies[i].empty()) << "No reply to query #" << (i + 1);
+        Message msg{replies[i]};
+        EXPECT_EQ(msg.header().id(), i + 1);
+        EXPECT_EQ(msg.header().rcode(), Message::Header::RCODE::OK);
+        EXPECT_EQ(msg.getAnswers().count(), 2);
+    }
+
+    {
+        boost::asio::ip::tcp::socket sock{ctx};
+        sock.connect({boost::asio::ip::make_address("127.0.0.1"), tcp_port});
+        boost::asio::write(sock, boost::asio::buffer(makeTcpQuery(100, "www.example.com", TYPE_A)));
+        const auto buffer = readTcpReply(sock);
+        Message msg{buffer};
+        EXPECT_EQ(msg.header().id(), 100);
+        EXPECT_EQ(msg.getAnswers().count(), 2);
+    }
+
+    ms.stop();
+}
+#endif
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -5,6 +5,7 @@
 #include "nsblast/DnsMessages.h"
 #include "nsblast/detail/write_labels.hpp"
 #include "nsblast/util.h"
+#include "ObjectPool.h"
 
 using namespace std;
 using namespace nsblast::lib;
@@ -41,6 +42,29 @@ struct WriteLabelsSetup {
     Labels latest;
 };
 
+struct IndexedWriteLabelsSetup {
+
+    auto add(string_view fqdn) {
+        labels_buffer.resize(255);
+
+        nsblast::lib::detail::writeName(labels_buffer, 0, fqdn);
+        Labels labels{labels_buffer, 0};
+
+        uint16_t start_offset = static_cast<uint16_t>(buffer.size());
+
+        auto len = nsblast::lib::detail::writeLabels(labels, index, buffer, nsblast::MAX_UDP_QUERY_BUFFER);
+
+        latest = {buffer, start_offset};
+
+        return len;
+    }
+
+    vector<char> labels_buffer;
+    vector<char> buffer;
+    LabelIndex index;
+    Labels latest;
+};
+
 bool hasPointer(span_t labels) {
 
     for(auto it = labels.begin(); it < labels.end(); ++it) {
@@ -174,6 +198,48 @@ TEST(WriteLabels, compressionOk) {
     EXPECT_EQ(wls.existing.at(4).string(), fqdn6);
 }
 
+TEST(WriteLabels, indexedCompressionOk) {
+    IndexedWriteLabelsSetup wls;
+
+    wls.add("example.com");
+    EXPECT_EQ(wls.latest.string(), "example.com");
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 0);
+    EXPECT_EQ(wls.index.size(), 2); // example.com, com
+
+    wls.add("ns1.example.com");
+    EXPECT_EQ(wls.latest.string(), "ns1.example.com");
+    EXPECT_EQ(wls.latest.bytes(), 6); // "ns1" + len (1) + ptr (2)
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 1);
+
+    wls.add("www.a.b.c.example.com");
+    EXPECT_EQ(wls.latest.string(), "www.a.b.c.example.com");
+    EXPECT_EQ(wls.latest.bytes(), 12); // "www.a.b.c" + len (1) + ptr (2)
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 1);
+
+    wls.add("c.example.com");
+    EXPECT_EQ(wls.latest.string(), "c.example.com");
+    EXPECT_EQ(wls.latest.bytes(), 2); // ptr (2)
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 2); // ptr --> c --> example.com
+
+    wls.add("ns1.nsblast.com");
+    EXPECT_EQ(wls.latest.string(), "ns1.nsblast.com");
+    EXPECT_EQ(wls.latest.bytes(), 14); // "ns1.nsblast" (11) + len (1) ptr (2)
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 1);
+
+    // Compression is case-insensitive
+    wls.add("WWW.Example.COM");
+    EXPECT_EQ(wls.latest.bytes(), 6); // "WWW" + len (1) + ptr (2)
+    EXPECT_EQ(wls.latest.string(), "WWW.example.com");
+
+    // Don't point to just the root label
+    wls.add("example.org");
+    EXPECT_EQ(wls.latest.bytes(), 13);
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 0);
+
+    wls.add("ns1.example.com"); // repeat
+    EXPECT_EQ(wls.latest.bytes(), 2); // ptr (2)
+    EXPECT_EQ(numPointers(wls.buffer, wls.latest.offset()), 2); // ptr --> ns1 --> example.com
+}
 
 TEST(CreateMessageHeader, CheckingOpcodeQuery) {
 
@@ -1621,6 +1687,87 @@ TEST(MessageBuilder, Empty) {
      EXPECT_TRUE(mb.empty());
 }
 
+TEST(MessageBuilder, ResetAndReuse) {
+    MessageBuilder fresh;
+    fresh.createHeader(2, true, Message::Header::OPCODE::QUERY, false);
+    fresh.addQuestion("www.example.com", TYPE_A);
+    fresh.finish();
+
+    MessageBuilder mb;
+    mb.addOpt(4096);
+    mb.createHeader(1, true, Message::Header::OPCODE::QUERY, true);
+    mb.addQuestion("example.com", TYPE_MX);
+    mb.setRcode(Message::Header::RCODE::NAME_ERROR);
+    mb.finish();
+    EXPECT_FALSE(mb.empty());
+
+    mb.reset();
+    EXPECT_TRUE(mb.empty());
+    EXPECT_EQ(mb.size(), 0);
+    EXPECT_FALSE(mb.hasOpt());
+
+    mb.createHeader(2, true, Message::Header::OPCODE::QUERY, false);
+    mb.addQuestion("www.example.com", TYPE_A);
+    mb.finish();
+
+    EXPECT_EQ(mb.header().rcode(), Message::Header::RCODE::OK);
+    EXPECT_EQ(mb.header().arcount(), 0);
+    ASSERT_EQ(mb.span().size(), fresh.span().size());
+    EXPECT_TRUE(std::equal(mb.span().begin(), mb.span().end(), fresh.span().begin()));
+}
+
+TEST(ObjectPool, reusesReleasedObjects) {
+    struct Item {
+        int value = 0;
+    };
+
+    auto first = ObjectPool<Item, 2>::get();
+    first->value = 1;
+    const auto *ptr = first.get();
+    first.reset();
+
+    // The free object is handed out again, and it's not reset by the pool
+    auto again = ObjectPool<Item, 2>::get();
+    EXPECT_EQ(again.get(), ptr);
+    EXPECT_EQ(again->value, 1);
+
+    // At most maxFree objects are kept
+    vector<shared_ptr<Item>> items;
+    for(auto i = 0; i < 4; ++i) {
+        items.emplace_back(ObjectPool<Item, 2>::get());
+    }
+    vector<const Item *> ptrs;
+    for(const auto& item : items) {
+        ptrs.push_back(item.get());
+    }
+    items.clear();
+
+    for(auto i = 0; i < 4; ++i) {
+        items.emplace_back(ObjectPool<Item, 2>::get());
+    }
+    const auto reused = ranges::count_if(items, [&](const auto& item) {
+        return ranges::find(ptrs, item.get()) != ptrs.end();
+    });
+    EXPECT_LE(reused, 2);
+}
+
+TEST(ObjectPool, dropsLargeBuilders) {
+    struct Recycle {
+        bool operator()(const MessageBuilder& mb) const noexcept {
+            return mb.capacity() <= MAX_UDP_QUERY_BUFFER_WITH_OPT;
+        }
+    };
+
+    auto mb = ObjectPool<MessageBuilder, 2, Recycle>::get();
+    mb->setMaxBufferSize(MAX_UDP_QUERY_BUFFER_WITH_OPT * 16);
+    EXPECT_GT(mb->capacity(), MAX_UDP_QUERY_BUFFER_WITH_OPT);
+    mb.reset();
+
+    // The large builder was deleted, not re-used
+    auto other = ObjectPool<MessageBuilder, 2, Recycle>::get();
+    EXPECT_LE(other->capacity(), MAX_UDP_QUERY_BUFFER_WITH_OPT);
+}
+
 TEST(Message, singleQueryOk) {
 
     // UDP package from dig captured by wireshark
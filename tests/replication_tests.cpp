@@ -1,5 +1,8 @@
 
+#include <random>
 #include <format>
+#include <optional>
+#include <thread>
 
 #include "gtest/gtest.h"
 
@@ -10,6 +13,7 @@
 #include "nsblast/logging.h"
 
 #include "PrimaryReplication.h"
+#include "FollowerReplication.h"
 
 using namespace std;
 using namespace nsblast;
@@ -81,6 +85,164 @@ public:
 };
 
 
+// A replicated transaction that sets the value of www.example.com to it's id
+nsblast::pb::Transaction makeFollowerTrx(uint64_t id) {
+    nsblast::pb::Transaction trx;
+    trx.set_id(id);
+    trx.set_uuid(newUuidStr());
+    trx.set_node("primary");
+    auto part = trx.add_parts();
+    const ResourceIf::RealKey key{"www.example.com"sv, key_class_t::ENTRY};
+    part->set_key(key.data(), key.size());
+    part->set_value(to_string(id));
+    part->set_columnfamilyix(static_cast<int32_t>(ResourceIf::Category::ENTRY));
+    return trx;
+}
+
+grpc::nsblast::pb::SyncUpdate makeFollowerUpdate(uint64_t first, uint64_t last) {
+    grpc::nsblast::pb::SyncUpdate update;
+    update.set_isinsync(true);
+    for(auto id = first; id <= last; ++id) {
+        *update.add_trxs() = makeFollowerTrx(id);
+    }
+    return update;
+}
+
+bool waitFor(const function<bool()>& fn) {
+    for(auto i = 0; i < 1000; ++i) {
+        if (fn()) {
+            return true;
+        }
+        this_thread::sleep_for(10ms);
+    }
+    return fn();
+}
+
+string followerValue(MockServer& ms) {
+    string value;
+    auto trx = ms.db().transaction();
+    trx->read({"www.example.com"sv, key_class_t::ENTRY}, value, ResourceIf::Category::ENTRY, false);
+    return value;
+}
+
+void initFollower(MockServer& ms, size_t queueSize) {
+    // GrpcFollow needs the cluster auth key. We don't connect to a primary.
+    setenv("NSBLAST_CLUSTER_AUTH_KEY", "not-so-secret", 1);
+    ms->config().cluster_role = "follower";
+    ms->config().cluster_follower_apply_queue_size = queueSize;
+    ms->config().num_dns_threads = 4;
+    ms.initReplication();
+    ms.startGrpcService();
+}
+
+// The updates a follower has received from the primary
+struct ReceivedUpdates {
+    std::mutex mutex;
+    std::vector<grpc::nsblast::pb::SyncUpdate> updates;
+    uint64_t last_trxid = 0;
+    size_t num_trxs = 0;
+};
+
+// The metrics for the cluster are registered when the server is constructed
+shared_ptr<TmpDb> makeClusterDb(const string& role, const string& compression = "lz4") {
+    auto db = make_shared<TmpDb>();
+    db->config().cluster_role = role;
+    db->config().cluster_sync_compression = compression;
+    return db;
+}
+
+void initSyncPrimary(MockServer& primary, const string& address) {
+    setenv("NSBLAST_CLUSTER_AUTH_KEY", "not-so-secret", 1);
+    primary->config().cluster_server_addr = address;
+    primary->config().num_dns_threads = 4;
+    primary.initReplication();
+    primary.StartReplication();
+    primary.startGrpcService();
+    primary.startIoThreads();
+}
+
+// Adds a zone and `numTrx` more transactions to the primary's transaction-log
+void addBacklog(MockServer& primary, size_t numTrx) {
+    const auto zone = "example.com"s;
+    primary->createTestZone(zone);
+
+    for(size_t i = 0; i < numTrx; ++i) {
+        auto alias = format("test{}.{}", i, zone);
+        StorageBuilder sb;
+        sb.createCname(alias, 1234, zone);
+        sb.setZoneLen(zone.size());
+        sb.finish();
+
+        auto tx = primary->resource().transaction();
+        tx->write({alias, key_class_t::ENTRY}, sb.buffer(), true);
+        tx->commit();
+    }
+}
+
+// Sync from the primary, and record the updates instead of applying them
+void startRecordingFollower(MockServer& follower, const string& address,
+                            ReceivedUpdates& received) {
+    follower->config().cluster_server_addr = address;
+    follower->config().num_dns_threads = 2;
+    follower.initReplication();
+    follower.startGrpcService();
+    follower.startIoThreads();
+
+    follower.grpcFollow().createSyncClient([&received] {
+        lock_guard lock{received.mutex};
+        return received.last_trxid;
+    }, [&received](grpc::nsblast::pb::SyncUpdate& update) {
+        lock_guard lock{received.mutex};
+        if (update.has_trx()) {
+            received.last_trxid = update.trx().id();
+            ++received.num_trxs;
+        }
+        for(const auto& trx : update.trxs()) {
+            received.last_trxid = trx.id();
+            ++received.num_trxs;
+        }
+        received.updates.emplace_back(update);
+        return true;
+    });
+}
+
+size_t numReceivedTrxs(ReceivedUpdates& received) {
+    lock_guard lock{received.mutex};
+    return received.num_trxs;
+}
+
+// An update that is larger than cluster_sync_compression_min_bytes
+GrpcPrimary::update_t makeLargeUpdate(const string& value) {
+    auto update = make_shared<grpc::nsblast::pb::SyncUpdate>(makeFollowerUpdate(1, 10));
+    update->mutable_trxs(0)->mutable_parts(0)->set_value(value);
+    return update;
+}
+
+// Sync the backlog from a primary that compress everything it can
+void syncCompressed(const string& followerCompression) {
+    const auto address = "127.0.0.1:10933"s;
+    const size_t num_trxs = 40;
+
+    MockServer primary{makeClusterDb("primary")};
+    primary->config().cluster_sync_compression_min_bytes = 0;
+    initSyncPrimary(primary, address);
+    addBacklog(primary, num_trxs);
+
+    MockServer follower{makeClusterDb("follower", followerCompression)};
+    ReceivedUpdates received;
+    startRecordingFollower(follower, address, received);
+
+    EXPECT_TRUE(waitFor([&] { return numReceivedTrxs(received) == num_trxs + 1; }));
+    {
+        lock_guard lock{received.mutex};
+        EXPECT_EQ(received.last_trxid, primary.db().getLastCommittedTransactionId());
+    }
+
+    follower.grpcFollow().stop();
+    primary.stop();
+    follower.stop();
+}
+
 } // anon ns
 
 TEST(ReplicationPrimary, NewAgentNoBacklog) {
@@ -248,6 +410,389 @@ TEST(ReplicationPrimary, NewAgentFillBacklog) {
     ms.stop();
 }
 
+TEST(ReplicationPrimary, AgentBehindRetainedLog) {
+
+    MockServer ms;
+    ms->config().cluster_role = "primary";
+    ms->config().cluster_trxlog_retention_count = 2;
+    ms.initReplication();
+    ms.StartReplication();
+    ms.startIoThreads();
+
+    {
+        for(auto i = 0; i < 5; ++i) {
+            ms->createTestZone("example"s + to_string(i) + ".com");
+        }
+
+        EXPECT_GT(ms.db().pruneTrxLog({}, true), 0);
+        EXPECT_GT(ms.db().firstRetainedTrxId(), 1);
+
+        auto client = make_shared<MockSyncClient>();
+        auto replication_agent = ms.primaryReplication().addAgent(client);
+        auto& agent = reinterpret_cast<PrimaryReplication::Agent &>(*replication_agent);
+        auto future = agent.getFutureWhenStateChange();
+
+        // The follower has nothing, and the first transactions are gone.
+        replication_agent->onTrxId(0);
+
+        EXPECT_EQ(future.wait_for(10s), std::future_status::ready);
+        EXPECT_TRUE(replication_agent->isDone());
+        EXPECT_EQ(client->queueUsed(), 1);
+        EXPECT_TRUE(client->updates.front()->needbootstrap());
+        EXPECT_EQ(client->updates.front()->firstretainedtrxid(), ms.db().firstRetainedTrxId());
+    }
+    ms.stop();
+}
+
+TEST(ReplicationPrimary, WaitForQuorum) {
+
+    MockServer ms;
+    ms->config().cluster_role = "primary";
+    ms.initReplication();
+    ms.StartReplication();
+    ms.startIoThreads();
+
+    {
+        auto first = make_shared<MockSyncClient>();
+        auto second = make_shared<MockSyncClient>();
+        auto first_agent = ms.primaryReplication().addAgent(first);
+        auto second_agent = ms.primaryReplication().addAgent(second);
+
+        for(auto *agent : {first_agent, second_agent}) {
+            auto future = reinterpret_cast<PrimaryReplication::Agent &>(*agent).getFutureWhenStateChange();
+            agent->onTrxId(0);
+            EXPECT_EQ(future.wait_for(10s), std::future_status::ready);
+            EXPECT_TRUE(agent->isStreaming());
+        }
+
+        promise<boost::system::error_code> one, both;
+        ms.primaryReplication().waiter(1).wait(5, 10s, [&one](boost::system::error_code ec) {
+            one.set_value(ec);
+        });
+        ms.primaryReplication().waiter(2).wait(5, 1s, [&both](boost::system::error_code ec) {
+            both.set_value(ec);
+        });
+
+        // Only one of the followers confirms the transaction
+        first_agent->onTrxId(5);
+
+        auto one_result = one.get_future();
+        EXPECT_EQ(one_result.wait_for(10s), std::future_status::ready);
+        EXPECT_FALSE(one_result.get().failed());
+
+        auto both_result = both.get_future();
+        EXPECT_EQ(both_result.wait_for(10s), std::future_status::ready);
+        EXPECT_TRUE(both_result.get().failed());
+    }
+    ms.stop();
+}
+
+TEST(ReplicationFollower, ApplyInOrder) {
+
+    MockServer ms;
+    initFollower(ms, 4);
+    ms.startIoThreads();
+
+    {
+        FollowerReplication follower{ms};
+        FollowerReplication::Agent agent{follower};
+
+        // Several workers prepare the batches. They must be committed in order.
+        for(uint64_t id = 1; id <= 60; id += 3) {
+            auto update = makeFollowerUpdate(id, id + 2);
+            agent.onUpdate(update);
+        }
+
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 60; }));
+        EXPECT_EQ(followerValue(ms), "60");
+        EXPECT_TRUE(follower.isInSync());
+
+        auto trx = ms.db().transaction();
+        for(uint64_t id = 1; id <= 60; ++id) {
+            EXPECT_TRUE(trx->keyExists({id, key_class_t::TRXID}, ResourceIf::Category::TRXLOG));
+        }
+    }
+    ms.stop();
+}
+
+TEST(ReplicationFollower, BackPressure) {
+
+    MockServer ms;
+    initFollower(ms, 2);
+
+    {
+        FollowerReplication follower{ms};
+        FollowerReplication::Agent agent{follower};
+
+        // No worker-threads yet, so nothing is committed
+        auto first = makeFollowerUpdate(1, 1);
+        EXPECT_TRUE(agent.onUpdate(first));
+        auto second = makeFollowerUpdate(2, 2);
+        EXPECT_FALSE(agent.onUpdate(second));
+        EXPECT_EQ(agent.trxId(), 0);
+
+        ms.startIoThreads();
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 2; }));
+        EXPECT_EQ(followerValue(ms), "2");
+
+        // There is room in the queue again
+        auto third = makeFollowerUpdate(3, 3);
+        EXPECT_TRUE(agent.onUpdate(third));
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 3; }));
+    }
+    ms.stop();
+}
+
+TEST(ReplicationFollower, ResyncOnHole) {
+
+    MockServer ms;
+    initFollower(ms, 4);
+    ms.startIoThreads();
+
+    {
+        FollowerReplication follower{ms};
+        FollowerReplication::Agent agent{follower};
+
+        auto update = makeFollowerUpdate(1, 3);
+        agent.onUpdate(update);
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 3; }));
+
+        // #4 is missing
+        update = makeFollowerUpdate(5, 5);
+        agent.onUpdate(update);
+        EXPECT_TRUE(waitFor([&] { return !agent.isResyncing(); }));
+        EXPECT_EQ(agent.trxId(), 3);
+        EXPECT_EQ(followerValue(ms), "3");
+
+        // The new stream starts after the last transaction we have. The first
+        // update after the re-sync must be applied.
+        update = makeFollowerUpdate(4, 5);
+        agent.onUpdate(update);
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 5; }));
+        EXPECT_EQ(followerValue(ms), "5");
+
+        // Transactions we already have are skipped
+        update = makeFollowerUpdate(4, 6);
+        agent.onUpdate(update);
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 6; }));
+        EXPECT_EQ(followerValue(ms), "6");
+    }
+    ms.stop();
+}
+
+TEST(ReplicationFollower, ResyncDuringCommit) {
+
+    MockServer ms;
+    initFollower(ms, 4);
+    ms.startIoThreads();
+
+    {
+        FollowerReplication follower{ms};
+        FollowerReplication::Agent agent{follower};
+
+        // Get a hole from the primary while the first update is committed
+        optional<thread> hole_thread;
+        ms.db().setEntriesChangedCallback([&](const auto& /*changes*/, bool /*zonesChanged*/) {
+            if (hole_thread) {
+                return;
+            }
+            hole_thread.emplace([&agent] {
+                // #4 is missing
+                auto update = makeFollowerUpdate(5, 5);
+                agent.onUpdate(update);
+            });
+
+            // Give the re-sync time to run if it don't wait for the commit
+            this_thread::sleep_for(100ms);
+        });
+
+        auto update = makeFollowerUpdate(1, 3);
+        agent.onUpdate(update);
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 3; }));
+        ASSERT_TRUE(hole_thread.has_value());
+        hole_thread->join();
+        ms.db().setEntriesChangedCallback({});
+        EXPECT_TRUE(waitFor([&] { return !agent.isResyncing(); }));
+
+        // The first update after the re-sync must be committed
+        update = makeFollowerUpdate(4, 5);
+        agent.onUpdate(update);
+        EXPECT_TRUE(waitFor([&] { return agent.trxId() == 5; }));
+        EXPECT_EQ(followerValue(ms), "5");
+    }
+    ms.stop();
+}
+
+TEST(ReplicationBootstrap, FromPrimary) {
+
+    setenv("NSBLAST_CLUSTER_AUTH_KEY", "not-so-secret", 1);
+    const auto address = "127.0.0.1:10931"s;
+
+    MockServer primary;
+    primary->config().cluster_role = "primary";
+    primary->config().cluster_server_addr = address;
+    primary->config().num_dns_threads = 4;
+    primary.initReplication();
+    primary.startGrpcService();
+    primary.startIoThreads();
+
+    primary->createTestZone();
+    primary->createWwwA();
+    {
+        auto trx = primary.db().transaction();
+        trx->write({"example.com"sv, 1001, key_class_t::DIFF}, "diff"s, true, ResourceIf::Category::DIFF);
+        trx->commit();
+    }
+
+    MockServer follower;
+    follower->config().cluster_role = "follower";
+    follower->config().cluster_server_addr = address;
+    follower.initReplication();
+    follower.startGrpcService();
+
+    // Data that the snapshot replaces
+    follower->createTestZone("example.org");
+
+    const auto trxid = follower.grpcFollow().bootstrap();
+    EXPECT_GT(trxid, 0);
+    EXPECT_EQ(trxid, primary.db().getLastCommittedTransactionId());
+    EXPECT_EQ(follower.db().getLastCommittedTransactionId(), trxid);
+
+    {
+        auto trx = follower.db().transaction();
+        EXPECT_TRUE(trx->lookup("example.com"));
+        EXPECT_TRUE(trx->lookup("www.example.com"));
+        EXPECT_FALSE(trx->lookup("example.org"));
+        EXPECT_TRUE(trx->keyExists({"example.com"sv, 1001, key_class_t::DIFF}, ResourceIf::Category::DIFF));
+    }
+    EXPECT_EQ(follower.db().zoneIndex()->findClosest("www.example.com").zone, "example.com");
+    EXPECT_TRUE(follower.db().zoneIndex()->findClosest("www.example.org").zone.empty());
+
+    follower.stop();
+    primary.stop();
+}
+
+TEST(ReplicationSync, BatchesQueuedTransactions) {
+
+    const auto address = "127.0.0.1:10932"s;
+    const size_t max_bytes = 1024;
+    const size_t num_trxs = 60;
+
+    MockServer primary{makeClusterDb("primary")};
+    primary->config().cluster_sync_batch_max_bytes = max_bytes;
+    primary->config().cluster_sync_batch_max_delay = 50;
+    initSyncPrimary(primary, address);
+    addBacklog(primary, num_trxs);
+
+    MockServer follower{makeClusterDb("follower", "none")};
+    ReceivedUpdates received;
+    startRecordingFollower(follower, address, received);
+
+    // The zone is one transaction
+    EXPECT_TRUE(waitFor([&] { return numReceivedTrxs(received) == num_trxs + 1; }));
+
+    {
+        lock_guard lock{received.mutex};
+        EXPECT_EQ(received.last_trxid, primary.db().getLastCommittedTransactionId());
+
+        bool have_batch = false;
+        uint64_t prev_id = 0;
+        for(const auto& update : received.updates) {
+            EXPECT_TRUE(update.compressed().empty());
+            if (update.trxs_size() > 1) {
+                have_batch = true;
+            }
+
+            size_t bytes = 0;
+            for(const auto& trx : update.trxs()) {
+                EXPECT_EQ(trx.id(), prev_id + 1);
+                prev_id = trx.id();
+                bytes += trx.ByteSizeLong();
+            }
+            if (update.has_trx()) {
+                EXPECT_EQ(update.trx().id(), prev_id + 1);
+                prev_id = update.trx().id();
+            }
+            EXPECT_LE(bytes, max_bytes);
+        }
+        EXPECT_TRUE(have_batch);
+    }
+
+    follower.grpcFollow().stop();
+    primary.stop();
+    follower.stop();
+}
+
+TEST(ReplicationSync, CompressOncePerUpdate) {
+
+    setenv("NSBLAST_CLUSTER_AUTH_KEY", "not-so-secret", 1);
+    MockServer primary{makeClusterDb("primary")};
+    MockServer follower{makeClusterDb("follower")};
+    GrpcPrimary grpc_primary{primary};
+    GrpcFollow grpc_follow{follower};
+
+    const auto update = makeLargeUpdate(string(4096, 'a'));
+    const auto compressed = grpc_primary.compress(update);
+    ASSERT_NE(compressed, update);
+    EXPECT_FALSE(compressed->compressed().empty());
+    EXPECT_LT(compressed->compressed().size(), update->ByteSizeLong());
+    EXPECT_EQ(compressed->uncompressedsize(), update->ByteSizeLong());
+
+    // The next follower gets the same compressed update
+    EXPECT_EQ(grpc_primary.compress(update), compressed);
+
+    auto copy = *compressed;
+    EXPECT_TRUE(grpc_follow.decompress(copy));
+    EXPECT_TRUE(copy.compressed().empty());
+    ASSERT_EQ(copy.trxs_size(), update->trxs_size());
+    for(auto i = 0; i < copy.trxs_size(); ++i) {
+        EXPECT_EQ(copy.trxs(i).id(), update->trxs(i).id());
+        EXPECT_EQ(copy.trxs(i).uuid(), update->trxs(i).uuid());
+        EXPECT_EQ(copy.trxs(i).parts(0).value(), update->trxs(i).parts(0).value());
+    }
+
+    // Corrupt data is rejected
+    auto corrupt = *compressed;
+    corrupt.set_uncompressedsize(corrupt.uncompressedsize() + 1);
+    EXPECT_FALSE(grpc_follow.decompress(corrupt));
+}
+
+TEST(ReplicationSync, CompressFallbackToUncompressed) {
+
+    setenv("NSBLAST_CLUSTER_AUTH_KEY", "not-so-secret", 1);
+    MockServer primary{makeClusterDb("primary")};
+    GrpcPrimary grpc_primary{primary};
+
+    // Below cluster_sync_compression_min_bytes
+    const auto small = make_shared<grpc::nsblast::pb::SyncUpdate>(makeFollowerUpdate(1, 1));
+    EXPECT_LT(small->ByteSizeLong(), primary->config().cluster_sync_compression_min_bytes);
+    EXPECT_EQ(grpc_primary.compress(small), small);
+
+    // Random data don't compress
+    mt19937 rnd{42};
+    string noise(4096, 0);
+    for(auto& ch : noise) {
+        ch = static_cast<char>(rnd());
+    }
+    const auto random = makeLargeUpdate(noise);
+    EXPECT_EQ(grpc_primary.compress(random), random);
+    EXPECT_EQ(grpc_primary.compress(random), random);
+
+    // Updates without transactions are not compressed
+    const auto empty = make_shared<grpc::nsblast::pb::SyncUpdate>();
+    empty->set_isinsync(true);
+    EXPECT_EQ(grpc_primary.compress(empty), empty);
+}
+
+TEST(ReplicationSync, CompressedStream) {
+    syncCompressed("lz4");
+}
+
+TEST(ReplicationSync, FollowerWithoutCompression) {
+    // The follower stops the stream if it gets a compressed update
+    syncCompressed("none");
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
 